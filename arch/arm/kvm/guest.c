@@ -39,6 +39,13 @@ struct kvm_stats_debugfs_item debugfs_entries[] = {
 	VCPU_STAT(mmio_exit_user),
 	VCPU_STAT(mmio_exit_kernel),
 	VCPU_STAT(exits),
+	VCPU_STAT(halt_successful_poll),
+	VCPU_STAT(halt_attempted_poll),
+	VCPU_STAT(halt_poll_invalid),
+	VCPU_STAT(halt_poll_success_ns),
+	VCPU_STAT(halt_poll_fail_ns),
+	VCPU_STAT(halt_poll_yield),
+	VCPU_STAT(halt_wakeup),
 	{ NULL }
 };
 
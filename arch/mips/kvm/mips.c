@@ -72,6 +72,9 @@ struct kvm_stats_debugfs_item debugfs_entries[] = {
 	{ "halt_successful_poll", VCPU_STAT(halt_successful_poll), KVM_STAT_VCPU },
 	{ "halt_attempted_poll", VCPU_STAT(halt_attempted_poll), KVM_STAT_VCPU },
 	{ "halt_poll_invalid", VCPU_STAT(halt_poll_invalid), KVM_STAT_VCPU },
+	{ "halt_poll_success_ns", VCPU_STAT(halt_poll_success_ns), KVM_STAT_VCPU },
+	{ "halt_poll_fail_ns", VCPU_STAT(halt_poll_fail_ns), KVM_STAT_VCPU },
+	{ "halt_poll_yield", VCPU_STAT(halt_poll_yield), KVM_STAT_VCPU },
 	{ "halt_wakeup",  VCPU_STAT(halt_wakeup),	 KVM_STAT_VCPU },
 	{NULL}
 };
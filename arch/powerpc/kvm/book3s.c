@@ -59,6 +59,9 @@ struct kvm_stats_debugfs_item debugfs_entries[] = {
 	{ "halt_attempted_poll", VCPU_STAT(halt_attempted_poll), },
 	{ "halt_successful_wait",	VCPU_STAT(halt_successful_wait) },
 	{ "halt_poll_invalid", VCPU_STAT(halt_poll_invalid) },
+	{ "halt_poll_success_ns", VCPU_STAT(halt_poll_success_ns) },
+	{ "halt_poll_fail_ns", VCPU_STAT(halt_poll_fail_ns) },
+	{ "halt_poll_yield", VCPU_STAT(halt_poll_yield) },
 	{ "halt_wakeup", VCPU_STAT(halt_wakeup) },
 	{ "pf_storage",  VCPU_STAT(pf_storage) },
 	{ "sp_storage",  VCPU_STAT(sp_storage) },
@@ -304,6 +304,9 @@ struct kvm_vcpu_stat {
 	u64 halt_successful_poll;
 	u64 halt_attempted_poll;
 	u64 halt_poll_invalid;
+	u64 halt_poll_success_ns;
+	u64 halt_poll_fail_ns;
+	u64 halt_poll_yield;
 	u64 halt_wakeup;
 	u64 instruction_lctl;
 	u64 instruction_lctlg;
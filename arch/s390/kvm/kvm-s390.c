@@ -75,6 +75,9 @@ struct kvm_stats_debugfs_item debugfs_entries[] = {
 	{ "halt_successful_poll", VCPU_STAT(halt_successful_poll) },
 	{ "halt_attempted_poll", VCPU_STAT(halt_attempted_poll) },
 	{ "halt_poll_invalid", VCPU_STAT(halt_poll_invalid) },
+	{ "halt_poll_success_ns", VCPU_STAT(halt_poll_success_ns) },
+	{ "halt_poll_fail_ns", VCPU_STAT(halt_poll_fail_ns) },
+	{ "halt_poll_yield", VCPU_STAT(halt_poll_yield) },
 	{ "halt_wakeup", VCPU_STAT(halt_wakeup) },
 	{ "instruction_lctlg", VCPU_STAT(instruction_lctlg) },
 	{ "instruction_lctl", VCPU_STAT(instruction_lctl) },
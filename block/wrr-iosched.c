@@ -0,0 +1,406 @@
+/*
+ * The WRR I/O scheduler. Shares the device between submitting tasks in
+ * proportion to their SCHED_WRR weight, with deficit round-robin.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/elevator.h>
+#include <linux/module.h>
+#include <linux/sbitmap.h>
+#include <linux/hash.h>
+#include <linux/sched.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-mq-debugfs.h"
+#include "blk-mq-sched.h"
+#include "blk-mq-tag.h"
+
+/*
+ * Requests are first queued on per-CPU lists, where bios are merged, and
+ * moved to per-hctx flows when the hctx dispatches. Submitting tasks are
+ * hashed into a fixed number of flows. Each flow may dispatch as many
+ * requests per round as the WRR weight of its last submitter; tasks that
+ * are not SCHED_WRR count as WRR_DEFAULT_WEIGHT.
+ */
+enum {
+	WRR_IOSCHED_FLOW_BITS = 6,
+	WRR_IOSCHED_NR_FLOWS = 1 << WRR_IOSCHED_FLOW_BITS,
+};
+
+/*
+ * There is a same mapping between ctx & hctx and wcq & whd,
+ * we use request->mq_ctx->index_hw to index the wcq in whd.
+ */
+struct wrr_ctx_queue {
+	/* Protects rq_list, also against merges. */
+	spinlock_t lock;
+	struct list_head rq_list;
+} ____cacheline_aligned_in_smp;
+
+struct wrr_flow {
+	struct list_head rqs;
+	/* Entry in the active list while the flow has requests. */
+	struct list_head active;
+	int deficit;
+	unsigned int weight;
+	unsigned int queued;
+	unsigned long dispatched;
+};
+
+struct wrr_hctx_data {
+	spinlock_t lock;
+	/* Requests inserted at head and requests without a flow. */
+	struct list_head dispatch;
+	/* Flows with requests, in round-robin order. */
+	struct list_head active;
+	struct wrr_flow flows[WRR_IOSCHED_NR_FLOWS];
+	struct wrr_ctx_queue *wcqs;
+	struct sbitmap wcq_map;
+};
+
+static unsigned int rq_get_flow(struct request *rq)
+{
+	return (unsigned long)rq->elv.priv[0];
+}
+
+static unsigned int rq_get_weight(struct request *rq)
+{
+	return (unsigned long)rq->elv.priv[1];
+}
+
+static int wrr_init_sched(struct request_queue *q, struct elevator_type *e)
+{
+	struct elevator_queue *eq;
+
+	eq = elevator_alloc(q, e);
+	if (!eq)
+		return -ENOMEM;
+
+	q->elevator = eq;
+	return 0;
+}
+
+static void wrr_exit_sched(struct elevator_queue *e)
+{
+}
+
+static int wrr_init_hctx(struct blk_mq_hw_ctx *hctx, unsigned int hctx_idx)
+{
+	struct wrr_hctx_data *whd;
+	int i;
+
+	whd = kmalloc_node(sizeof(*whd), GFP_KERNEL, hctx->numa_node);
+	if (!whd)
+		return -ENOMEM;
+
+	whd->wcqs = kmalloc_array_node(hctx->nr_ctx,
+				       sizeof(struct wrr_ctx_queue),
+				       GFP_KERNEL, hctx->numa_node);
+	if (!whd->wcqs)
+		goto err_whd;
+
+	for (i = 0; i < hctx->nr_ctx; i++) {
+		spin_lock_init(&whd->wcqs[i].lock);
+		INIT_LIST_HEAD(&whd->wcqs[i].rq_list);
+	}
+
+	if (sbitmap_init_node(&whd->wcq_map, hctx->nr_ctx, ilog2(8),
+			      GFP_KERNEL, hctx->numa_node))
+		goto err_wcqs;
+
+	spin_lock_init(&whd->lock);
+	INIT_LIST_HEAD(&whd->dispatch);
+	INIT_LIST_HEAD(&whd->active);
+	for (i = 0; i < WRR_IOSCHED_NR_FLOWS; i++) {
+		struct wrr_flow *flow = &whd->flows[i];
+
+		INIT_LIST_HEAD(&flow->rqs);
+		INIT_LIST_HEAD(&flow->active);
+		flow->deficit = 0;
+		flow->weight = WRR_DEFAULT_WEIGHT;
+		flow->queued = 0;
+		flow->dispatched = 0;
+	}
+
+	hctx->sched_data = whd;
+	return 0;
+
+err_wcqs:
+	kfree(whd->wcqs);
+err_whd:
+	kfree(whd);
+	return -ENOMEM;
+}
+
+static void wrr_exit_hctx(struct blk_mq_hw_ctx *hctx, unsigned int hctx_idx)
+{
+	struct wrr_hctx_data *whd = hctx->sched_data;
+
+	sbitmap_free(&whd->wcq_map);
+	kfree(whd->wcqs);
+	kfree(hctx->sched_data);
+}
+
+static bool wrr_bio_merge(struct blk_mq_hw_ctx *hctx, struct bio *bio)
+{
+	struct wrr_hctx_data *whd = hctx->sched_data;
+	struct blk_mq_ctx *ctx = blk_mq_get_ctx(hctx->queue);
+	struct wrr_ctx_queue *wcq = &whd->wcqs[ctx->index_hw];
+	bool merged;
+
+	spin_lock(&wcq->lock);
+	merged = blk_mq_bio_list_merge(hctx->queue, &wcq->rq_list, bio);
+	spin_unlock(&wcq->lock);
+	blk_mq_put_ctx(ctx);
+
+	return merged;
+}
+
+/* Runs in the context of the submitting task. */
+static void wrr_prepare_request(struct request *rq, struct bio *bio)
+{
+	unsigned int weight = WRR_DEFAULT_WEIGHT;
+
+	if (current->policy == SCHED_WRR)
+		weight = READ_ONCE(current->wrr.weight);
+
+	rq->elv.priv[0] = (void *)(unsigned long)hash_32(current->pid,
+							 WRR_IOSCHED_FLOW_BITS);
+	rq->elv.priv[1] = (void *)(unsigned long)weight;
+}
+
+static void wrr_insert_requests(struct blk_mq_hw_ctx *hctx,
+				struct list_head *rq_list, bool at_head)
+{
+	struct wrr_hctx_data *whd = hctx->sched_data;
+	struct request *rq, *next;
+
+	list_for_each_entry_safe(rq, next, rq_list, queuelist) {
+		struct wrr_ctx_queue *wcq = &whd->wcqs[rq->mq_ctx->index_hw];
+
+		/* Requeues and requests without a flow go out first */
+		if (at_head || !(rq->rq_flags & RQF_ELVPRIV)) {
+			spin_lock(&whd->lock);
+			if (at_head)
+				list_move(&rq->queuelist, &whd->dispatch);
+			else
+				list_move_tail(&rq->queuelist, &whd->dispatch);
+			blk_mq_sched_request_inserted(rq);
+			spin_unlock(&whd->lock);
+			continue;
+		}
+
+		spin_lock(&wcq->lock);
+		list_move_tail(&rq->queuelist, &wcq->rq_list);
+		sbitmap_set_bit(&whd->wcq_map, rq->mq_ctx->index_hw);
+		blk_mq_sched_request_inserted(rq);
+		spin_unlock(&wcq->lock);
+	}
+}
+
+/* Called with whd->lock held. */
+static void wrr_flow_add(struct wrr_hctx_data *whd, struct request *rq)
+{
+	struct wrr_flow *flow = &whd->flows[rq_get_flow(rq)];
+
+	list_move_tail(&rq->queuelist, &flow->rqs);
+	flow->weight = rq_get_weight(rq);
+	flow->queued++;
+	if (list_empty(&flow->active)) {
+		flow->deficit = flow->weight;
+		list_add_tail(&flow->active, &whd->active);
+	}
+}
+
+static bool flush_busy_wcq(struct sbitmap *sb, unsigned int bitnr, void *data)
+{
+	struct wrr_hctx_data *whd = data;
+	struct wrr_ctx_queue *wcq = &whd->wcqs[bitnr];
+	struct request *rq, *next;
+
+	spin_lock(&wcq->lock);
+	list_for_each_entry_safe(rq, next, &wcq->rq_list, queuelist)
+		wrr_flow_add(whd, rq);
+	sbitmap_clear_bit(sb, bitnr);
+	spin_unlock(&wcq->lock);
+
+	return true;
+}
+
+/*
+ * Deficit round-robin: the flow at the head dispatches while it has
+ * credit, then goes to the tail with its weight added. Every flow is
+ * passed over at most once per request, and only while it is out of
+ * credit, so this is O(1) amortized.
+ */
+static struct request *wrr_dispatch_flow(struct wrr_hctx_data *whd)
+{
+	struct wrr_flow *flow;
+	struct request *rq;
+
+	while ((flow = list_first_entry_or_null(&whd->active, struct wrr_flow,
+						active))) {
+		if (flow->deficit <= 0) {
+			flow->deficit += flow->weight;
+			list_move_tail(&flow->active, &whd->active);
+			continue;
+		}
+
+		rq = list_first_entry(&flow->rqs, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		flow->deficit--;
+		flow->queued--;
+		flow->dispatched++;
+		if (list_empty(&flow->rqs))
+			list_del_init(&flow->active);
+		return rq;
+	}
+
+	return NULL;
+}
+
+static struct request *wrr_dispatch_request(struct blk_mq_hw_ctx *hctx)
+{
+	struct wrr_hctx_data *whd = hctx->sched_data;
+	struct request *rq;
+
+	spin_lock(&whd->lock);
+
+	rq = list_first_entry_or_null(&whd->dispatch, struct request,
+				      queuelist);
+	if (rq) {
+		list_del_init(&rq->queuelist);
+		goto out;
+	}
+
+	/* Sort what the CPUs queued since the last dispatch into flows */
+	if (sbitmap_any_bit_set(&whd->wcq_map))
+		sbitmap_for_each_set(&whd->wcq_map, flush_busy_wcq, whd);
+
+	rq = wrr_dispatch_flow(whd);
+out:
+	spin_unlock(&whd->lock);
+	return rq;
+}
+
+static bool wrr_has_work(struct blk_mq_hw_ctx *hctx)
+{
+	struct wrr_hctx_data *whd = hctx->sched_data;
+
+	return !list_empty_careful(&whd->dispatch) ||
+	       !list_empty_careful(&whd->active) ||
+	       sbitmap_any_bit_set(&whd->wcq_map);
+}
+
+#ifdef CONFIG_BLK_DEBUG_FS
+static int wrr_flows_show(void *data, struct seq_file *m)
+{
+	struct blk_mq_hw_ctx *hctx = data;
+	struct wrr_hctx_data *whd = hctx->sched_data;
+	int i;
+
+	spin_lock(&whd->lock);
+	for (i = 0; i < WRR_IOSCHED_NR_FLOWS; i++) {
+		struct wrr_flow *flow = &whd->flows[i];
+
+		if (!flow->queued && !flow->dispatched)
+			continue;
+		seq_printf(m, "%d weight=%u deficit=%d queued=%u dispatched=%lu\n",
+			   i, flow->weight, flow->deficit, flow->queued,
+			   flow->dispatched);
+	}
+	spin_unlock(&whd->lock);
+	return 0;
+}
+
+static void *wrr_dispatch_start(struct seq_file *m, loff_t *pos)
+	__acquires(&whd->lock)
+{
+	struct blk_mq_hw_ctx *hctx = m->private;
+	struct wrr_hctx_data *whd = hctx->sched_data;
+
+	spin_lock(&whd->lock);
+	return seq_list_start(&whd->dispatch, *pos);
+}
+
+static void *wrr_dispatch_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	struct blk_mq_hw_ctx *hctx = m->private;
+	struct wrr_hctx_data *whd = hctx->sched_data;
+
+	return seq_list_next(v, &whd->dispatch, pos);
+}
+
+static void wrr_dispatch_stop(struct seq_file *m, void *v)
+	__releases(&whd->lock)
+{
+	struct blk_mq_hw_ctx *hctx = m->private;
+	struct wrr_hctx_data *whd = hctx->sched_data;
+
+	spin_unlock(&whd->lock);
+}
+
+static const struct seq_operations wrr_dispatch_seq_ops = {
+	.start	= wrr_dispatch_start,
+	.next	= wrr_dispatch_next,
+	.stop	= wrr_dispatch_stop,
+	.show	= blk_mq_debugfs_rq_show,
+};
+
+static const struct blk_mq_debugfs_attr wrr_hctx_debugfs_attrs[] = {
+	{"dispatch", 0400, .seq_ops = &wrr_dispatch_seq_ops},
+	{"flows", 0400, wrr_flows_show},
+	{},
+};
+#endif
+
+static struct elevator_type wrr_sched = {
+	.ops.mq = {
+		.init_sched = wrr_init_sched,
+		.exit_sched = wrr_exit_sched,
+		.init_hctx = wrr_init_hctx,
+		.exit_hctx = wrr_exit_hctx,
+		.bio_merge = wrr_bio_merge,
+		.prepare_request = wrr_prepare_request,
+		.insert_requests = wrr_insert_requests,
+		.dispatch_request = wrr_dispatch_request,
+		.has_work = wrr_has_work,
+	},
+	.uses_mq = true,
+#ifdef CONFIG_BLK_DEBUG_FS
+	.hctx_debugfs_attrs = wrr_hctx_debugfs_attrs,
+#endif
+	.elevator_name = "wrr",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init wrr_iosched_init(void)
+{
+	return elv_register(&wrr_sched);
+}
+
+static void __exit wrr_iosched_exit(void)
+{
+	elv_unregister(&wrr_sched);
+}
+
+module_init(wrr_iosched_init);
+module_exit(wrr_iosched_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("WRR I/O scheduler");
@@ -21,8 +21,9 @@ EXPORT_SYMBOL_GPL(kcrypto_wq);
 
 static int __init crypto_wq_init(void)
 {
-	kcrypto_wq = alloc_workqueue("crypto",
-				     WQ_MEM_RECLAIM | WQ_CPU_INTENSIVE, 1);
+	/* cryptd and mcryptd requests run at the weight of their submitter */
+	kcrypto_wq = alloc_workqueue("crypto", WQ_MEM_RECLAIM |
+				     WQ_CPU_INTENSIVE | WQ_WRR_INHERIT, 1);
 	if (unlikely(!kcrypto_wq))
 		return -ENOMEM;
 	return 0;
@@ -15,6 +15,8 @@
 #include <linux/blk-mq.h>
 #include <linux/blk-mq-virtio.h>
 #include <linux/numa.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #define PART_BITS 4
 #define VQ_NAME_LEN 16
@@ -23,11 +25,22 @@ static int major;
 static DEFINE_IDA(vd_index_ida);
 
 static struct workqueue_struct *virtblk_wq;
+static struct dentry *virtblk_debugfs_root;
+
+/* Per-virtqueue counters, protected by the virtqueue lock */
+struct virtio_blk_vq_stats {
+	unsigned long queued;		/* requests added to the ring */
+	unsigned long kicks;		/* notifications sent to the host */
+	unsigned long irqs;		/* completion interrupts */
+	unsigned long completed;	/* requests completed from interrupts */
+	unsigned long polled;		/* requests completed by blk_poll() */
+};
 
 struct virtio_blk_vq {
 	struct virtqueue *vq;
 	spinlock_t lock;
 	char name[VQ_NAME_LEN];
+	struct virtio_blk_vq_stats stats;
 } ____cacheline_aligned_in_smp;
 
 struct virtio_blk {
@@ -51,6 +64,9 @@ struct virtio_blk {
 	/* num of vqs */
 	int num_vqs;
 	struct virtio_blk_vq *vqs;
+
+	/* debugfs directory of the disk */
+	struct dentry *debugfs_dir;
 };
 
 struct virtblk_req {
@@ -196,12 +212,14 @@ static void virtblk_done(struct virtqueue *vq)
 	unsigned int len;
 
 	spin_lock_irqsave(&vblk->vqs[qid].lock, flags);
+	vblk->vqs[qid].stats.irqs++;
 	do {
 		virtqueue_disable_cb(vq);
 		while ((vbr = virtqueue_get_buf(vblk->vqs[qid].vq, &len)) != NULL) {
 			struct request *req = blk_mq_rq_from_pdu(vbr);
 
 			blk_mq_complete_request(req);
+			vblk->vqs[qid].stats.completed++;
 			req_done = true;
 		}
 		if (unlikely(virtqueue_is_broken(vq)))
@@ -214,6 +232,40 @@ static void virtblk_done(struct virtqueue *vq)
 	spin_unlock_irqrestore(&vblk->vqs[qid].lock, flags);
 }
 
+/*
+ * Reap the completions of the virtqueue behind @hctx for blk_poll(), when
+ * polling is enabled through the io_poll queue attribute.  Interrupts stay
+ * enabled, so virtblk_done() picks up whatever the poller leaves behind.
+ */
+static int virtblk_poll(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	struct virtio_blk_vq *vq = &vblk->vqs[hctx->queue_num];
+	struct virtblk_req *vbr;
+	unsigned long flags;
+	unsigned int len;
+	bool req_done = false;
+	int found = 0;
+
+	spin_lock_irqsave(&vq->lock, flags);
+	while ((vbr = virtqueue_get_buf(vq->vq, &len)) != NULL) {
+		struct request *req = blk_mq_rq_from_pdu(vbr);
+
+		if (req->tag == tag)
+			found = 1;
+		blk_mq_complete_request(req);
+		vq->stats.polled++;
+		req_done = true;
+	}
+
+	/* In case queue is stopped waiting for more buffers. */
+	if (req_done)
+		blk_mq_start_stopped_hw_queues(hctx->queue, true);
+	spin_unlock_irqrestore(&vq->lock, flags);
+
+	return found;
+}
+
 static blk_status_t virtio_queue_rq(struct blk_mq_hw_ctx *hctx,
 			   const struct blk_mq_queue_data *bd)
 {
@@ -280,8 +332,11 @@ static blk_status_t virtio_queue_rq(struct blk_mq_hw_ctx *hctx,
 		return BLK_STS_IOERR;
 	}
 
-	if (bd->last && virtqueue_kick_prepare(vblk->vqs[qid].vq))
+	vblk->vqs[qid].stats.queued++;
+	if (bd->last && virtqueue_kick_prepare(vblk->vqs[qid].vq)) {
+		vblk->vqs[qid].stats.kicks++;
 		notify = true;
+	}
 	spin_unlock_irqrestore(&vblk->vqs[qid].lock, flags);
 
 	if (notify)
@@ -448,7 +503,7 @@ static int init_vq(struct virtio_blk *vblk)
 
 	num_vqs = min_t(unsigned int, nr_cpu_ids, num_vqs);
 
-	vblk->vqs = kmalloc_array(num_vqs, sizeof(*vblk->vqs), GFP_KERNEL);
+	vblk->vqs = kcalloc(num_vqs, sizeof(*vblk->vqs), GFP_KERNEL);
 	if (!vblk->vqs)
 		return -ENOMEM;
 
@@ -621,8 +676,46 @@ static const struct blk_mq_ops virtio_mq_ops = {
 	.initialize_rq_fn = virtblk_initialize_rq,
 #endif
 	.map_queues	= virtblk_map_queues,
+	.poll		= virtblk_poll,
 };
 
+static int virtblk_debugfs_queues_show(struct seq_file *m, void *v)
+{
+	struct virtio_blk *vblk = m->private;
+	struct request_queue *q = vblk->disk->queue;
+	struct virtio_blk_vq_stats stats;
+	unsigned long flags;
+	int i;
+
+	seq_puts(m, "vq       cpus     queued     kicks      irqs       completed  polled\n");
+	for (i = 0; i < vblk->num_vqs; i++) {
+		spin_lock_irqsave(&vblk->vqs[i].lock, flags);
+		stats = vblk->vqs[i].stats;
+		spin_unlock_irqrestore(&vblk->vqs[i].lock, flags);
+
+		seq_printf(m, "%-8s %-8.*pbl %-10lu %-10lu %-10lu %-10lu %lu\n",
+			   vblk->vqs[i].name,
+			   cpumask_pr_args(q->queue_hw_ctx[i]->cpumask),
+			   stats.queued, stats.kicks, stats.irqs,
+			   stats.completed, stats.polled);
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(virtblk_debugfs_queues);
+
+static void virtblk_debugfs_init(struct virtio_blk *vblk)
+{
+	vblk->debugfs_dir = debugfs_create_dir(vblk->disk->disk_name,
+					       virtblk_debugfs_root);
+	if (IS_ERR_OR_NULL(vblk->debugfs_dir)) {
+		vblk->debugfs_dir = NULL;
+		return;
+	}
+
+	debugfs_create_file("queues", 0444, vblk->debugfs_dir, vblk,
+			    &virtblk_debugfs_queues_fops);
+}
+
 static unsigned int virtblk_queue_depth;
 module_param_named(queue_depth, virtblk_queue_depth, uint, 0444);
 
@@ -795,6 +888,8 @@ static int virtblk_probe(struct virtio_device *vdev)
 					 &dev_attr_cache_type_ro);
 	if (err)
 		goto out_del_disk;
+
+	virtblk_debugfs_init(vblk);
 	return 0;
 
 out_del_disk:
@@ -823,6 +918,7 @@ static void virtblk_remove(struct virtio_device *vdev)
 	/* Make sure no work handler is accessing the device. */
 	flush_work(&vblk->config_work);
 
+	debugfs_remove_recursive(vblk->debugfs_dir);
 	del_gendisk(vblk->disk);
 	blk_cleanup_queue(vblk->disk->queue);
 
@@ -922,6 +1018,8 @@ static int __init init(void)
 	if (!virtblk_wq)
 		return -ENOMEM;
 
+	virtblk_debugfs_root = debugfs_create_dir("virtio-blk", NULL);
+
 	major = register_blkdev(0, "virtblk");
 	if (major < 0) {
 		error = major;
@@ -936,6 +1034,7 @@ static int __init init(void)
 out_unregister_blkdev:
 	unregister_blkdev(major, "virtblk");
 out_destroy_workqueue:
+	debugfs_remove(virtblk_debugfs_root);
 	destroy_workqueue(virtblk_wq);
 	return error;
 }
@@ -944,6 +1043,7 @@ static void __exit fini(void)
 {
 	unregister_virtio_driver(&virtio_blk);
 	unregister_blkdev(major, "virtblk");
+	debugfs_remove(virtblk_debugfs_root);
 	destroy_workqueue(virtblk_wq);
 }
 module_init(init);
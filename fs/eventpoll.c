@@ -228,6 +228,19 @@ struct eventpoll {
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	/* used to track busy poll napi_id */
 	unsigned int napi_id;
+
+	/*
+	 * Adaptive busy poll budget, see ep_busy_poll_budget().  Threads
+	 * waiting on the same eventpoll update these without locking, they
+	 * are only hints and statistics.
+	 */
+	unsigned long busy_poll_last;	/* when events were last found */
+	unsigned int busy_poll_gap;	/* average gap between events, usecs */
+	unsigned int busy_poll_usecs;	/* budget of the current busy poll */
+	unsigned int busy_poll_streak;	/* busy polls in a row that missed */
+	unsigned long busy_poll_hits;
+	unsigned long busy_poll_misses;
+	unsigned long busy_poll_yields;	/* stopped for other WRR tasks */
 #endif
 };
 
@@ -385,16 +398,83 @@ static inline int ep_events_available(struct eventpoll *ep)
 }
 
 #ifdef CONFIG_NET_RX_BUSY_POLL
+/* Maximum number of halvings of the busy poll budget after misses */
+#define EP_BUSY_POLL_MAX_SHIFT	4
+/* Event gaps are averaged over about 1 << EP_BUSY_POLL_GAP_SHIFT samples */
+#define EP_BUSY_POLL_GAP_SHIFT	3
+/* Longest event gap accounted, in usecs */
+#define EP_BUSY_POLL_MAX_GAP	USEC_PER_SEC
+
+/*
+ * The busy poll budget, in usecs, is net.core.busy_poll capped at twice
+ * the average gap between events: spinning longer than that is unlikely
+ * to find anything a sleep would not.  It is halved for every busy poll
+ * in a row that found nothing, so an idle eventpoll soon stops burning
+ * its timeslice, and restored by the first one that finds events.
+ */
+static unsigned int ep_busy_poll_budget(struct eventpoll *ep)
+{
+	unsigned int budget = READ_ONCE(sysctl_net_busy_poll);
+	unsigned int gap = READ_ONCE(ep->busy_poll_gap);
+
+	if (!budget)
+		return 0;
+
+	if (gap)
+		budget = min(budget, 2 * gap);
+	budget >>= min_t(unsigned int, READ_ONCE(ep->busy_poll_streak),
+			 EP_BUSY_POLL_MAX_SHIFT);
+	return max(budget, 1U);
+}
+
+/*
+ * Account events found by ep_poll(), to track the average gap between
+ * them.
+ */
+static void ep_busy_poll_account_events(struct eventpoll *ep)
+{
+	unsigned long now, gap;
+	unsigned int avg;
+
+	if (!net_busy_loop_on())
+		return;
+
+	now = busy_loop_current_time();
+	gap = clamp_t(unsigned long, now - READ_ONCE(ep->busy_poll_last),
+		      1, EP_BUSY_POLL_MAX_GAP);
+	WRITE_ONCE(ep->busy_poll_last, now);
+
+	/* 0 until the first events, the average is then at least 1 */
+	avg = READ_ONCE(ep->busy_poll_gap);
+	if (avg)
+		avg += ((long)gap - (long)avg) >> EP_BUSY_POLL_GAP_SHIFT;
+	else
+		avg = gap;
+	WRITE_ONCE(ep->busy_poll_gap, avg);
+}
+
+/*
+ * Stop spinning when events are found, when the budget runs out, or when
+ * other WRR tasks are waiting for this CPU: they would otherwise wait for
+ * the whole timeslice of the busy poller, which finds nothing meanwhile
+ * that a sleep would not.
+ */
 static bool ep_busy_loop_end(void *p, unsigned long start_time)
 {
 	struct eventpoll *ep = p;
 
-	return ep_events_available(ep) || busy_loop_timeout(start_time);
+	if (ep_events_available(ep))
+		return true;
+	if (sched_wrr_contended())
+		return true;
+	return time_after(busy_loop_current_time(),
+			  start_time + READ_ONCE(ep->busy_poll_usecs));
 }
 
 /*
  * Busy poll if globally on and supporting sockets found && no events,
- * busy loop will return if need_resched or ep_events_available.
+ * busy loop will return if need_resched, ep_events_available, or when
+ * other tasks wait for this CPU.
  *
  * we must do our busy polling with irqs enabled
  */
@@ -402,8 +482,27 @@ static void ep_busy_loop(struct eventpoll *ep, int nonblock)
 {
 	unsigned int napi_id = READ_ONCE(ep->napi_id);
 
-	if ((napi_id >= MIN_NAPI_ID) && net_busy_loop_on())
-		napi_busy_loop(napi_id, nonblock ? NULL : ep_busy_loop_end, ep);
+	if (!(napi_id >= MIN_NAPI_ID) || !net_busy_loop_on())
+		return;
+
+	if (nonblock) {
+		napi_busy_loop(napi_id, NULL, ep);
+		return;
+	}
+
+	WRITE_ONCE(ep->busy_poll_usecs, ep_busy_poll_budget(ep));
+	napi_busy_loop(napi_id, ep_busy_loop_end, ep);
+
+	if (ep_events_available(ep)) {
+		ep->busy_poll_hits++;
+		WRITE_ONCE(ep->busy_poll_streak, 0);
+	} else if (sched_wrr_contended()) {
+		/* cut short, says nothing about the budget */
+		ep->busy_poll_yields++;
+	} else {
+		ep->busy_poll_misses++;
+		WRITE_ONCE(ep->busy_poll_streak, ep->busy_poll_streak + 1);
+	}
 }
 
 static inline void ep_reset_busy_poll_napi_id(struct eventpoll *ep)
@@ -450,6 +549,10 @@ static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
 
 #else
 
+static inline void ep_busy_poll_account_events(struct eventpoll *ep)
+{
+}
+
 static inline void ep_busy_loop(struct eventpoll *ep, int nonblock)
 {
 }
@@ -949,6 +1052,13 @@ static void ep_show_fdinfo(struct seq_file *m, struct file *f)
 	struct eventpoll *ep = f->private_data;
 	struct rb_node *rbp;
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	seq_printf(m, "busy_poll: budget_us: %u gap_us: %u hits: %lu misses: %lu yields: %lu\n",
+		   ep_busy_poll_budget(ep), READ_ONCE(ep->busy_poll_gap),
+		   ep->busy_poll_hits, ep->busy_poll_misses,
+		   ep->busy_poll_yields);
+#endif
+
 	mutex_lock(&ep->mtx);
 	for (rbp = rb_first_cached(&ep->rbr); rbp; rbp = rb_next(rbp)) {
 		struct epitem *epi = rb_entry(rbp, struct epitem, rbn);
@@ -1831,6 +1941,9 @@ check_events:
 
 	spin_unlock_irq(&ep->wq.lock);
 
+	if (eavail)
+		ep_busy_poll_account_events(ep);
+
 	/*
 	 * Try to transfer events to user space. In case we get 0 events and
 	 * there's still timeout left over, we go trying again in search of
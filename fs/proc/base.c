@@ -676,9 +676,9 @@ int proc_setattr(struct dentry *dentry, struct iattr *attr)
  * May current process learn task's sched/cmdline info (for hide_pid_min=1)
  * or euid/egid (for hide_pid_min=2)?
  */
-static bool has_pid_permissions(struct pid_namespace *pid,
-				 struct task_struct *task,
-				 int hide_pid_min)
+bool has_pid_permissions(struct pid_namespace *pid,
+			 struct task_struct *task,
+			 int hide_pid_min)
 {
 	if (pid->hide_pid < hide_pid_min)
 		return true;
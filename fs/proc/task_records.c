@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * /proc/task_records: fixed-size binary scheduling records of all the
+ * threads of a pid namespace, see include/uapi/linux/sched/task_record.h.
+ * It saves monitoring agents from opening and parsing /proc/<pid>/stat
+ * and status for every thread.
+ */
+#include <linux/cgroup.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/pid_namespace.h>
+#include <linux/proc_fs.h>
+#include <linux/sched.h>
+#include <linux/sched/cputime.h>
+#include <linux/sched/task.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <uapi/linux/sched/task_record.h>
+#include "internal.h"
+
+/* The next thread at or after tid @nr, with a reference held */
+static struct task_struct *next_task(struct pid_namespace *ns, int nr)
+{
+	struct task_struct *task = NULL;
+	struct pid *pid;
+
+	rcu_read_lock();
+	while ((pid = find_ge_pid(nr, ns))) {
+		task = pid_task(pid, PIDTYPE_PID);
+		if (task) {
+			get_task_struct(task);
+			break;
+		}
+		nr = pid_nr_ns(pid, ns) + 1;
+	}
+	rcu_read_unlock();
+
+	return task;
+}
+
+static void fill_task_record(struct task_record *rec, struct task_struct *task,
+			     struct pid_namespace *ns)
+{
+	u64 utime, stime;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->size = sizeof(*rec);
+	rec->pid = task_pid_nr_ns(task, ns);
+	rec->tgid = task_tgid_nr_ns(task, ns);
+	rec->policy = task->policy;
+	rec->nice = task_nice(task);
+	rec->state = task_state_index(task);
+	rec->cpu = task_cpu(task);
+	if (task->policy == SCHED_WRR) {
+		rec->wrr_weight = READ_ONCE(task->wrr.weight);
+		rec->wrr_time_slice = READ_ONCE(task->wrr.time_slice);
+	}
+
+	task_cputime_adjusted(task, &utime, &stime);
+	rec->utime = utime;
+	rec->stime = stime;
+	rec->runtime = task->se.sum_exec_runtime;
+#ifdef CONFIG_SCHED_INFO
+	rec->run_delay = task->sched_info.run_delay;
+	rec->pcount = task->sched_info.pcount;
+#endif
+	rec->nvcsw = task->nvcsw;
+	rec->nivcsw = task->nivcsw;
+	rec->start_time = task->start_time;
+	get_task_comm(rec->comm, task);
+}
+
+#ifdef CONFIG_CGROUPS
+/* Protects the cgroup filter of the open files against concurrent writes */
+static DEFINE_SPINLOCK(task_records_lock);
+
+/* The cgroup filter of @file, with a reference held, or NULL */
+static struct cgroup *task_records_filter(struct file *file)
+{
+	struct cgroup *cgrp;
+
+	spin_lock(&task_records_lock);
+	cgrp = file->private_data;
+	if (cgrp)
+		cgroup_get(cgrp);
+	spin_unlock(&task_records_lock);
+
+	return cgrp;
+}
+
+static void task_records_put_filter(struct cgroup *cgrp)
+{
+	if (cgrp)
+		cgroup_put(cgrp);
+}
+
+static bool task_records_match(struct task_struct *task, struct cgroup *cgrp)
+{
+	bool ret;
+
+	if (!cgrp)
+		return true;
+
+	rcu_read_lock();
+	ret = task_under_cgroup_hierarchy(task, cgrp);
+	rcu_read_unlock();
+
+	return ret;
+}
+#else
+static inline struct cgroup *task_records_filter(struct file *file)
+{
+	return NULL;
+}
+
+static inline void task_records_put_filter(struct cgroup *cgrp)
+{
+}
+
+static inline bool task_records_match(struct task_struct *task,
+				      struct cgroup *cgrp)
+{
+	return true;
+}
+#endif
+
+static ssize_t task_records_read(struct file *file, char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	struct pid_namespace *ns = proc_pid_ns(file_inode(file));
+	struct cgroup *cgrp = task_records_filter(file);
+	struct task_record rec;
+	struct task_struct *task;
+	ssize_t copied = 0;
+	loff_t nr = *ppos;
+
+	while (count - copied >= sizeof(rec) && nr <= PID_MAX_LIMIT) {
+		task = next_task(ns, nr);
+		if (!task)
+			break;
+		nr = task_pid_nr_ns(task, ns) + 1;
+
+		if (task_records_match(task, cgrp) &&
+		    has_pid_permissions(ns, task, HIDEPID_NO_ACCESS)) {
+			fill_task_record(&rec, task, ns);
+			if (copy_to_user(buf + copied, &rec, sizeof(rec))) {
+				put_task_struct(task);
+				/* Resume from this thread */
+				nr--;
+				if (!copied)
+					copied = -EFAULT;
+				break;
+			}
+			copied += sizeof(rec);
+		}
+		put_task_struct(task);
+
+		if (fatal_signal_pending(current))
+			break;
+		cond_resched();
+	}
+
+	*ppos = nr;
+	task_records_put_filter(cgrp);
+	return copied;
+}
+
+#ifdef CONFIG_CGROUPS
+/* Restrict the records to a cgroup2 directory and its descendants */
+static ssize_t task_records_write(struct file *file, const char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	struct cgroup *cgrp, *old;
+	char *path;
+
+	path = memdup_user_nul(buf, count);
+	if (IS_ERR(path))
+		return PTR_ERR(path);
+
+	cgrp = cgroup_get_from_path(strim(path));
+	kfree(path);
+	if (IS_ERR(cgrp))
+		return PTR_ERR(cgrp);
+
+	spin_lock(&task_records_lock);
+	old = file->private_data;
+	file->private_data = cgrp;
+	spin_unlock(&task_records_lock);
+	if (old)
+		cgroup_put(old);
+	return count;
+}
+
+static int task_records_release(struct inode *inode, struct file *file)
+{
+	if (file->private_data)
+		cgroup_put(file->private_data);
+	return 0;
+}
+#endif
+
+static const struct file_operations task_records_fops = {
+	.read		= task_records_read,
+#ifdef CONFIG_CGROUPS
+	.write		= task_records_write,
+	.release	= task_records_release,
+#endif
+	.llseek		= default_llseek,
+};
+
+static int __init proc_task_records_init(void)
+{
+	proc_create("task_records", 0644, NULL, &task_records_fops);
+	return 0;
+}
+fs_initcall(proc_task_records_init);
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _BPF_WRR_H
+#define _BPF_WRR_H
+
+#include <uapi/linux/bpf.h>
+
+struct task_struct;
+
+#ifdef CONFIG_BPF_SYSCALL
+int wrr_prog_attach(const union bpf_attr *attr, struct bpf_prog *prog);
+int wrr_prog_detach(const union bpf_attr *attr);
+int wrr_prog_query(const union bpf_attr *attr, union bpf_attr __user *uattr);
+int wrr_bpf_select_cpu(struct task_struct *p, int prev_cpu, int cpu);
+bool wrr_bpf_allow_migration(struct task_struct *p, int src_cpu, int dst_cpu);
+#else
+static inline int wrr_prog_attach(const union bpf_attr *attr,
+				  struct bpf_prog *prog)
+{
+	return -EINVAL;
+}
+
+static inline int wrr_prog_detach(const union bpf_attr *attr)
+{
+	return -EINVAL;
+}
+
+static inline int wrr_prog_query(const union bpf_attr *attr,
+				 union bpf_attr __user *uattr)
+{
+	return -EINVAL;
+}
+
+static inline int wrr_bpf_select_cpu(struct task_struct *p, int prev_cpu,
+				     int cpu)
+{
+	return cpu;
+}
+
+static inline bool wrr_bpf_allow_migration(struct task_struct *p,
+					   int src_cpu, int dst_cpu)
+{
+	return true;
+}
+#endif
+
+#endif /* _BPF_WRR_H */
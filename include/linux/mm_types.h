@@ -490,6 +490,10 @@ struct mm_struct {
 #if IS_ENABLED(CONFIG_HMM)
 		/* HMM needs to track a few things per mm */
 		struct hmm *hmm;
+#endif
+#ifdef CONFIG_FUTEX
+		/* hash of the private futexes, set up by their first use */
+		struct futex_private_hash *futex_hash;
 #endif
 	} __randomize_layout;
 
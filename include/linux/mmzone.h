@@ -276,6 +276,15 @@ struct per_cpu_pages {
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 
+	/*
+	 * high and batch are used scaled by 1 << scale, which grows while
+	 * the lists keep being drained and refilled, see pcp_adapt().
+	 */
+	u8 scale;
+	unsigned int nr_bulk;		/* churn since the last pcp_adapt() */
+	unsigned long nr_zone_lock;	/* zone->lock taken for the lists */
+	unsigned long nr_refill;	/* refills from the buddy allocator */
+
 	/* Lists of pages, one per migrate type stored on the pcp-lists */
 	struct list_head lists[MIGRATE_PCPTYPES];
 };
@@ -620,6 +629,9 @@ extern struct page *mem_map;
  * Memory statistics and page replacement data structures are maintained on a
  * per-zone basis.
  */
+/* Maximum number of kswapd threads per node, see vm.kswapd_threads */
+#define MAX_KSWAPD_THREADS	16
+
 struct bootmem_data;
 typedef struct pglist_data {
 	struct zone node_zones[MAX_NR_ZONES];
@@ -655,11 +667,20 @@ typedef struct pglist_data {
 	int node_id;
 	wait_queue_head_t kswapd_wait;
 	wait_queue_head_t pfmemalloc_wait;
-	struct task_struct *kswapd;	/* Protected by
-					   mem_hotplug_begin/end() */
+	/*
+	 * kswapd[0] is woken by allocators, the others help it reclaim.
+	 * Protected by mem_hotplug_begin/end().
+	 */
+	struct task_struct *kswapd[MAX_KSWAPD_THREADS];
 	int kswapd_order;
 	enum zone_type kswapd_classzone_idx;
 
+	/* Reclaim request handed by kswapd[0] to its helpers */
+	wait_queue_head_t kswapd_helper_wait;
+	unsigned long kswapd_helper_seq;
+	int kswapd_helper_order;
+	enum zone_type kswapd_helper_classzone_idx;
+
 	int kswapd_failures;		/* Number of 'reclaimed == 0' runs */
 
 #ifdef CONFIG_COMPACTION
@@ -887,6 +908,8 @@ int min_free_kbytes_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
 int watermark_scale_factor_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
+int kswapd_threads_sysctl_handler(struct ctl_table *, int,
+					void __user *, size_t *, loff_t *);
 extern int sysctl_lowmem_reserve_ratio[MAX_NR_ZONES];
 int lowmem_reserve_ratio_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
@@ -573,8 +573,12 @@ struct sched_wrr_entity {
 	unsigned int time_slice;	// remaining time slice
 	struct list_head run_list;	// list node used in a runqueue
 	unsigned short on_rq;		// 1 if task is on a runqueue, 0 otherwise
+	int last_cpu;			// CPU the task was on before its last migration, -1 if never migrated
+	u64 wait_start;			// runqueue clock when the task last started waiting
 };
 
+#define WRR_MIN_WEIGHT 1
+#define WRR_MAX_WEIGHT 20
 #define WRR_DEFAULT_WEIGHT 10
 #define WRR_TIMESLICE (10 * HZ / 1000) // 10ms
 
@@ -1545,6 +1549,8 @@ extern int sched_setscheduler(struct task_struct *, int, const struct sched_para
 extern int sched_setscheduler_nocheck(struct task_struct *, int, const struct sched_param *);
 extern int sched_setattr(struct task_struct *, const struct sched_attr *);
 extern int sched_setattr_nocheck(struct task_struct *, const struct sched_attr *);
+extern int sched_set_wrr_weight(struct task_struct *p, unsigned int weight);
+extern bool sched_wrr_contended(void);
 extern struct task_struct *idle_task(int cpu);
 
 /**
@@ -67,6 +67,22 @@ extern unsigned int sysctl_sched_autogroup_enabled;
 extern int sysctl_sched_rr_timeslice;
 extern int sched_rr_timeslice;
 
+/*
+ *  control WRR task placement:
+ *
+ *  /proc/sys/kernel/sched_wrr_select_mode
+ *  /proc/sys/kernel/sched_wrr_select_samples
+ */
+enum sched_wrr_select_mode {
+	SCHED_WRR_SELECT_SCAN,		/* the lightest of all allowed CPUs */
+	SCHED_WRR_SELECT_SAMPLE,	/* the lightest of prev_cpu and a few random ones */
+	SCHED_WRR_NR_SELECT_MODES,
+};
+#define SCHED_WRR_SELECT_MAX_SAMPLES	16
+
+extern int sysctl_sched_wrr_select_mode;
+extern int sysctl_sched_wrr_select_samples;
+
 extern int sched_rr_handler(struct ctl_table *table, int write,
 		void __user *buffer, size_t *lenp,
 		loff_t *ppos);
@@ -109,6 +109,10 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 #ifdef CONFIG_SWAP
 		SWAP_RA,
 		SWAP_RA_HIT,
+#endif
+#ifdef CONFIG_MEMCG
+		MEMCG_STOCK_HIT,	/* charge served from the per-cpu stock */
+		MEMCG_STOCK_MISS,	/* charge went to the page counters */
 #endif
 		NR_VM_EVENT_ITEMS
 };
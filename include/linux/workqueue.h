@@ -145,6 +145,11 @@ struct workqueue_attrs {
 	 */
 	cpumask_var_t cpumask;
 
+	/**
+	 * @wrr_weight: SCHED_WRR weight of the workers, 0 for the default
+	 */
+	unsigned int wrr_weight;
+
 	/**
 	 * @no_numa: disable NUMA affinity
 	 *
@@ -340,6 +345,15 @@ enum {
 	 */
 	WQ_POWER_EFFICIENT	= 1 << 7,
 
+	/*
+	 * Run each work item of a per-cpu workqueue in the worker pool of
+	 * the WRR weight tier of the task that queued it, so that deferred
+	 * work keeps the priority of its submitter. Ignored for WQ_UNBOUND
+	 * workqueues, which take a weight from their attrs, and for
+	 * WQ_HIGHPRI ones, which always run in the high tier.
+	 */
+	WQ_WRR_INHERIT		= 1 << 8,
+
 	__WQ_DRAINING		= 1 << 16, /* internal: workqueue is draining */
 	__WQ_ORDERED		= 1 << 17, /* internal: workqueue is ordered */
 	__WQ_LEGACY		= 1 << 18, /* internal: create*_workqueue() */
@@ -413,6 +413,7 @@ struct ip_vs_conn;
 struct ip_vs_app;
 struct sk_buff;
 struct ip_vs_proto_data;
+struct seq_file;
 
 struct ip_vs_protocol {
 	struct ip_vs_protocol	*next;
@@ -712,6 +713,9 @@ struct ip_vs_scheduler {
 	struct ip_vs_dest* (*schedule)(struct ip_vs_service *svc,
 				       const struct sk_buff *skb,
 				       struct ip_vs_iphdr *iph);
+
+	/* show scheduler statistics of the service, called under RCU */
+	void (*show_stats)(struct ip_vs_service *svc, struct seq_file *seq);
 };
 
 /* The persistence engine object */
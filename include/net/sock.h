@@ -273,6 +273,8 @@ struct sock_common {
   *	@sk_gso_max_size: Maximum GSO segment size to build
   *	@sk_gso_max_segs: Maximum number of GSO segments
   *	@sk_pacing_shift: scaling factor for TCP Small Queues
+  *	@sk_wrr_weight: SCHED_WRR weight of the last task that sent on the
+  *		socket, 0 if it was not a WRR task (used by sch_wdrr)
   *	@sk_lingertime: %SO_LINGER l_linger setting
   *	@sk_backlog: always used with the per-socket spinlock held
   *	@sk_callback_lock: used with the callbacks in the end of this struct
@@ -463,6 +465,7 @@ struct sock {
 #define SK_PROTOCOL_MAX U8_MAX
 	u16			sk_gso_max_segs;
 	u8			sk_pacing_shift;
+	u8			sk_wrr_weight;
 	unsigned long	        sk_lingertime;
 	struct proto		*sk_prot_creator;
 	rwlock_t		sk_callback_lock;
@@ -2517,6 +2520,19 @@ static inline int sk_get_rmem0(const struct sock *sk, const struct proto *proto)
 	return *proto->sysctl_rmem;
 }
 
+/* Remember the WRR weight of the sending task for egress scheduling */
+static inline void sk_wrr_weight_update(struct sock *sk)
+{
+	u8 weight = 0;
+
+	if (current->policy == SCHED_WRR)
+		weight = READ_ONCE(current->wrr.weight);
+
+	/* Avoid dirtying the cache line on every send */
+	if (unlikely(READ_ONCE(sk->sk_wrr_weight) != weight))
+		WRITE_ONCE(sk->sk_wrr_weight, weight);
+}
+
 /* Default TCP Small queue budget is ~1 ms of data (1sec >> 10)
  * Some wifi drivers need to tweak it to get more chunks.
  * They can use this helper from their ndo_start_xmit()
@@ -208,6 +208,102 @@ TRACE_EVENT(sched_migrate_task,
 		  __entry->orig_cpu, __entry->dest_cpu)
 );
 
+/*
+ * Tracepoint for a WRR task that used up its time slice:
+ */
+TRACE_EVENT(sched_wrr_slice_expire,
+
+	TP_PROTO(struct task_struct *p, unsigned int nr_running,
+		 unsigned int total_weight),
+
+	TP_ARGS(p, nr_running, total_weight),
+
+	TP_STRUCT__entry(
+		__array(	char,	comm,	TASK_COMM_LEN	)
+		__field(	pid_t,	pid			)
+		__field(	unsigned int,	weight		)
+		__field(	unsigned int,	nr_running	)
+		__field(	unsigned int,	total_weight	)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, p->comm, TASK_COMM_LEN);
+		__entry->pid		= p->pid;
+		__entry->weight		= p->wrr.weight;
+		__entry->nr_running	= nr_running;
+		__entry->total_weight	= total_weight;
+	),
+
+	TP_printk("comm=%s pid=%d weight=%u nr_running=%u total_weight=%u",
+		  __entry->comm, __entry->pid, __entry->weight,
+		  __entry->nr_running, __entry->total_weight)
+);
+
+/*
+ * Tracepoint for a task moved by the WRR load balancer. The total
+ * weights are those of the two runqueues before the move.
+ */
+TRACE_EVENT(sched_wrr_balance,
+
+	TP_PROTO(struct task_struct *p, int orig_cpu, int dest_cpu,
+		 unsigned int orig_weight, unsigned int dest_weight),
+
+	TP_ARGS(p, orig_cpu, dest_cpu, orig_weight, dest_weight),
+
+	TP_STRUCT__entry(
+		__array(	char,	comm,	TASK_COMM_LEN	)
+		__field(	pid_t,	pid			)
+		__field(	unsigned int,	weight		)
+		__field(	int,	orig_cpu		)
+		__field(	int,	dest_cpu		)
+		__field(	unsigned int,	orig_weight	)
+		__field(	unsigned int,	dest_weight	)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, p->comm, TASK_COMM_LEN);
+		__entry->pid		= p->pid;
+		__entry->weight		= p->wrr.weight;
+		__entry->orig_cpu	= orig_cpu;
+		__entry->dest_cpu	= dest_cpu;
+		__entry->orig_weight	= orig_weight;
+		__entry->dest_weight	= dest_weight;
+	),
+
+	TP_printk("comm=%s pid=%d weight=%u orig_cpu=%d orig_weight=%u dest_cpu=%d dest_weight=%u",
+		  __entry->comm, __entry->pid, __entry->weight,
+		  __entry->orig_cpu, __entry->orig_weight,
+		  __entry->dest_cpu, __entry->dest_weight)
+);
+
+/*
+ * Tracepoint for a change of WRR weight:
+ */
+TRACE_EVENT(sched_wrr_setweight,
+
+	TP_PROTO(struct task_struct *p, unsigned int old_weight),
+
+	TP_ARGS(p, old_weight),
+
+	TP_STRUCT__entry(
+		__array(	char,	comm,	TASK_COMM_LEN	)
+		__field(	pid_t,	pid			)
+		__field(	unsigned int,	old_weight	)
+		__field(	unsigned int,	weight		)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, p->comm, TASK_COMM_LEN);
+		__entry->pid		= p->pid;
+		__entry->old_weight	= old_weight;
+		__entry->weight		= p->wrr.weight;
+	),
+
+	TP_printk("comm=%s pid=%d old_weight=%u weight=%u",
+		  __entry->comm, __entry->pid,
+		  __entry->old_weight, __entry->weight)
+);
+
 DECLARE_EVENT_CLASS(sched_process_template,
 
 	TP_PROTO(struct task_struct *p),
@@ -152,6 +152,7 @@ enum bpf_prog_type {
 	BPF_PROG_TYPE_LWT_SEG6LOCAL,
 	BPF_PROG_TYPE_LIRC_MODE2,
 	BPF_PROG_TYPE_SK_REUSEPORT,
+	BPF_PROG_TYPE_SCHED_WRR,
 };
 
 enum bpf_attach_type {
@@ -172,6 +173,8 @@ enum bpf_attach_type {
 	BPF_CGROUP_UDP4_SENDMSG,
 	BPF_CGROUP_UDP6_SENDMSG,
 	BPF_LIRC_MODE2,
+	BPF_WRR_SELECT_CPU,
+	BPF_WRR_BALANCE,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -2141,6 +2144,17 @@ union bpf_attr {
  *		request in the skb.
  *	Return
  *		0 on success, or a negative error in case of failure.
+ *
+ * int bpf_wrr_rq_stats(u32 cpu, struct bpf_wrr_rq_stats *stats, u32 size)
+ *	Description
+ *		Read the WRR runqueue statistics of *cpu* into *stats*, whose
+ *		*size* must be **sizeof**\ (**struct bpf_wrr_rq_stats**).
+ *		The values are read without the runqueue lock and may be
+ *		slightly out of date. Only available to
+ *		**BPF_PROG_TYPE_SCHED_WRR** programs.
+ *	Return
+ *		0 on success, or a negative error in case of failure. On
+ *		failure *stats* is zeroed.
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -2226,7 +2240,8 @@ union bpf_attr {
 	FN(get_current_cgroup_id),	\
 	FN(get_local_storage),		\
 	FN(sk_select_reuseport),	\
-	FN(skb_ancestor_cgroup_id),
+	FN(skb_ancestor_cgroup_id),	\
+	FN(wrr_rq_stats),
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
  * function eBPF program intends to call
@@ -2702,6 +2717,38 @@ struct bpf_raw_tracepoint_args {
 	__u64 args[0];
 };
 
+/* Context of BPF_PROG_TYPE_SCHED_WRR programs, read-only */
+struct bpf_wrr_ctx {
+	__u32 pid;
+	__u32 tgid;
+	__u32 weight;		/* WRR weight of the task */
+	__s32 prev_cpu;		/* SELECT_CPU: CPU the task last ran on
+				 * BALANCE: CPU with the largest total weight
+				 */
+	__s32 cpu;		/* SELECT_CPU: CPU the built-in policy chose
+				 * BALANCE: CPU the task would move to
+				 */
+	__u32 nr_cpu_ids;
+};
+
+/* BPF_WRR_SELECT_CPU programs return a CPU, or BPF_WRR_DEFAULT to keep the
+ * built-in choice. BPF_WRR_BALANCE programs return BPF_WRR_VETO to keep the
+ * task where it is, or BPF_WRR_DEFAULT to let the load balancer move it.
+ * A CPU that is offline or not allowed by the task's affinity is treated
+ * as BPF_WRR_DEFAULT.
+ */
+#define BPF_WRR_DEFAULT		-1
+#define BPF_WRR_VETO		-2
+
+struct bpf_wrr_rq_stats {
+	__u32 nr_running;
+	__u32 total_weight;
+	__u32 online;
+	__u32 pad;
+	__u64 nr_migrations_in;
+	__u64 nr_migrations_out;
+};
+
 /* DIRECT:  Skip the FIB rules and go to FIB table associated with device
  * OUTPUT:  Do lookup from egress perspective; default is ingress
  */
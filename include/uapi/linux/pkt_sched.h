@@ -970,6 +970,33 @@ enum {
 
 #define TCA_ETF_MAX (__TCA_ETF_MAX - 1)
 
+/* WDRR */
+enum {
+	TCA_WDRR_UNSPEC,
+	TCA_WDRR_LIMIT,		/* limit on the number of queued packets */
+	TCA_WDRR_FLOWS,		/* number of flow buckets */
+	TCA_WDRR_QUANTUM,	/* bytes a weight 1 flow may send per round */
+	TCA_WDRR_DEFAULT_WEIGHT, /* weight of traffic not sent by a WRR task */
+	TCA_WDRR_KEY,		/* enum tc_wdrr_key */
+	__TCA_WDRR_MAX
+};
+
+#define TCA_WDRR_MAX	(__TCA_WDRR_MAX - 1)
+
+enum tc_wdrr_key {
+	TC_WDRR_KEY_SOCKET,	/* one flow per socket (packet hash) */
+	TC_WDRR_KEY_CGROUP,	/* one flow per cgroup v2 of the socket */
+	__TC_WDRR_KEY_MAX
+};
+
+struct tc_wdrr_xstats {
+	__u32	drop_overlimit;	/* packets dropped because limit was hit */
+	__u32	new_flow_count;	/* times a flow became active */
+	__u32	flows_len;	/* active flows */
+	__u32	pad;
+	__u64	default_weight;	/* packets queued with the default weight */
+};
+
 
 /* CAKE */
 enum {
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_SCHED_TASK_RECORD_H
+#define _UAPI_LINUX_SCHED_TASK_RECORD_H
+
+#include <linux/types.h>
+
+#define TASK_RECORD_COMM_LEN	16
+
+/*
+ * Fixed-size scheduling record of a thread, read in batches from
+ * /proc/task_records: each read(2) returns as many whole records as fit
+ * in the buffer, for the threads of the pid namespace of that /proc in
+ * ascending thread id order. The file offset is the thread id to resume
+ * from, so pread(2) at offset 0 reads from the first thread. Writing the
+ * path of a cgroup2 directory to the file restricts the records to the
+ * threads in that cgroup and its descendants.
+ *
+ * New fields are only appended; @size is the size of the records the
+ * kernel returns.
+ */
+struct task_record {
+	__u32	size;			/* sizeof(struct task_record) */
+	__u32	pid;			/* thread id, in the reader's namespace */
+	__u32	tgid;
+	__u32	policy;			/* SCHED_* */
+	__s32	nice;
+	__u32	state;			/* index into "RSDTtXZPI", as in stat */
+	__u32	cpu;			/* CPU it runs or last ran on */
+	__u32	wrr_weight;		/* WRR weight, 0 unless SCHED_WRR */
+	__u32	wrr_time_slice;		/* ticks left of the WRR timeslice */
+	__u32	__reserved;
+	__u64	utime;			/* ns */
+	__u64	stime;			/* ns */
+	__u64	runtime;		/* ns run on a CPU */
+	__u64	run_delay;		/* ns waited on a runqueue */
+	__u64	pcount;			/* times run on a CPU */
+	__u64	nvcsw;			/* voluntary context switches */
+	__u64	nivcsw;			/* involuntary context switches */
+	__u64	start_time;		/* ns after boot, monotonic */
+	char	comm[TASK_RECORD_COMM_LEN];
+};
+
+#endif /* _UAPI_LINUX_SCHED_TASK_RECORD_H */
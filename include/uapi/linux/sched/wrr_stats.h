@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_SCHED_WRR_STATS_H
+#define _UAPI_LINUX_SCHED_WRR_STATS_H
+
+#include <linux/types.h>
+
+#define WRR_STATS_NR_WEIGHTS		20	/* one runtime bucket per weight 1..20 */
+#define WRR_STATS_NR_WAIT_BUCKETS	16	/* log2(us) runqueue wait histogram */
+
+/*
+ * Per-CPU WRR statistics, exported read-only through
+ * /sys/kernel/debug/sched_wrr/cpuN_stats. Map one page of the file and
+ * read it like a seqcount:
+ *
+ *	do {
+ *		seq = READ_ONCE(st->seq);
+ *		rmb();
+ *		... copy the fields ...
+ *		rmb();
+ *	} while ((seq & 1) || READ_ONCE(st->seq) != seq);
+ *
+ * wait_hist[0] counts waits shorter than 1us, wait_hist[i] waits in
+ * [2^(i-1), 2^i) us; the last bucket also counts everything longer.
+ */
+struct wrr_stats_page {
+	__u32	seq;			/* odd while the kernel is updating */
+	__u32	cpu;
+	__u32	nr_running;
+	__u32	total_weight;
+	__u64	runtime[WRR_STATS_NR_WEIGHTS];	/* ns run by tasks of weight i + 1 */
+	__u64	nr_migrations_in;
+	__u64	nr_migrations_out;
+	__u64	nr_balance;		/* load balancing passes run on this CPU */
+	__u64	wait_hist[WRR_STATS_NR_WAIT_BUCKETS];
+};
+
+#endif /* _UAPI_LINUX_SCHED_WRR_STATS_H */
@@ -89,6 +89,7 @@ struct task_struct init_task
 		.weight		= WRR_DEFAULT_WEIGHT,
 		.time_slice	= WRR_DEFAULT_WEIGHT * WRR_TIMESLICE,
 		.run_list	= LIST_HEAD_INIT(init_task.wrr.run_list),
+		.last_cpu	= -1,
 	},
 	.tasks		= LIST_HEAD_INIT(init_task.tasks),
 #ifdef CONFIG_SMP
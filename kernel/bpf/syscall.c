@@ -12,6 +12,7 @@
 #include <linux/bpf.h>
 #include <linux/bpf_trace.h>
 #include <linux/bpf_lirc.h>
+#include <linux/bpf_wrr.h>
 #include <linux/btf.h>
 #include <linux/syscalls.h>
 #include <linux/slab.h>
@@ -1640,6 +1641,10 @@ static int bpf_prog_attach(const union bpf_attr *attr)
 	case BPF_LIRC_MODE2:
 		ptype = BPF_PROG_TYPE_LIRC_MODE2;
 		break;
+	case BPF_WRR_SELECT_CPU:
+	case BPF_WRR_BALANCE:
+		ptype = BPF_PROG_TYPE_SCHED_WRR;
+		break;
 	default:
 		return -EINVAL;
 	}
@@ -1661,6 +1666,9 @@ static int bpf_prog_attach(const union bpf_attr *attr)
 	case BPF_PROG_TYPE_LIRC_MODE2:
 		ret = lirc_prog_attach(attr, prog);
 		break;
+	case BPF_PROG_TYPE_SCHED_WRR:
+		ret = wrr_prog_attach(attr, prog);
+		break;
 	default:
 		ret = cgroup_bpf_prog_attach(attr, ptype, prog);
 	}
@@ -1713,6 +1721,9 @@ static int bpf_prog_detach(const union bpf_attr *attr)
 		return sockmap_get_from_fd(attr, BPF_PROG_TYPE_SK_SKB, NULL);
 	case BPF_LIRC_MODE2:
 		return lirc_prog_detach(attr);
+	case BPF_WRR_SELECT_CPU:
+	case BPF_WRR_BALANCE:
+		return wrr_prog_detach(attr);
 	default:
 		return -EINVAL;
 	}
@@ -1749,6 +1760,9 @@ static int bpf_prog_query(const union bpf_attr *attr,
 		break;
 	case BPF_LIRC_MODE2:
 		return lirc_prog_query(attr, uattr);
+	case BPF_WRR_SELECT_CPU:
+	case BPF_WRR_BALANCE:
+		return wrr_prog_query(attr, uattr);
 	default:
 		return -EINVAL;
 	}
@@ -631,6 +631,7 @@ void __mmdrop(struct mm_struct *mm)
 	destroy_context(mm);
 	hmm_mm_destroy(mm);
 	mmu_notifier_mm_destroy(mm);
+	futex_mm_free(mm);
 	check_mm(mm);
 	put_user_ns(mm->user_ns);
 	free_mm(mm);
@@ -959,6 +960,9 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 	mm->pmd_huge_pte = NULL;
 #endif
 	mm_init_uprobes_state(mm);
+#ifdef CONFIG_FUTEX
+	mm->futex_hash = NULL;
+#endif
 
 	if (current->mm) {
 		mm->flags = current->mm->flags & MMF_INIT_MASK;
@@ -277,6 +277,29 @@ static struct {
 #define futex_queues   (__futex_data.queues)
 #define futex_hashsize (__futex_data.hashsize)
 
+/*
+ * PROCESS_PRIVATE futexes are hashed in a table of their mm, so that the
+ * futexes of unrelated processes do not share buckets, and the buckets
+ * are on the node of the process instead of being spread over all nodes.
+ * The global table above is left to shared futexes.
+ *
+ * The table is allocated by the first private futex operation of the mm
+ * once it has more than one user, and never changes afterwards: a waiter
+ * and its waker must always hash to the same bucket.  Until then the mm
+ * uses the global table, which is safe because a single thread can't be
+ * queued on a futex while it is doing another futex operation, and it
+ * saves single-threaded processes the memory of a table they can never
+ * contend on.  If the allocation fails, the mm keeps using the global
+ * table, marked by FUTEX_PRIVATE_HASH_GLOBAL.
+ */
+struct futex_private_hash {
+	unsigned long			mask;
+	struct futex_hash_bucket	queues[];
+};
+
+#define FUTEX_PRIVATE_HASH_GLOBAL	((struct futex_private_hash *)1UL)
+#define FUTEX_PRIVATE_HASH_MIN		16
+
 
 /*
  * Fault injections for futexes.
@@ -383,18 +406,84 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
 #endif
 }
 
+static inline bool futex_key_private(union futex_key *key)
+{
+	return !(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED));
+}
+
+/**
+ * futex_private_hash_init - Set up the private futex hash of an mm
+ * @mm:		The mm of the task doing a private futex operation
+ *
+ * Called by every private futex operation before it hashes its key, so
+ * that the table is in place before the first key of @mm is hashed.
+ * The table gets 4 buckets per possible CPU: no more threads than that
+ * can contend on its bucket locks at a time.
+ */
+static void futex_private_hash_init(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph;
+	unsigned long i, size;
+
+	if (!mm || likely(READ_ONCE(mm->futex_hash)))
+		return;
+
+	/* Stay on the global table while single-threaded, see above */
+	if (atomic_read(&mm->mm_users) <= 1)
+		return;
+
+	size = roundup_pow_of_two(4 * num_possible_cpus());
+	size = clamp_t(unsigned long, size, FUTEX_PRIVATE_HASH_MIN, futex_hashsize);
+
+	fph = kvzalloc_node(struct_size(fph, queues, size),
+			    GFP_KERNEL_ACCOUNT | __GFP_NOWARN, numa_node_id());
+	if (!fph) {
+		cmpxchg(&mm->futex_hash, NULL, FUTEX_PRIVATE_HASH_GLOBAL);
+		return;
+	}
+
+	fph->mask = size - 1;
+	for (i = 0; i < size; i++) {
+		atomic_set(&fph->queues[i].waiters, 0);
+		plist_head_init(&fph->queues[i].chain);
+		spin_lock_init(&fph->queues[i].lock);
+	}
+
+	/* Pairs with the READ_ONCE() in hash_futex() */
+	if (cmpxchg(&mm->futex_hash, NULL, fph))
+		kvfree(fph);
+}
+
+/**
+ * futex_mm_free - Free the private futex hash of an mm
+ * @mm:		The mm being freed
+ */
+void futex_mm_free(struct mm_struct *mm)
+{
+	if (mm->futex_hash != FUTEX_PRIVATE_HASH_GLOBAL)
+		kvfree(mm->futex_hash);
+}
+
 /**
- * hash_futex - Return the hash bucket in the global hash
+ * hash_futex - Return the hash bucket of a futex key
  * @key:	Pointer to the futex key for which the hash is calculated
  *
  * We hash on the keys returned from get_futex_key (see below) and return the
- * corresponding hash bucket in the global hash.
+ * corresponding hash bucket in the private hash of the mm for private keys,
+ * or in the global hash otherwise.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
+	struct futex_private_hash *fph;
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
+
+	if (futex_key_private(key) && key->private.mm) {
+		fph = READ_ONCE(key->private.mm->futex_hash);
+		if (fph && fph != FUTEX_PRIVATE_HASH_GLOBAL)
+			return &fph->queues[hash & fph->mask];
+	}
 	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
@@ -527,6 +616,7 @@ get_futex_key(u32 __user *uaddr, int fshared, union futex_key *key, int rw)
 	 *        but access_ok() should be faster than find_vma()
 	 */
 	if (!fshared) {
+		futex_private_hash_init(mm);
 		key->private.mm = mm;
 		key->private.address = address;
 		get_futex_key_refs(key);  /* implies smp_mb(); (B) */
@@ -41,6 +41,7 @@
 #include <linux/rculist.h>
 #include <linux/poll.h>
 #include <linux/irq_work.h>
+#include <linux/kthread.h>
 #include <linux/ctype.h>
 #include <linux/uio.h>
 #include <linux/sched/clock.h>
@@ -407,6 +408,19 @@ DEFINE_RAW_SPINLOCK(logbuf_lock);
 
 #ifdef CONFIG_PRINTK
 DECLARE_WAIT_QUEUE_HEAD(log_wait);
+/* Kthread flushing deferred console output, once it is running */
+static struct task_struct *printk_flush_task;
+
+/*
+ * Leave the console output of printk() calls made with interrupts
+ * disabled to printk_flush_task, so that they only pay for storing the
+ * message.  Warnings and more severe messages, oopses and panics still
+ * print synchronously, as they may be the last output before a lockup.
+ */
+static bool __read_mostly console_offload = true;
+module_param(console_offload, bool, 0644);
+MODULE_PARM_DESC(console_offload, "flush the console of printk() below KERN_WARNING with IRQs off from a kthread");
+
 /* the next printk record to read by syslog(READ) or /proc/kmsg */
 static u64 syslog_seq;
 static u32 syslog_idx;
@@ -1889,17 +1903,36 @@ int vprintk_store(int facility, int level,
 			  dict, dictlen, text, text_len);
 }
 
+/* The console loglevel a printk() will be stored with */
+static int printk_emit_level(int level, const char *fmt)
+{
+	int kern_level;
+
+	if (level != LOGLEVEL_DEFAULT)
+		return level;
+
+	kern_level = printk_get_level(fmt);
+	if (kern_level >= '0' && kern_level <= '7')
+		return kern_level - '0';
+
+	return default_message_loglevel;
+}
+
 asmlinkage int vprintk_emit(int facility, int level,
 			    const char *dict, size_t dictlen,
 			    const char *fmt, va_list args)
 {
 	int printed_len;
-	bool in_sched = false;
+	bool in_sched = false, defer = false;
 	unsigned long flags;
 
 	if (level == LOGLEVEL_SCHED) {
 		level = LOGLEVEL_DEFAULT;
 		in_sched = true;
+	} else if (console_offload && irqs_disabled() && !oops_in_progress &&
+		   READ_ONCE(printk_flush_task) &&
+		   printk_emit_level(level, fmt) > LOGLEVEL_WARNING) {
+		defer = true;
 	}
 
 	boot_delay_msec(level);
@@ -1911,7 +1944,9 @@ asmlinkage int vprintk_emit(int facility, int level,
 	logbuf_unlock_irqrestore(flags);
 
 	/* If called from the scheduler, we can not call up(). */
-	if (!in_sched) {
+	if (defer) {
+		defer_console_output();
+	} else if (!in_sched) {
 		/*
 		 * Disable preemption to avoid being preempted while holding
 		 * console_sem which would prevent anyone from printing to
@@ -2872,14 +2907,59 @@ late_initcall(printk_late_init);
 
 static DEFINE_PER_CPU(int, printk_pending);
 
+static unsigned long printk_flush_pending;
+
+/*
+ * Deferred console output is flushed from process context, where
+ * console_unlock() may reschedule between records, instead of from the
+ * irq_work that used to do it: on a serial console that can take
+ * milliseconds, with interrupts disabled.
+ */
+static int printk_flush_thread(void *unused)
+{
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!test_and_clear_bit(0, &printk_flush_pending)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		console_lock();
+		console_unlock();
+	}
+
+	return 0;
+}
+
+static int __init printk_flush_init(void)
+{
+	struct task_struct *task;
+
+	/* Until it runs, deferred output is flushed from irq_work */
+	task = kthread_run(printk_flush_thread, NULL, "printk");
+	if (WARN_ON(IS_ERR(task)))
+		return PTR_ERR(task);
+
+	WRITE_ONCE(printk_flush_task, task);
+	return 0;
+}
+late_initcall(printk_flush_init);
+
 static void wake_up_klogd_work_func(struct irq_work *irq_work)
 {
 	int pending = __this_cpu_xchg(printk_pending, 0);
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
-		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
+		struct task_struct *task = READ_ONCE(printk_flush_task);
+
+		if (task) {
+			set_bit(0, &printk_flush_pending);
+			wake_up_process(task);
+		} else if (console_trylock()) {
+			/* If trylock fails, someone else is doing the printing */
 			console_unlock();
+		}
 	}
 
 	if (pending & PRINTK_PENDING_WAKEUP)
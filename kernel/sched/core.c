@@ -2171,6 +2171,8 @@ static void __sched_fork(unsigned long clone_flags, struct task_struct *p)
 	INIT_LIST_HEAD(&p->wrr.run_list);
 	p->wrr.time_slice = p->wrr.weight * WRR_TIMESLICE;
 	p->wrr.on_rq = 0;
+	p->wrr.last_cpu = -1;
+	p->wrr.wait_start = 0;
 
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	INIT_HLIST_HEAD(&p->preempt_notifiers);
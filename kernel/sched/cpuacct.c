@@ -24,12 +24,19 @@ struct cpuacct_usage {
 	u64	usages[CPUACCT_STAT_NSTATS];
 };
 
+/* WRR runtime and runqueue wait time, indexed by task weight - 1 */
+struct cpuacct_wrr_usage {
+	u64	runtime[WRR_MAX_WEIGHT];
+	u64	wait[WRR_MAX_WEIGHT];
+};
+
 /* track CPU usage of a group of tasks and its child groups */
 struct cpuacct {
 	struct cgroup_subsys_state	css;
 	/* cpuusage holds pointer to a u64-type object on every CPU */
 	struct cpuacct_usage __percpu	*cpuusage;
 	struct kernel_cpustat __percpu	*cpustat;
+	struct cpuacct_wrr_usage __percpu *wrr_usage;
 };
 
 static inline struct cpuacct *css_ca(struct cgroup_subsys_state *css)
@@ -49,9 +56,11 @@ static inline struct cpuacct *parent_ca(struct cpuacct *ca)
 }
 
 static DEFINE_PER_CPU(struct cpuacct_usage, root_cpuacct_cpuusage);
+static DEFINE_PER_CPU(struct cpuacct_wrr_usage, root_cpuacct_wrr_usage);
 static struct cpuacct root_cpuacct = {
 	.cpustat	= &kernel_cpustat,
 	.cpuusage	= &root_cpuacct_cpuusage,
+	.wrr_usage	= &root_cpuacct_wrr_usage,
 };
 
 /* Create a new CPU accounting group */
@@ -75,8 +84,14 @@ cpuacct_css_alloc(struct cgroup_subsys_state *parent_css)
 	if (!ca->cpustat)
 		goto out_free_cpuusage;
 
+	ca->wrr_usage = alloc_percpu(struct cpuacct_wrr_usage);
+	if (!ca->wrr_usage)
+		goto out_free_cpustat;
+
 	return &ca->css;
 
+out_free_cpustat:
+	free_percpu(ca->cpustat);
 out_free_cpuusage:
 	free_percpu(ca->cpuusage);
 out_free_ca:
@@ -90,6 +105,7 @@ static void cpuacct_css_free(struct cgroup_subsys_state *css)
 {
 	struct cpuacct *ca = css_ca(css);
 
+	free_percpu(ca->wrr_usage);
 	free_percpu(ca->cpustat);
 	free_percpu(ca->cpuusage);
 	kfree(ca);
@@ -293,6 +309,64 @@ static int cpuacct_stats_show(struct seq_file *sf, void *v)
 	return 0;
 }
 
+static int cpuacct_wrr_usage_seq_show(struct seq_file *m, void *V)
+{
+	struct cpuacct *ca = css_ca(seq_css(m));
+	u64 runtime, wait;
+	int cpu, i;
+
+	seq_puts(m, "cpu weight runtime wait\n");
+
+	for_each_possible_cpu(cpu) {
+		struct cpuacct_wrr_usage *usage = per_cpu_ptr(ca->wrr_usage, cpu);
+
+		for (i = 0; i < WRR_MAX_WEIGHT; i++) {
+#ifndef CONFIG_64BIT
+			/*
+			 * Take rq->lock to make 64-bit read safe on 32-bit
+			 * platforms.
+			 */
+			raw_spin_lock_irq(&cpu_rq(cpu)->lock);
+#endif
+
+			runtime = usage->runtime[i];
+			wait = usage->wait[i];
+
+#ifndef CONFIG_64BIT
+			raw_spin_unlock_irq(&cpu_rq(cpu)->lock);
+#endif
+
+			/* Most CPUs only ever see a few weights */
+			if (runtime || wait)
+				seq_printf(m, "%d %d %llu %llu\n", cpu, i + 1,
+					   runtime, wait);
+		}
+	}
+	return 0;
+}
+
+static int cpuacct_wrr_usage_write(struct cgroup_subsys_state *css,
+				   struct cftype *cft, u64 val)
+{
+	struct cpuacct *ca = css_ca(css);
+	int cpu;
+
+	/*
+	 * Only allow '0' here to do a reset.
+	 */
+	if (val)
+		return -EINVAL;
+
+	for_each_possible_cpu(cpu) {
+		raw_spin_lock_irq(&cpu_rq(cpu)->lock);
+		memset(per_cpu_ptr(ca->wrr_usage, cpu), 0,
+		       sizeof(struct cpuacct_wrr_usage));
+		raw_spin_unlock_irq(&cpu_rq(cpu)->lock);
+	}
+
+	return 0;
+}
+
 static struct cftype files[] = {
 	{
 		.name = "usage",
@@ -327,6 +401,11 @@ static struct cftype files[] = {
 		.name = "stat",
 		.seq_show = cpuacct_stats_show,
 	},
+	{
+		.name = "wrr_usage_by_weight",
+		.seq_show = cpuacct_wrr_usage_seq_show,
+		.write_u64 = cpuacct_wrr_usage_write,
+	},
 	{ }	/* terminate */
 };
 
@@ -352,6 +431,30 @@ void cpuacct_charge(struct task_struct *tsk, u64 cputime)
 	rcu_read_unlock();
 }
 
+/*
+ * Charge WRR runtime and runqueue wait time to the weight bucket of this
+ * task in its accounting group.
+ *
+ * called with rq->lock held.
+ */
+void cpuacct_charge_wrr(struct task_struct *tsk, u64 runtime, u64 wait)
+{
+	int i = clamp_t(unsigned int, tsk->wrr.weight,
+			WRR_MIN_WEIGHT, WRR_MAX_WEIGHT) - 1;
+	struct cpuacct_wrr_usage *usage;
+	struct cpuacct *ca;
+
+	rcu_read_lock();
+
+	for (ca = task_ca(tsk); ca; ca = parent_ca(ca)) {
+		usage = this_cpu_ptr(ca->wrr_usage);
+		usage->runtime[i] += runtime;
+		usage->wait[i] += wait;
+	}
+
+	rcu_read_unlock();
+}
+
 /*
  * Add user/system time to cpuacct.
  *
@@ -174,14 +174,44 @@ static const struct file_operations sched_feat_fops = {
 
 __read_mostly bool sched_debug_enabled;
 
+static void print_wrr_cpu(struct seq_file *m, int cpu);
+
+static int sched_wrr_cpu_show(struct seq_file *m, void *v)
+{
+	print_wrr_cpu(m, (long)m->private);
+	return 0;
+}
+
+static int sched_wrr_cpu_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, sched_wrr_cpu_show, inode->i_private);
+}
+
+static const struct file_operations sched_wrr_cpu_fops = {
+	.open		= sched_wrr_cpu_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static __init int sched_init_debug(void)
 {
+	char buf[16];
+	int cpu;
+
 	debugfs_create_file("sched_features", 0644, NULL, NULL,
 			&sched_feat_fops);
 
 	debugfs_create_bool("sched_debug", 0644, NULL,
 			&sched_debug_enabled);
 
+	/* One file per CPU, so a single WRR runqueue can be read at a time */
+	for_each_possible_cpu(cpu) {
+		snprintf(buf, sizeof(buf), "cpu%d", cpu);
+		debugfs_create_file(buf, 0444, wrr_debugfs_dir, (void *)(long)cpu,
+				&sched_wrr_cpu_fops);
+	}
+
 	return 0;
 }
 late_initcall(sched_init_debug);
@@ -433,7 +463,7 @@ static void print_cfs_group_stats(struct seq_file *m, int cpu, struct task_group
 }
 #endif
 
-#ifdef CONFIG_CGROUP_SCHED
+#if defined(CONFIG_FAIR_GROUP_SCHED) || defined(CONFIG_RT_GROUP_SCHED)
 static char group_path[PATH_MAX];
 
 static char *task_group_path(struct task_group *tg)
@@ -447,44 +477,86 @@ static char *task_group_path(struct task_group *tg)
 }
 #endif
 
-static void
-print_task(struct seq_file *m, struct rq *rq, struct task_struct *p)
+/*
+ * Snapshot of a task queued on a WRR runqueue. Taken under rq->lock so the
+ * lock is never held across seq_file or console output.
+ */
+struct wrr_task_snap {
+	char comm[TASK_COMM_LEN];
+	pid_t pid;
+	int prio;
+	unsigned int weight;
+	unsigned int time_slice;
+	unsigned int policy;
+	int last_cpu;
+	char state;
+	bool curr;
+	u64 wait;
+};
+
+/* Queued tasks printed per runqueue; protected by sched_debug_lock */
+#define WRR_SNAP_MAX	256
+static struct wrr_task_snap wrr_snap[WRR_SNAP_MAX];
+
+static void print_task(struct seq_file *m, struct wrr_task_snap *s)
 {
-	if (rq->curr == p)
+	if (s->curr)
 		SEQ_printf(m, ">R");
 	else
-		SEQ_printf(m, " %c", task_state_to_char(p));
+		SEQ_printf(m, " %c", s->state);
 
-	SEQ_printf(m, "%15s %5d %6d %7d %10d %7d", p->comm, task_pid_nr(p), p->prio, p->wrr.weight, p->wrr.time_slice, p->policy);
-
-#ifdef CONFIG_NUMA_BALANCING
-	SEQ_printf(m, " %d %d", task_node(p), task_numa_group_id(p));
-#endif
-#ifdef CONFIG_CGROUP_SCHED
-	SEQ_printf(m, " %s", task_group_path(task_group(p)));
-#endif
-
-	SEQ_printf(m, "\n");
+	SEQ_printf(m, "%15s %5d %6d %7d %10d %7d %9Ld.%06ld %8d\n",
+		   s->comm, s->pid, s->prio, s->weight, s->time_slice,
+		   s->policy, SPLIT_NS(s->wait), s->last_cpu);
 }
 
+/*
+ * Only the tasks on rq->wrr.queue are printed: walking the whole task list
+ * once per CPU does not scale on large machines.
+ */
 static void print_rq(struct seq_file *m, struct rq *rq, int rq_cpu)
 {
-	struct task_struct *g, *p;
+	struct sched_wrr_entity *wrr_se;
+	unsigned int nr = 0, nr_queued, i;
+	unsigned long flags;
+	u64 now;
+
+	raw_spin_lock_irqsave(&rq->lock, flags);
+	now = rq->clock;
+	nr_queued = rq->wrr.nr_running;
+	list_for_each_entry(wrr_se, &rq->wrr.queue, run_list) {
+		struct task_struct *p = container_of(wrr_se, struct task_struct, wrr);
+		struct wrr_task_snap *s = &wrr_snap[nr];
+
+		memcpy(s->comm, p->comm, TASK_COMM_LEN);
+		s->pid = task_pid_nr(p);
+		s->prio = p->prio;
+		s->weight = wrr_se->weight;
+		s->time_slice = wrr_se->time_slice;
+		s->policy = p->policy;
+		s->last_cpu = wrr_se->last_cpu;
+		s->state = task_state_to_char(p);
+		s->curr = rq->curr == p;
+		s->wait = 0;
+		if (!s->curr && now > wrr_se->wait_start)
+			s->wait = now - wrr_se->wait_start;
+
+		if (++nr == WRR_SNAP_MAX)
+			break;
+	}
+	raw_spin_unlock_irqrestore(&rq->lock, flags);
 
 	SEQ_printf(m, "\n");
 	SEQ_printf(m, "runnable tasks:\n");
-	SEQ_printf(m, " S           task   PID   prio  weight  timeslice  policy\n");
+	SEQ_printf(m, " S           task   PID   prio  weight  timeslice  policy         wait-time  last-cpu\n");
 	SEQ_printf(m, "-------------------------------------------------------"
 		   "----------------------------------------------------\n");
 
-	rcu_read_lock();
-	for_each_process_thread(g, p) {
-		if (task_cpu(p) != rq_cpu)
-			continue;
+	for (i = 0; i < nr; i++)
+		print_task(m, &wrr_snap[i]);
 
-		print_task(m, rq, p);
-	}
-	rcu_read_unlock();
+	if (nr_queued > nr)
+		SEQ_printf(m, "  ... %u more\n", nr_queued - nr);
 }
 
 void print_wrr_rq(struct seq_file *m, int cpu, struct wrr_rq *wrr_rq) {
@@ -492,6 +564,34 @@ void print_wrr_rq(struct seq_file *m, int cpu, struct wrr_rq *wrr_rq) {
 	SEQ_printf(m, "wrr_rq[%d]:\n", cpu);
 	SEQ_printf(m, "  .%-30s: %d\n", "nr_running", wrr_rq->nr_running);
 	SEQ_printf(m, "  .%-30s: %d\n", "total_weight", wrr_rq->total_weight);
+	SEQ_printf(m, "  .%-30s: %ld\n", "nr_migrations_in",
+		   atomic_long_read(&wrr_rq->nr_migrations_in));
+	SEQ_printf(m, "  .%-30s: %ld\n", "nr_migrations_out",
+		   atomic_long_read(&wrr_rq->nr_migrations_out));
+	SEQ_printf(m, "  .%-30s: %ld\n", "nr_balance",
+		   atomic_long_read(&wrr_rq->nr_balance));
+
+#ifdef CONFIG_SCHEDSTATS
+	if (schedstat_enabled()) {
+		static const char * const modes[] = {
+			[SCHED_WRR_SELECT_SCAN]		= "scan",
+			[SCHED_WRR_SELECT_SAMPLE]	= "sample",
+		};
+		char name[32];
+		int i;
+
+		for (i = 0; i < SCHED_WRR_NR_SELECT_MODES; i++) {
+			snprintf(name, sizeof(name), "select_%s.count", modes[i]);
+			SEQ_printf(m, "  .%-30s: %lu\n", name, wrr_rq->select_count[i]);
+			snprintf(name, sizeof(name), "select_%s.weight", modes[i]);
+			SEQ_printf(m, "  .%-30s: %lu\n", name, wrr_rq->select_weight[i]);
+			snprintf(name, sizeof(name), "select_%s.balance_count", modes[i]);
+			SEQ_printf(m, "  .%-30s: %lu\n", name, wrr_rq->balance_count[i]);
+			snprintf(name, sizeof(name), "select_%s.balance_imbalance", modes[i]);
+			SEQ_printf(m, "  .%-30s: %lu\n", name, wrr_rq->balance_imbalance[i]);
+		}
+	}
+#endif
 }
 
 void print_cfs_rq(struct seq_file *m, int cpu, struct cfs_rq *cfs_rq)
@@ -698,6 +798,16 @@ do {									\
 	SEQ_printf(m, "\n");
 }
 
+static void print_wrr_cpu(struct seq_file *m, int cpu)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&sched_debug_lock, flags);
+	print_wrr_stats(m, cpu);
+	print_rq(m, cpu_rq(cpu), cpu);
+	spin_unlock_irqrestore(&sched_debug_lock, flags);
+}
+
 static const char *sched_tunable_scaling_names[] = {
 	"none",
 	"logaritmic",
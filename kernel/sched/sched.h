@@ -34,6 +34,7 @@
 #include <linux/sched/xacct.h>
 
 #include <uapi/linux/sched/types.h>
+#include <uapi/linux/sched/wrr_stats.h>
 
 #include <linux/binfmts.h>
 #include <linux/blkdev.h>
@@ -692,6 +693,27 @@ struct wrr_rq {
 	struct list_head queue;     // head of task queue
 	unsigned int nr_running;    // # of running tasks
 	unsigned int total_weight;  // total weight of tasks on the queue
+
+	struct wrr_stats_page *stats;       // statistics page exported to userspace
+	atomic_long_t nr_migrations_in;     // tasks moved to this CPU
+	atomic_long_t nr_migrations_out;    // tasks moved away from this CPU
+	atomic_long_t nr_balance;           // load balancing passes run on this CPU
+
+#ifdef CONFIG_SMP
+	int active_balance;                 // 1 while a push of the running task is queued
+	int push_cpu;                       // CPU the running task is pushed to
+	struct cpu_stop_work active_balance_work;
+	unsigned int nr_balance_failed;     // passes in a row only the running task could balance
+	unsigned int active_backoff;        // pushes in a row that moved nothing
+#endif
+
+#ifdef CONFIG_SCHEDSTATS
+	/* Per placement mode, only updated by this CPU with interrupts disabled */
+	unsigned long select_count[SCHED_WRR_NR_SELECT_MODES];     // placements done on this CPU
+	unsigned long select_weight[SCHED_WRR_NR_SELECT_MODES];    // sum of the chosen CPUs' total weight
+	unsigned long balance_count[SCHED_WRR_NR_SELECT_MODES];    // balancing passes done on this CPU
+	unsigned long balance_imbalance[SCHED_WRR_NR_SELECT_MODES]; // sum of max - min total weight they saw
+#endif
 };
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -2082,6 +2104,8 @@ print_numa_stats(struct seq_file *m, int node, unsigned long tsf,
 #endif /* CONFIG_SCHED_DEBUG */
 
 extern void init_wrr_rq(struct wrr_rq *wrr_rq);
+extern void wrr_stats_sync(struct wrr_rq *wrr_rq);
+extern struct dentry *wrr_debugfs_dir;
 extern void init_cfs_rq(struct cfs_rq *cfs_rq);
 extern void init_rt_rq(struct rt_rq *rt_rq);
 extern void init_dl_rq(struct dl_rq *dl_rq);
@@ -3,6 +3,15 @@
  */
 #include "sched.h"
 
+#include <linux/bpf_wrr.h>
+#include <linux/random.h>
+#include <trace/events/sched.h>
+
+/* Placement mode of select_task_rq_wrr(), see enum sched_wrr_select_mode */
+int sysctl_sched_wrr_select_mode __read_mostly = SCHED_WRR_SELECT_SCAN;
+/* Random CPUs looked at in SCHED_WRR_SELECT_SAMPLE mode, besides prev_cpu */
+int sysctl_sched_wrr_select_samples __read_mostly = 2;
+
 /// @brief Initialize a WRR runqueue.
 /// @param wrr_rq a WRR runqueue to initiate.
 void init_wrr_rq(struct wrr_rq *wrr_rq)
@@ -10,6 +19,88 @@ void init_wrr_rq(struct wrr_rq *wrr_rq)
 	INIT_LIST_HEAD(&wrr_rq->queue);
 	wrr_rq->nr_running = 0;
 	wrr_rq->total_weight = 0;
+
+	wrr_rq->stats = NULL;
+	atomic_long_set(&wrr_rq->nr_migrations_in, 0);
+	atomic_long_set(&wrr_rq->nr_migrations_out, 0);
+	atomic_long_set(&wrr_rq->nr_balance, 0);
+
+#ifdef CONFIG_SMP
+	wrr_rq->active_balance = 0;
+	wrr_rq->push_cpu = 0;
+	wrr_rq->nr_balance_failed = 0;
+	wrr_rq->active_backoff = 0;
+#endif
+
+#ifdef CONFIG_SCHEDSTATS
+	memset(wrr_rq->select_count, 0, sizeof(wrr_rq->select_count));
+	memset(wrr_rq->select_weight, 0, sizeof(wrr_rq->select_weight));
+	memset(wrr_rq->balance_count, 0, sizeof(wrr_rq->balance_count));
+	memset(wrr_rq->balance_imbalance, 0, sizeof(wrr_rq->balance_imbalance));
+#endif
+}
+
+/// @brief Start updating the statistics page of a WRR runqueue.
+/// The summary fields are refreshed here; the caller may update the
+/// others until wrr_stats_end(). The runqueue lock must be held.
+/// @param wrr_rq a WRR runqueue.
+/// @return the statistics page, or NULL if there is none.
+static inline struct wrr_stats_page *wrr_stats_begin(struct wrr_rq *wrr_rq)
+{
+	struct wrr_stats_page *st = wrr_rq->stats;
+
+	if (!st)
+		return NULL;
+
+	/* Readers retry while seq is odd, see struct wrr_stats_page */
+	WRITE_ONCE(st->seq, st->seq + 1);
+	smp_wmb();
+
+	st->nr_running = wrr_rq->nr_running;
+	st->total_weight = wrr_rq->total_weight;
+	st->nr_migrations_in = atomic_long_read(&wrr_rq->nr_migrations_in);
+	st->nr_migrations_out = atomic_long_read(&wrr_rq->nr_migrations_out);
+	st->nr_balance = atomic_long_read(&wrr_rq->nr_balance);
+
+	return st;
+}
+
+/// @brief Finish updating a statistics page.
+/// @param st a statistics page returned by wrr_stats_begin().
+static inline void wrr_stats_end(struct wrr_stats_page *st)
+{
+	smp_wmb();
+	WRITE_ONCE(st->seq, st->seq + 1);
+}
+
+/// @brief Publish the summary fields of a WRR runqueue to its statistics page.
+/// @param wrr_rq a WRR runqueue, whose runqueue lock is held.
+void wrr_stats_sync(struct wrr_rq *wrr_rq)
+{
+	struct wrr_stats_page *st = wrr_stats_begin(wrr_rq);
+
+	if (st)
+		wrr_stats_end(st);
+}
+
+/// @brief Record how long a task waited on the runqueue before being picked.
+/// @param rq a runqueue.
+/// @param wait nanoseconds the task picked to run next waited.
+static void wrr_stats_account_wait(struct rq *rq, u64 wait)
+{
+	struct wrr_stats_page *st;
+	u64 wait_us;
+	int bucket = 0;
+
+	wait_us = div_u64(wait, NSEC_PER_USEC);
+	if (wait_us)
+		bucket = min_t(int, ilog2(wait_us) + 1, WRR_STATS_NR_WAIT_BUCKETS - 1);
+
+	st = wrr_stats_begin(&rq->wrr);
+	if (st) {
+		st->wait_hist[bucket]++;
+		wrr_stats_end(st);
+	}
 }
 
 /// @brief Get the task_struct of a WRR scheduler entity.
@@ -20,6 +111,37 @@ static inline struct task_struct *wrr_task_of(struct sched_wrr_entity *wrr_se)
 	return container_of(wrr_se, struct task_struct, wrr);
 }
 
+/// @brief Pick a random online CPU that a task is allowed to run on.
+/// CPUs following a hole in the mask are a bit more likely to be picked,
+/// which does not matter for sampling.
+/// @param p a task.
+/// @return a CPU index, or -1 if the affinity allows no online CPU.
+static inline int wrr_random_cpu(struct task_struct *p)
+{
+	int cpu;
+
+	cpu = cpumask_next_and((int)prandom_u32_max(nr_cpu_ids) - 1,
+			       &p->cpus_allowed, cpu_online_mask);
+	if (cpu >= nr_cpu_ids)
+		cpu = cpumask_first_and(&p->cpus_allowed, cpu_online_mask);
+
+	return cpu < nr_cpu_ids ? cpu : -1;
+}
+
+/* Hooks of the policy shared with the userspace simulator in tools/sched/ */
+#define wrr_policy_for_each_cpu(cpu)		for_each_online_cpu(cpu)
+#define wrr_policy_cpu_online(cpu)		cpu_online(cpu)
+#define wrr_policy_total_weight(cpu)		(cpu_rq(cpu)->wrr.total_weight)
+#define wrr_policy_cpu_allowed(wrr_se, cpu)	\
+	cpumask_test_cpu(cpu, &wrr_task_of(wrr_se)->cpus_allowed)
+#define wrr_policy_random_cpu(wrr_se)		wrr_random_cpu(wrr_task_of(wrr_se))
+#define wrr_policy_running(wrr_se, cpu)		\
+	task_running(cpu_rq(cpu), wrr_task_of(wrr_se))
+#define wrr_policy_may_migrate(wrr_se, src, dst)	\
+	wrr_bpf_allow_migration(wrr_task_of(wrr_se), src, dst)
+
+#include "wrr_policy.h"
+
 /// @brief Get the runqueue of a WRR runqueue.
 /// @param wrr_rq a WRR runqueue.
 /// @return a runqueue containing `wrr_rq`.
@@ -87,9 +209,11 @@ static void enqueue_task_wrr(struct rq *rq, struct task_struct *p, int flags)
 		return;
 
 	list_add_tail(&wrr_se->run_list, &wrr_rq->queue);
+	wrr_se->wait_start = rq_clock(rq);
 
 	inc_wrr_tasks(wrr_se, wrr_rq);
 	add_nr_running(rq, 1);
+	wrr_stats_sync(wrr_rq);
 }
 
 /// @brief Dequeue a task from WRR runqueue.
@@ -108,6 +232,7 @@ static void dequeue_task_wrr(struct rq *rq, struct task_struct *p, int flags)
 
 	dec_wrr_tasks(wrr_se, wrr_rq);
 	sub_nr_running(rq, 1);
+	wrr_stats_sync(wrr_rq);
 }
 
 /// @brief Dequeue a task from WRR runqueue, and enqueue it again.
@@ -138,6 +263,7 @@ static struct task_struct *pick_next_task_wrr(struct rq *rq, struct task_struct
 {
 	struct wrr_rq *wrr_rq = &rq->wrr;
 	struct sched_wrr_entity *wrr_se;
+	struct task_struct *p;
 
 	/* Put previous task to the end of the queue */
 	put_prev_task(rq, prev);
@@ -147,7 +273,15 @@ static struct task_struct *pick_next_task_wrr(struct rq *rq, struct task_struct
 	if (!wrr_se)
 		return NULL;
 
-	return wrr_task_of(wrr_se);
+	p = wrr_task_of(wrr_se);
+	if (p != prev) {
+		u64 wait = rq_clock(rq) - wrr_se->wait_start;
+
+		wrr_stats_account_wait(rq, wait);
+		cpuacct_charge_wrr(p, 0, wait);
+	}
+
+	return p;
 }
 
 /// @brief Requeue the previous WRR task on the runqueue. 
@@ -156,36 +290,54 @@ static struct task_struct *pick_next_task_wrr(struct rq *rq, struct task_struct
 static void put_prev_task_wrr(struct rq *rq, struct task_struct *prev)
 {
 	requeue_task_wrr(rq, prev);
+	prev->wrr.wait_start = rq_clock(rq);
 }
 
 #ifdef CONFIG_SMP
 
 /// @brief Select a CPU to execute a task (with minimum total weight).
+/// Depending on sysctl_sched_wrr_select_mode, all CPUs or only a sample
+/// of them are looked at.
 /// @param p a task to be enqueued in a runqueue.
-/// @param cpu previously executed CPU index.
+/// @param cpu previously executed CPU index, a sampling candidate that is
+/// also passed to the BPF hook.
 /// @param sd_flag sched-domain flag (not used).
 /// @param wake_flags wake flags (not used).
 static int select_task_rq_wrr(struct task_struct *p, int cpu, int sd_flag, int wake_flags)
 {
-	unsigned int min_cpu_index = -1;
-	unsigned int min_total_weight = UINT_MAX;
+	int mode = READ_ONCE(sysctl_sched_wrr_select_mode);
+	int min_cpu;
 
 	/* RCU read lock is needed because we read data from multiple CPUs */
 	rcu_read_lock();
-	for_each_online_cpu(cpu) {
-		struct wrr_rq *wrr_rq = &cpu_rq(cpu)->wrr;
-		/*
-			1. The CPU affinity constraint should be satisfied.
-			2. We should select a CPU with minimum total weight.
-		*/
-		if (cpumask_test_cpu(cpu, &p->cpus_allowed) && (wrr_rq->total_weight < min_total_weight)) {
-			min_cpu_index = cpu;
-			min_total_weight = wrr_rq->total_weight;
-		}
+	if (mode == SCHED_WRR_SELECT_SAMPLE)
+		min_cpu = wrr_policy_sample_cpu(&p->wrr, cpu,
+						READ_ONCE(sysctl_sched_wrr_select_samples));
+	else
+		min_cpu = wrr_policy_select_cpu(&p->wrr);
+
+	/* pi_lock is held with interrupts disabled, this_rq() is stable */
+	if (min_cpu >= 0) {
+		schedstat_inc(this_rq()->wrr.select_count[mode]);
+		schedstat_add(this_rq()->wrr.select_weight[mode],
+			      wrr_policy_total_weight(min_cpu));
 	}
 	rcu_read_unlock();
 
-	return min_cpu_index;
+	/* A BPF_WRR_SELECT_CPU program may override the choice */
+	return wrr_bpf_select_cpu(p, cpu, min_cpu);
+}
+
+/// @brief Remember the CPU a task is leaving when it migrates.
+/// @param p a task being moved to another CPU.
+/// @param new_cpu the destination CPU (not used).
+static void migrate_task_rq_wrr(struct task_struct *p, int new_cpu)
+{
+	p->wrr.last_cpu = task_cpu(p);
+
+	/* Neither runqueue lock may be held here, published on the next update */
+	atomic_long_inc(&task_rq(p)->wrr.nr_migrations_out);
+	atomic_long_inc(&cpu_rq(new_cpu)->wrr.nr_migrations_in);
 }
 
 #endif
@@ -195,6 +347,7 @@ static int select_task_rq_wrr(struct task_struct *p, int cpu, int sd_flag, int w
 static void update_curr_wrr(struct rq *rq)
 {
 	struct task_struct *curr = rq->curr;
+	struct wrr_stats_page *st;
 	u64 delta_exec;
 	u64 now;
 
@@ -214,6 +367,14 @@ static void update_curr_wrr(struct rq *rq)
 
 	curr->se.exec_start = now;
 	cgroup_account_cputime(curr, delta_exec);
+	cpuacct_charge_wrr(curr, delta_exec, 0);
+
+	st = wrr_stats_begin(&rq->wrr);
+	if (st) {
+		st->runtime[clamp_t(unsigned int, curr->wrr.weight,
+				    WRR_MIN_WEIGHT, WRR_MAX_WEIGHT) - 1] += delta_exec;
+		wrr_stats_end(st);
+	}
 }
 
 /// @brief Update timeslice of the current WRR task at every tick.
@@ -232,14 +393,13 @@ static void task_tick_wrr(struct rq *rq, struct task_struct *p, int queued)
 
 	/* 
 		Decrement time slice and check whether there is remaining time slice.
-		If so, return. Otherwise(It's time to preempt) requeue the current task.
+		If so, return. Otherwise(It's time to preempt) the time slice is
+		re-initialized and we requeue the current task.
 	 */
-	if (--wrr_se->time_slice > 0) {
+	if (!wrr_policy_tick(wrr_se))
 		return;
-	}
 
-	/* Re-initialize the time slice. */
-	wrr_se->time_slice = wrr_se->weight * WRR_TIMESLICE;
+	trace_sched_wrr_slice_expire(p, rq->wrr.nr_running, rq->wrr.total_weight);
 
 	/* Requeue the task. */
 	if (wrr_se->run_list.prev != wrr_se->run_list.next) {
@@ -265,6 +425,18 @@ static void prio_changed_wrr(struct rq *rq, struct task_struct *p, int oldprio)
 
 static void switched_to_wrr(struct rq *rq, struct task_struct *p) {}
 
+/// @brief Check whether WRR tasks other than the current one are waiting
+/// on this CPU, for busy-waiting code that should yield to them instead of
+/// spinning through its timeslice.
+/// @return true if other WRR tasks are runnable on this CPU, else false.
+bool sched_wrr_contended(void)
+{
+	struct rq *rq = cpu_rq(raw_smp_processor_id());
+
+	return READ_ONCE(rq->wrr.nr_running) > (current->sched_class == &wrr_sched_class);
+}
+EXPORT_SYMBOL_GPL(sched_wrr_contended);
+
 #ifdef CONFIG_SCHED_DEBUG
 extern void print_wrr_rq(struct seq_file *m, int cpu, struct wrr_rq *wrr_rq);
 
@@ -289,6 +461,7 @@ const struct sched_class wrr_sched_class = {
 
 #ifdef CONFIG_SMP
 	.select_task_rq = select_task_rq_wrr,
+	.migrate_task_rq = migrate_task_rq_wrr,
 	.set_cpus_allowed = set_cpus_allowed_common,
 #endif
 
@@ -305,112 +478,179 @@ const struct sched_class wrr_sched_class = {
 
 #ifdef CONFIG_SMP
 
+/// @brief Move a queued, not running task to another CPU.
+/// Both runqueue locks must be held.
+/// @param src_rq the runqueue `p` is on.
+/// @param dst_rq the runqueue to move `p` to.
+/// @param p a task.
+static void wrr_move_task(struct rq *src_rq, struct rq *dst_rq, struct task_struct *p)
+{
+	p->on_rq = TASK_ON_RQ_MIGRATING;
+	deactivate_task(src_rq, p, DEQUEUE_NOCLOCK);
+	set_task_cpu(p, cpu_of(dst_rq));
+
+	activate_task(dst_rq, p, ENQUEUE_NOCLOCK);
+	p->on_rq = TASK_ON_RQ_QUEUED;
+	check_preempt_curr(dst_rq, p, 0);
+}
+
+/// @brief Push a task away from this CPU, which is `data`, while the
+/// stopper keeps the task it preempted off the CPU.
+/// @param data the runqueue of this CPU.
+/// @return 0.
+static int wrr_active_balance_cpu_stop(void *data)
+{
+	struct rq *busiest_rq = data;
+	int busiest_cpu = cpu_of(busiest_rq);
+	int target_cpu = busiest_rq->wrr.push_cpu;
+	struct rq *target_rq = cpu_rq(target_cpu);
+	unsigned int max_total, min_total;
+	struct sched_wrr_entity *wrr_se = NULL;
+	struct task_struct *p;
+
+	local_irq_disable();
+	double_rq_lock(busiest_rq, target_rq);
+
+	/* Either CPU may have gone inactive since the work was queued */
+	if (!cpu_active(busiest_cpu) || !cpu_active(target_cpu))
+		goto out_unlock;
+	if (unlikely(busiest_cpu != smp_processor_id() || !busiest_rq->wrr.active_balance))
+		goto out_unlock;
+
+	update_rq_clock(busiest_rq);
+	update_rq_clock(target_rq);
+
+	/* The preempted task is now just queued, pick with the current totals */
+	max_total = busiest_rq->wrr.total_weight;
+	min_total = target_rq->wrr.total_weight;
+	wrr_se = wrr_policy_pick_migration(&busiest_rq->wrr.queue, busiest_cpu, max_total,
+					   target_cpu, min_total);
+	if (wrr_se) {
+		p = wrr_task_of(wrr_se);
+		trace_sched_wrr_balance(p, busiest_cpu, target_cpu, max_total, min_total);
+		wrr_move_task(busiest_rq, target_rq, p);
+		busiest_rq->wrr.active_backoff = 0;
+	} else if (busiest_rq->wrr.active_backoff < WRR_ACTIVE_BALANCE_MAX_SHIFT) {
+		busiest_rq->wrr.active_backoff++;
+	}
+	busiest_rq->wrr.nr_balance_failed = 0;
+
+out_unlock:
+	busiest_rq->wrr.active_balance = 0;
+	double_rq_unlock(busiest_rq, target_rq);
+	local_irq_enable();
+
+	return 0;
+}
+
+/// @brief Decide whether the running task of `max_cpu` should be pushed to
+/// `min_cpu`, because no waiting task could be moved. Both runqueue locks
+/// must be held.
+/// @param max_cpu the source CPU.
+/// @param max_total the total weight of `max_cpu`.
+/// @param min_cpu the destination CPU.
+/// @param min_total the total weight of `min_cpu`.
+/// @return true if the caller should queue the push, else false.
+static bool wrr_want_active_balance(int max_cpu, unsigned int max_total,
+				    int min_cpu, unsigned int min_total)
+{
+	struct rq *rq = cpu_rq(max_cpu);
+	struct wrr_rq *wrr_rq = &rq->wrr;
+	struct task_struct *curr = rq->curr;
+
+	/* Only count passes that moving the running task would have fixed */
+	if (curr->sched_class != &wrr_sched_class ||
+	    !wrr_policy_can_migrate(&curr->wrr, max_cpu, max_total, min_cpu, min_total)) {
+		wrr_rq->nr_balance_failed = 0;
+		return false;
+	}
+
+	wrr_rq->nr_balance_failed++;
+	if (wrr_rq->active_balance ||
+	    !wrr_policy_active_balance_due(wrr_rq->nr_balance_failed, wrr_rq->active_backoff))
+		return false;
+
+	wrr_rq->active_balance = 1;
+	wrr_rq->push_cpu = min_cpu;
+	return true;
+}
+
 /// @brief Load balancing for WRR scheduler.
 static void load_balance_wrr(void)
 {
-	int is_first_online_cpu = 1; // Flag variable for `for_each_online_cpu` loop
-	unsigned int temp_cpu, max_cpu = 1000, min_cpu = 1000;
-	unsigned int temp_total, max_total = 0, min_total = 0;
-	struct sched_wrr_entity *temp_wrr_se;
-
-	/* Weight of the task with the highest weight on max_cpu */
-	unsigned int max_weight = 0;
+	int max_cpu, min_cpu;
+	unsigned int max_total, min_total;
+	struct sched_wrr_entity *max_wrr_se;
 
 	/* The task with the highest weight on max_cpu */
-	struct task_struct *max_task = NULL;
-	struct task_struct *temp_task;
+	struct task_struct *max_task;
 
 	unsigned long irq_flags;
+	bool push;
+	int mode;
+
+	atomic_long_inc(&this_rq()->wrr.nr_balance);
 
 	/* RCU read lock, to synchronize access to multiple CPUs */
 	rcu_read_lock();
-
-	/* Iterate over all online cpus */
-	for_each_online_cpu (temp_cpu) {
-		temp_total = cpu_rq(temp_cpu)->wrr.total_weight;
-
-		if (is_first_online_cpu) // First online CPU
-		{
-			max_cpu = temp_cpu;
-			min_cpu = temp_cpu;
-			max_total = temp_total;
-			min_total = temp_total;
-			is_first_online_cpu = 0;
-		} else if (temp_total >= max_total) {
-			max_cpu = temp_cpu;
-			max_total = temp_total;
-		} else if (temp_total <= min_total) {
-			min_cpu = temp_cpu;
-			min_total = temp_total;
-		}
-	}
-
-	rcu_read_unlock();
-
-	if (max_cpu == min_cpu) {
+	if (!wrr_policy_find_imbalance(&max_cpu, &max_total, &min_cpu, &min_total)) {
+		rcu_read_unlock();
 		return;
 	}
+	rcu_read_unlock();
 
 	/* Disable interrupts */
 	local_irq_save(irq_flags);
 
+	/* How well the current placement mode keeps the CPUs balanced */
+	mode = READ_ONCE(sysctl_sched_wrr_select_mode);
+	schedstat_inc(this_rq()->wrr.balance_count[mode]);
+	schedstat_add(this_rq()->wrr.balance_imbalance[mode], max_total - min_total);
+
 	/* Atomically lock two runqueues, because we're trying to write on the runqueues */
 	double_rq_lock(cpu_rq(max_cpu), cpu_rq(min_cpu));
 	update_rq_clock(cpu_rq(max_cpu));
 	update_rq_clock(cpu_rq(min_cpu));
 
 	/* Choose the task with the highest weight on max_cpu */
-	list_for_each_entry (temp_wrr_se, &(cpu_rq(max_cpu)->wrr.queue),
-			     run_list) {
-		if (temp_wrr_se->weight >= max_weight) {
-			temp_task = wrr_task_of(temp_wrr_se);
-
-			/* If the task is currently running, continue */
-			if (task_running(cpu_rq(max_cpu), temp_task))
-				continue;
-
-			/* Migration should not make the total weight of min_cpu equal to or greater than that of max_cpu */
-			if (min_total + temp_wrr_se->weight >=
-			    max_total - temp_wrr_se->weight)
-				continue;
-
-			/* The task’s CPU affinity should allow migrating the task to min_cpu */
-			if (!cpumask_test_cpu(min_cpu,
-					      &temp_task->cpus_allowed))
-				continue;
-
-			/* All tests passed */
-			max_weight = temp_wrr_se->weight;
-			max_task = temp_task;
-		}
-	}
+	max_wrr_se = wrr_policy_pick_migration(&cpu_rq(max_cpu)->wrr.queue,
+					       max_cpu, max_total, min_cpu, min_total);
 
-	/* No transferable task exists, return */
-	if (max_task == NULL) {
+	/* No transferable task exists, the running one may have to be pushed */
+	if (max_wrr_se == NULL) {
+		push = wrr_want_active_balance(max_cpu, max_total, min_cpu, min_total);
 		double_rq_unlock(cpu_rq(max_cpu), cpu_rq(min_cpu));
 		local_irq_restore(irq_flags);
+
+		/* The stopper preempts the running task, which can then be moved */
+		if (push && !stop_one_cpu_nowait(max_cpu, wrr_active_balance_cpu_stop,
+						 cpu_rq(max_cpu),
+						 &cpu_rq(max_cpu)->wrr.active_balance_work)) {
+			/* The stopper is not running (max_cpu is going offline) */
+			raw_spin_lock_irqsave(&cpu_rq(max_cpu)->lock, irq_flags);
+			cpu_rq(max_cpu)->wrr.active_balance = 0;
+			raw_spin_unlock_irqrestore(&cpu_rq(max_cpu)->lock, irq_flags);
+		}
 		return;
 	}
+	max_task = wrr_task_of(max_wrr_se);
+	cpu_rq(max_cpu)->wrr.nr_balance_failed = 0;
+
+	trace_sched_wrr_balance(max_task, max_cpu, min_cpu, max_total, min_total);
 
 	/* 
 		Migrate the task to min_cpu 
 	*/
-	max_task->on_rq = TASK_ON_RQ_MIGRATING;
-	deactivate_task(cpu_rq(max_cpu), max_task, DEQUEUE_NOCLOCK);
-	set_task_cpu(max_task, min_cpu);
+	wrr_move_task(cpu_rq(max_cpu), cpu_rq(min_cpu), max_task);
 
-	activate_task(cpu_rq(min_cpu), max_task, ENQUEUE_NOCLOCK);
-	max_task->on_rq = TASK_ON_RQ_QUEUED;
-	check_preempt_curr(cpu_rq(min_cpu), max_task, 0);
-
-	/* Print logs */
-	printk(KERN_DEBUG
+	/* Print logs, deferred as the runqueue locks are held */
+	printk_deferred(KERN_DEBUG
 	       "[WRR LOAD BALANCING] jiffies: %Ld\n"
 	       "[WRR LOAD BALANCING] max_cpu: %d, total_weight: %u\n"
 	       "[WRR LOAD BALANCING] min_cpu: %d, total_weight: %u\n"
 	       "[WRR LOAD BALANCING] migrated task name: %s, task weight: %u\n",
 	       (long long)(jiffies), max_cpu, max_total, min_cpu, min_total,
-	       max_task->comm, max_weight);
+	       max_task->comm, max_wrr_se->weight);
 
 	double_rq_unlock(cpu_rq(max_cpu), cpu_rq(min_cpu));
 
@@ -448,9 +688,67 @@ void trigger_load_balance_wrr(void)
 
 #endif /* SMP */
 
-/// @brief Initialize the spinlock for load balancer, and initialize the timer for periodic load balancing.
+struct dentry *wrr_debugfs_dir;
+
+/// @brief Map the statistics page of a CPU read-only.
+/// @param filp a `cpuN_stats` file, whose inode keeps the CPU index.
+/// @param vma a one page mapping at offset 0.
+static int wrr_stats_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	long cpu = (long)file_inode(filp)->i_private;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	return vm_insert_page(vma, vma->vm_start, virt_to_page(cpu_rq(cpu)->wrr.stats));
+}
+
+static const struct file_operations wrr_stats_fops = {
+	.mmap = wrr_stats_mmap,
+};
+
+/// @brief Create /sys/kernel/debug/sched_wrr and a statistics file per CPU.
+static __init int init_wrr_debugfs(void)
+{
+	char buf[24];
+	int cpu;
+
+	wrr_debugfs_dir = debugfs_create_dir("sched_wrr", NULL);
+
+	for_each_possible_cpu(cpu) {
+		if (!cpu_rq(cpu)->wrr.stats)
+			continue;
+		snprintf(buf, sizeof(buf), "cpu%d_stats", cpu);
+		/* The debugfs file proxy does not forward mmap */
+		debugfs_create_file_unsafe(buf, 0444, wrr_debugfs_dir,
+					   (void *)(long)cpu, &wrr_stats_fops);
+	}
+
+	return 0;
+}
+fs_initcall(init_wrr_debugfs);
+
+/// @brief Initialize the spinlock for load balancer, the timer for periodic load balancing and the statistics pages.
 __init void init_sched_wrr_class(void)
 {
+	int cpu;
+
+	BUILD_BUG_ON(WRR_STATS_NR_WEIGHTS != WRR_MAX_WEIGHT);
+	BUILD_BUG_ON(sizeof(struct wrr_stats_page) > PAGE_SIZE);
+
+	/* Allocate the statistics page of every CPU on its own node */
+	for_each_possible_cpu(cpu) {
+		struct page *page = alloc_pages_node(cpu_to_node(cpu), GFP_NOWAIT | __GFP_ZERO, 0);
+
+		if (!page)
+			continue;
+		cpu_rq(cpu)->wrr.stats = page_address(page);
+		cpu_rq(cpu)->wrr.stats->cpu = cpu;
+	}
+
 #ifdef CONFIG_SMP
 	/* Initialize spinlock */
 	spin_lock_init(&wrr_balancer_lock);
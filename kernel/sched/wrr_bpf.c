@@ -0,0 +1,261 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF hooks for WRR task placement and load balancing
+ * (BPF_PROG_TYPE_SCHED_WRR, attached as BPF_WRR_SELECT_CPU or BPF_WRR_BALANCE)
+ */
+#include "sched.h"
+
+#include <linux/bpf.h>
+#include <linux/bpf_wrr.h>
+#include <linux/filter.h>
+
+enum {
+	WRR_BPF_SELECT_CPU,
+	WRR_BPF_BALANCE,
+	NR_WRR_BPF_HOOKS,
+};
+
+/* One program per hook, replaced with BPF_F_ALLOW_OVERRIDE */
+static struct bpf_prog __rcu *wrr_bpf_progs[NR_WRR_BPF_HOOKS];
+static DEFINE_MUTEX(wrr_bpf_mutex);
+
+const struct bpf_prog_ops sched_wrr_prog_ops = {
+};
+
+BPF_CALL_3(bpf_wrr_rq_stats, u32, cpu, struct bpf_wrr_rq_stats *, stats,
+	   u32, size)
+{
+	struct wrr_rq *wrr_rq;
+
+	if (unlikely(size != sizeof(*stats) || cpu >= nr_cpu_ids ||
+		     !cpu_possible(cpu)))
+		goto err_clear;
+
+	wrr_rq = &cpu_rq(cpu)->wrr;
+	stats->nr_running = READ_ONCE(wrr_rq->nr_running);
+	stats->total_weight = READ_ONCE(wrr_rq->total_weight);
+	stats->online = cpu_online(cpu);
+	stats->pad = 0;
+	stats->nr_migrations_in = atomic_long_read(&wrr_rq->nr_migrations_in);
+	stats->nr_migrations_out = atomic_long_read(&wrr_rq->nr_migrations_out);
+	return 0;
+
+err_clear:
+	memset(stats, 0, size);
+	return -EINVAL;
+}
+
+static const struct bpf_func_proto bpf_wrr_rq_stats_proto = {
+	.func		= bpf_wrr_rq_stats,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_ANYTHING,
+	.arg2_type	= ARG_PTR_TO_UNINIT_MEM,
+	.arg3_type	= ARG_CONST_SIZE,
+};
+
+/*
+ * The hooks run with runqueue or pi locks held, so only helpers that
+ * neither sleep nor print are allowed.
+ */
+static const struct bpf_func_proto *
+sched_wrr_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
+{
+	switch (func_id) {
+	case BPF_FUNC_wrr_rq_stats:
+		return &bpf_wrr_rq_stats_proto;
+	case BPF_FUNC_map_lookup_elem:
+		return &bpf_map_lookup_elem_proto;
+	case BPF_FUNC_map_update_elem:
+		return &bpf_map_update_elem_proto;
+	case BPF_FUNC_map_delete_elem:
+		return &bpf_map_delete_elem_proto;
+	case BPF_FUNC_ktime_get_ns:
+		return &bpf_ktime_get_ns_proto;
+	case BPF_FUNC_get_prandom_u32:
+		return &bpf_get_prandom_u32_proto;
+	case BPF_FUNC_get_smp_processor_id:
+		return &bpf_get_smp_processor_id_proto;
+	case BPF_FUNC_get_numa_node_id:
+		return &bpf_get_numa_node_id_proto;
+	default:
+		return NULL;
+	}
+}
+
+static bool sched_wrr_is_valid_access(int off, int size,
+				      enum bpf_access_type type,
+				      const struct bpf_prog *prog,
+				      struct bpf_insn_access_aux *info)
+{
+	/* The context is a read-only array of u32 */
+	if (type != BPF_READ || size != sizeof(__u32))
+		return false;
+	if (off < 0 || off + size > sizeof(struct bpf_wrr_ctx) || off % size)
+		return false;
+	return true;
+}
+
+const struct bpf_verifier_ops sched_wrr_verifier_ops = {
+	.get_func_proto  = sched_wrr_func_proto,
+	.is_valid_access = sched_wrr_is_valid_access,
+};
+
+/// @brief Run a WRR hook program.
+/// @param hook WRR_BPF_SELECT_CPU or WRR_BPF_BALANCE.
+/// @param p the task being placed or moved.
+/// @param prev_cpu the CPU `p` comes from.
+/// @param cpu the CPU the built-in policy chose.
+/// @param ret returns the program's verdict.
+/// @return true if a program ran, else false.
+static bool wrr_bpf_run(int hook, struct task_struct *p, int prev_cpu, int cpu, int *ret)
+{
+	struct bpf_wrr_ctx ctx;
+	struct bpf_prog *prog;
+
+	rcu_read_lock();
+	prog = rcu_dereference(wrr_bpf_progs[hook]);
+	if (!prog) {
+		rcu_read_unlock();
+		return false;
+	}
+
+	ctx.pid = p->pid;
+	ctx.tgid = p->tgid;
+	ctx.weight = p->wrr.weight;
+	ctx.prev_cpu = prev_cpu;
+	ctx.cpu = cpu;
+	ctx.nr_cpu_ids = nr_cpu_ids;
+
+	*ret = BPF_PROG_RUN(prog, &ctx);
+	rcu_read_unlock();
+
+	return true;
+}
+
+/// @brief Let a BPF_WRR_SELECT_CPU program override the CPU selected for a task.
+/// @param p a task to be enqueued.
+/// @param prev_cpu the CPU `p` last ran on.
+/// @param cpu the CPU the built-in policy chose.
+/// @return the CPU the program chose if it is usable, else `cpu`.
+int wrr_bpf_select_cpu(struct task_struct *p, int prev_cpu, int cpu)
+{
+	int ret;
+
+	if (!wrr_bpf_run(WRR_BPF_SELECT_CPU, p, prev_cpu, cpu, &ret))
+		return cpu;
+
+	/* Fall back to the built-in choice unless the program picked a usable CPU */
+	if (ret < 0 || ret >= nr_cpu_ids || !cpu_online(ret) ||
+	    !cpumask_test_cpu(ret, &p->cpus_allowed))
+		return cpu;
+
+	return ret;
+}
+
+/// @brief Ask a BPF_WRR_BALANCE program whether the load balancer may move a task.
+/// @param p a migration candidate.
+/// @param src_cpu the CPU with the largest total weight.
+/// @param dst_cpu the CPU with the smallest total weight.
+/// @return false if the program vetoed the migration, else true.
+bool wrr_bpf_allow_migration(struct task_struct *p, int src_cpu, int dst_cpu)
+{
+	int ret;
+
+	if (!wrr_bpf_run(WRR_BPF_BALANCE, p, src_cpu, dst_cpu, &ret))
+		return true;
+
+	return ret != BPF_WRR_VETO;
+}
+
+static int wrr_bpf_hook(enum bpf_attach_type type)
+{
+	return type == BPF_WRR_SELECT_CPU ? WRR_BPF_SELECT_CPU : WRR_BPF_BALANCE;
+}
+
+int wrr_prog_attach(const union bpf_attr *attr, struct bpf_prog *prog)
+{
+	int hook = wrr_bpf_hook(attr->attach_type);
+	struct bpf_prog *old;
+
+	if (attr->target_fd || (attr->attach_flags & ~BPF_F_ALLOW_OVERRIDE))
+		return -EINVAL;
+	if (!capable(CAP_SYS_NICE))
+		return -EPERM;
+
+	mutex_lock(&wrr_bpf_mutex);
+	old = rcu_dereference_protected(wrr_bpf_progs[hook],
+					lockdep_is_held(&wrr_bpf_mutex));
+	if (old && !(attr->attach_flags & BPF_F_ALLOW_OVERRIDE)) {
+		mutex_unlock(&wrr_bpf_mutex);
+		return -EEXIST;
+	}
+	rcu_assign_pointer(wrr_bpf_progs[hook], prog);
+	mutex_unlock(&wrr_bpf_mutex);
+
+	/* bpf_prog_put() frees the program after an RCU grace period */
+	if (old)
+		bpf_prog_put(old);
+	return 0;
+}
+
+int wrr_prog_detach(const union bpf_attr *attr)
+{
+	int hook = wrr_bpf_hook(attr->attach_type);
+	struct bpf_prog *prog, *old;
+	int ret = 0;
+
+	if (attr->target_fd || attr->attach_flags)
+		return -EINVAL;
+	if (!capable(CAP_SYS_NICE))
+		return -EPERM;
+
+	prog = bpf_prog_get_type(attr->attach_bpf_fd, BPF_PROG_TYPE_SCHED_WRR);
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	mutex_lock(&wrr_bpf_mutex);
+	old = rcu_dereference_protected(wrr_bpf_progs[hook],
+					lockdep_is_held(&wrr_bpf_mutex));
+	if (old != prog)
+		ret = -ENOENT;
+	else
+		RCU_INIT_POINTER(wrr_bpf_progs[hook], NULL);
+	mutex_unlock(&wrr_bpf_mutex);
+
+	/* Drop the reference taken at attach time as well as ours */
+	if (!ret)
+		bpf_prog_put(old);
+	bpf_prog_put(prog);
+	return ret;
+}
+
+int wrr_prog_query(const union bpf_attr *attr, union bpf_attr __user *uattr)
+{
+	__u32 __user *prog_ids = u64_to_user_ptr(attr->query.prog_ids);
+	int hook = wrr_bpf_hook(attr->query.attach_type);
+	struct bpf_prog *prog;
+	u32 cnt, id = 0, flags = 0;
+	int ret = 0;
+
+	if (attr->query.target_fd || attr->query.query_flags)
+		return -EINVAL;
+
+	mutex_lock(&wrr_bpf_mutex);
+	prog = rcu_dereference_protected(wrr_bpf_progs[hook],
+					 lockdep_is_held(&wrr_bpf_mutex));
+	if (prog)
+		id = prog->aux->id;
+	mutex_unlock(&wrr_bpf_mutex);
+
+	cnt = id ? 1 : 0;
+	if (copy_to_user(&uattr->query.prog_cnt, &cnt, sizeof(cnt)) ||
+	    copy_to_user(&uattr->query.attach_flags, &flags, sizeof(flags)))
+		return -EFAULT;
+
+	if (attr->query.prog_cnt != 0 && prog_ids && cnt &&
+	    copy_to_user(prog_ids, &id, sizeof(id)))
+		ret = -EFAULT;
+
+	return ret;
+}
@@ -0,0 +1,219 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * WRR placement, load balancing and timeslice policy.
+ *
+ * This file is shared by kernel/sched/wrr.c and the userspace simulator in
+ * tools/sched/, so it only uses what both of them provide. Before including
+ * it, define struct sched_wrr_entity (weight, time_slice, run_list),
+ * WRR_TIMESLICE, struct list_head with its iterators, and:
+ *
+ *   wrr_policy_for_each_cpu(cpu)		iterate over the online CPUs
+ *   wrr_policy_cpu_online(cpu)			whether cpu is online
+ *   wrr_policy_total_weight(cpu)		total weight of a CPU's WRR runqueue
+ *   wrr_policy_cpu_allowed(wrr_se, cpu)	whether the affinity allows cpu
+ *   wrr_policy_random_cpu(wrr_se)		a random online CPU the affinity
+ *						allows, or -1 if there is none
+ *   wrr_policy_running(wrr_se, cpu)		whether wrr_se is running on cpu
+ *   wrr_policy_may_migrate(wrr_se, src, dst)	whether a user policy allows the
+ *						load balancer to move wrr_se
+ */
+#ifndef _WRR_POLICY_H
+#define _WRR_POLICY_H
+
+/// @brief Get the full timeslice of a WRR entity.
+/// @param wrr_se a WRR entity.
+/// @return the timeslice of `wrr_se`, in ticks.
+static inline unsigned int wrr_policy_timeslice(struct sched_wrr_entity *wrr_se)
+{
+	return wrr_se->weight * WRR_TIMESLICE;
+}
+
+/// @brief Charge one tick to the running WRR entity.
+/// The timeslice is refilled when it runs out.
+/// @param wrr_se the running WRR entity.
+/// @return true if the timeslice of `wrr_se` expired, else false.
+static inline bool wrr_policy_tick(struct sched_wrr_entity *wrr_se)
+{
+	if (--wrr_se->time_slice > 0)
+		return false;
+
+	wrr_se->time_slice = wrr_policy_timeslice(wrr_se);
+	return true;
+}
+
+/// @brief Select a CPU with minimum total weight for a WRR entity.
+/// @param wrr_se a WRR entity to be enqueued.
+/// @return the selected CPU index, or -1 if the affinity allows no online CPU.
+static inline int wrr_policy_select_cpu(struct sched_wrr_entity *wrr_se)
+{
+	int cpu, min_cpu = -1;
+	unsigned int min_total_weight = UINT_MAX;
+
+	wrr_policy_for_each_cpu(cpu) {
+		/*
+			1. The CPU affinity constraint should be satisfied.
+			2. We should select a CPU with minimum total weight.
+		*/
+		if (wrr_policy_cpu_allowed(wrr_se, cpu) &&
+		    wrr_policy_total_weight(cpu) < min_total_weight) {
+			min_cpu = cpu;
+			min_total_weight = wrr_policy_total_weight(cpu);
+		}
+	}
+
+	return min_cpu;
+}
+
+/// @brief Select the CPU with minimum total weight among `prev_cpu` and
+/// `nr_samples` random CPUs, for when scanning every CPU costs too much.
+/// Looking at two CPUs instead of one already brings the excess weight of
+/// the heaviest CPU down from O(log n / log log n) to O(log log n).
+/// @param wrr_se a WRR entity to be enqueued.
+/// @param prev_cpu the CPU `wrr_se` last ran on, or -1.
+/// @param nr_samples the number of random CPUs to look at.
+/// @return the selected CPU index, or -1 if the affinity allows no online CPU.
+static inline int wrr_policy_sample_cpu(struct sched_wrr_entity *wrr_se, int prev_cpu,
+					unsigned int nr_samples)
+{
+	int cpu, min_cpu = -1;
+	unsigned int min_total_weight = UINT_MAX;
+
+	/* prev_cpu wins ties, its caches may still be warm */
+	if (prev_cpu >= 0 && wrr_policy_cpu_online(prev_cpu) &&
+	    wrr_policy_cpu_allowed(wrr_se, prev_cpu)) {
+		min_cpu = prev_cpu;
+		min_total_weight = wrr_policy_total_weight(prev_cpu);
+	}
+
+	while (nr_samples--) {
+		cpu = wrr_policy_random_cpu(wrr_se);
+		if (cpu < 0)
+			break;
+
+		if (wrr_policy_total_weight(cpu) < min_total_weight) {
+			min_cpu = cpu;
+			min_total_weight = wrr_policy_total_weight(cpu);
+		}
+	}
+
+	return min_cpu;
+}
+
+/// @brief Find the CPUs with maximum and minimum total weight.
+/// @param max_cpu returns the CPU with maximum total weight.
+/// @param max_total returns the total weight of `max_cpu`.
+/// @param min_cpu returns the CPU with minimum total weight.
+/// @param min_total returns the total weight of `min_cpu`.
+/// @return true if they are different CPUs, else false.
+static inline bool wrr_policy_find_imbalance(int *max_cpu, unsigned int *max_total,
+					     int *min_cpu, unsigned int *min_total)
+{
+	int is_first_online_cpu = 1; // Flag variable for the CPU loop
+	unsigned int temp_total;
+	int temp_cpu;
+
+	*max_cpu = *min_cpu = -1;
+	*max_total = *min_total = 0;
+
+	wrr_policy_for_each_cpu(temp_cpu) {
+		temp_total = wrr_policy_total_weight(temp_cpu);
+
+		if (is_first_online_cpu) { // First online CPU
+			*max_cpu = temp_cpu;
+			*min_cpu = temp_cpu;
+			*max_total = temp_total;
+			*min_total = temp_total;
+			is_first_online_cpu = 0;
+		} else if (temp_total >= *max_total) {
+			*max_cpu = temp_cpu;
+			*max_total = temp_total;
+		} else if (temp_total <= *min_total) {
+			*min_cpu = temp_cpu;
+			*min_total = temp_total;
+		}
+	}
+
+	return *max_cpu != *min_cpu;
+}
+
+/* Failed balancing passes before the running task of max_cpu is pushed */
+#define WRR_ACTIVE_BALANCE_PASSES	2U
+/* Cap of the backoff after pushes that moved nothing, as a shift of the above */
+#define WRR_ACTIVE_BALANCE_MAX_SHIFT	5
+
+/// @brief Check whether moving a WRR entity from `max_cpu` to `min_cpu` is allowed
+/// and makes the balance better. Whether it is running is not checked.
+/// @param wrr_se a WRR entity on `max_cpu`.
+/// @param max_cpu the source CPU.
+/// @param max_total the total weight of `max_cpu`.
+/// @param min_cpu the destination CPU.
+/// @param min_total the total weight of `min_cpu`.
+/// @return true if `wrr_se` may be moved, else false.
+static inline bool wrr_policy_can_migrate(struct sched_wrr_entity *wrr_se,
+					  int max_cpu, unsigned int max_total,
+					  int min_cpu, unsigned int min_total)
+{
+	/* Migration should not make the total weight of min_cpu equal to or greater than that of max_cpu */
+	if (min_total + wrr_se->weight >= max_total - wrr_se->weight)
+		return false;
+
+	/* The task's CPU affinity should allow migrating the task to min_cpu */
+	if (!wrr_policy_cpu_allowed(wrr_se, min_cpu))
+		return false;
+
+	/* A user policy may veto the migration */
+	return wrr_policy_may_migrate(wrr_se, max_cpu, min_cpu);
+}
+
+/// @brief Choose the WRR entity to migrate from `max_cpu` to `min_cpu`.
+/// It is the one with the highest weight that is not running and that
+/// wrr_policy_can_migrate() accepts.
+/// @param queue the WRR queue of `max_cpu`.
+/// @param max_cpu the source CPU.
+/// @param max_total the total weight of `max_cpu`.
+/// @param min_cpu the destination CPU.
+/// @param min_total the total weight of `min_cpu`.
+/// @return the entity to migrate, or NULL if no entity can be migrated.
+static inline struct sched_wrr_entity *
+wrr_policy_pick_migration(struct list_head *queue, int max_cpu, unsigned int max_total,
+			  int min_cpu, unsigned int min_total)
+{
+	struct sched_wrr_entity *temp_wrr_se, *max_wrr_se = NULL;
+	unsigned int max_weight = 0;
+
+	list_for_each_entry(temp_wrr_se, queue, run_list) {
+		if (temp_wrr_se->weight < max_weight)
+			continue;
+
+		/* If the task is currently running, continue */
+		if (wrr_policy_running(temp_wrr_se, max_cpu))
+			continue;
+
+		if (!wrr_policy_can_migrate(temp_wrr_se, max_cpu, max_total,
+					    min_cpu, min_total))
+			continue;
+
+		/* All tests passed */
+		max_weight = temp_wrr_se->weight;
+		max_wrr_se = temp_wrr_se;
+	}
+
+	return max_wrr_se;
+}
+
+/// @brief Decide whether to push the running entity of a CPU after a
+/// balancing pass could not move any waiting one.
+/// Pushing preempts the task, so it is only done once the imbalance has
+/// survived WRR_ACTIVE_BALANCE_PASSES passes, and after a push that moved
+/// nothing that number doubles, up to WRR_ACTIVE_BALANCE_MAX_SHIFT times.
+/// @param nr_failed passes in a row that could not balance the CPU.
+/// @param backoff pushes in a row that moved nothing.
+/// @return true if the running entity should be pushed, else false.
+static inline bool wrr_policy_active_balance_due(unsigned int nr_failed,
+						 unsigned int backoff)
+{
+	backoff = backoff < WRR_ACTIVE_BALANCE_MAX_SHIFT ? backoff : WRR_ACTIVE_BALANCE_MAX_SHIFT;
+	return nr_failed >= (WRR_ACTIVE_BALANCE_PASSES << backoff);
+}
+
+#endif /* _WRR_POLICY_H */
@@ -7,6 +7,44 @@
 #include <linux/syscalls.h>
 #include "sched/sched.h"
 
+#include <trace/events/sched.h>
+
+///@brief Update the WRR weight of a task, without permission checks.
+///@param p a task.
+///@param weight the new weight.
+///@return 0 on success, or -EINVAL if `weight` is out of range or `p` is not a WRR task.
+int sched_set_wrr_weight(struct task_struct *p, unsigned int weight)
+{
+	struct sched_wrr_entity *wrr_se = &p->wrr;
+	unsigned int old_weight;
+	struct rq_flags rf;
+	struct rq *rq;
+
+	if (weight < WRR_MIN_WEIGHT || weight > WRR_MAX_WEIGHT)
+		return -EINVAL;
+
+	// acquire task & rq lock (change task on a runqueue)
+	rq = task_rq_lock(p, &rf);
+
+	if (p->policy != SCHED_WRR) {
+		task_rq_unlock(rq, p, &rf);
+		return -EINVAL;
+	}
+
+	// only a queued task counts in the total weight of its runqueue
+	old_weight = wrr_se->weight;
+	wrr_se->weight = weight;
+	if (wrr_se->on_rq) {
+		rq->wrr.total_weight += weight - old_weight;
+		wrr_stats_sync(&rq->wrr);
+	}
+	trace_sched_wrr_setweight(p, old_weight);
+
+	task_rq_unlock(rq, p, &rf);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sched_set_wrr_weight);
+
 ///@brief Update the WRR weight of a task. (syscall #294)
 ///@param pid target task's PID. PID 0 indicates the calling task.
 ///@param weight the new weight.
@@ -16,10 +54,8 @@ SYSCALL_DEFINE2(sched_setweight, pid_t, pid, unsigned int, weight)
 	unsigned int uid;
 	struct task_struct *p;
 	struct sched_wrr_entity *wrr_se;
-	struct wrr_rq *wrr_rq;
 	int weight_diff;
-	struct rq *rq;
-	struct rq_flags rf;
+	int ret;
 
 	// pid must be positive
 	if (pid < 0) {
@@ -27,7 +63,7 @@ SYSCALL_DEFINE2(sched_setweight, pid_t, pid, unsigned int, weight)
 	}
 
 	// weight must be in valid range [1, 20]
-	if (weight < 1 || weight > 20) {
+	if (weight < WRR_MIN_WEIGHT || weight > WRR_MAX_WEIGHT) {
 		return -EINVAL;
 	}
 
@@ -62,19 +98,13 @@ SYSCALL_DEFINE2(sched_setweight, pid_t, pid, unsigned int, weight)
 		return -EPERM;
 	}
 
-	// acquire task & rq lock (change task on a runqueue)
-	rq = task_rq_lock(p, &rf);
-
 	// change weight
-	wrr_rq = &rq->wrr;
-	wrr_se->weight += weight_diff;
-	wrr_rq->total_weight += weight_diff;
+	ret = sched_set_wrr_weight(p, weight);
 
-	// release task & rq lock and RCU read lock
-	task_rq_unlock(rq, p, &rf);
+	// release RCU read lock
 	rcu_read_unlock();
 
-	return 0;
+	return ret;
 }
 
 ///@brief Query the WRR weight of a task. (syscall #295)
@@ -308,6 +308,11 @@ static int max_sched_tunable_scaling = SCHED_TUNABLESCALING_END-1;
 #endif /* CONFIG_SMP */
 #endif /* CONFIG_SCHED_DEBUG */
 
+static int max_sched_wrr_select_mode = SCHED_WRR_NR_SELECT_MODES - 1;
+static int max_sched_wrr_select_samples = SCHED_WRR_SELECT_MAX_SAMPLES;
+static int max_kswapd_threads = MAX_KSWAPD_THREADS;
+static int max_wrr_weight = WRR_MAX_WEIGHT;
+
 #ifdef CONFIG_COMPACTION
 static int min_extfrag_threshold;
 static int max_extfrag_threshold = 1000;
@@ -447,6 +452,24 @@ static struct ctl_table kern_table[] = {
 		.mode		= 0644,
 		.proc_handler	= sched_rr_handler,
 	},
+	{
+		.procname	= "sched_wrr_select_mode",
+		.data		= &sysctl_sched_wrr_select_mode,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &max_sched_wrr_select_mode,
+	},
+	{
+		.procname	= "sched_wrr_select_samples",
+		.data		= &sysctl_sched_wrr_select_samples,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &one,
+		.extra2		= &max_sched_wrr_select_samples,
+	},
 #ifdef CONFIG_SCHED_AUTOGROUP
 	{
 		.procname	= "sched_autogroup_enabled",
@@ -1461,6 +1484,24 @@ static struct ctl_table vm_table[] = {
 		.extra1		= &one,
 		.extra2		= &one_thousand,
 	},
+	{
+		.procname	= "kswapd_threads",
+		.data		= &kswapd_threads,
+		.maxlen		= sizeof(kswapd_threads),
+		.mode		= 0644,
+		.proc_handler	= kswapd_threads_sysctl_handler,
+		.extra1		= &one,
+		.extra2		= &max_kswapd_threads,
+	},
+	{
+		.procname	= "kswapd_wrr_weight",
+		.data		= &kswapd_wrr_weight,
+		.maxlen		= sizeof(kswapd_wrr_weight),
+		.mode		= 0644,
+		.proc_handler	= kswapd_threads_sysctl_handler,
+		.extra1		= &zero,
+		.extra2		= &max_wrr_weight,
+	},
 	{
 		.procname	= "percpu_pagelist_fraction",
 		.data		= &percpu_pagelist_fraction,
@@ -48,6 +48,9 @@
 #include <linux/moduleparam.h>
 #include <linux/uaccess.h>
 #include <linux/sched/isolation.h>
+#include <linux/sched/clock.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/nmi.h>
 
 #include "workqueue_internal.h"
@@ -83,7 +86,19 @@ enum {
 	WORKER_NOT_RUNNING	= WORKER_PREP | WORKER_CPU_INTENSIVE |
 				  WORKER_UNBOUND | WORKER_REBOUND,
 
-	NR_STD_WORKER_POOLS	= 2,		/* # standard pools per cpu */
+	NR_STD_WORKER_POOLS	= 3,		/* # standard pools per cpu */
+
+	/*
+	 * Standard pools by WRR weight tier.  The first two keep the
+	 * indexing by WQ_HIGHPRI that predates the tiers.
+	 */
+	WRR_TIER_NORMAL		= 0,		/* default weight */
+	WRR_TIER_HIGH		= 1,		/* WRR_MAX_WEIGHT, WQ_HIGHPRI */
+	WRR_TIER_LOW		= 2,		/* WRR_MIN_WEIGHT */
+
+	/* submitter weights below LOW and above HIGH pick those tiers */
+	WRR_TIER_LOW_WEIGHT	= 5,
+	WRR_TIER_HIGH_WEIGHT	= 15,
 
 	UNBOUND_POOL_HASH_ORDER	= 6,		/* hashed by pool->attrs */
 	BUSY_WORKER_HASH_ORDER	= 6,		/* 64 pointers */
@@ -175,6 +190,10 @@ struct worker_pool {
 	struct hlist_node	hash_node;	/* PL: unbound_pool_hash node */
 	int			refcnt;		/* PL: refcnt for unbound pools */
 
+	u64			nr_queued;	/* L: work items queued */
+	u64			nr_executed;	/* L: work items executed */
+	u64			exec_ns;	/* L: time spent executing them */
+
 	/*
 	 * The current concurrency level.  As it's likely to be accessed
 	 * from other CPUs during try_to_wake_up(), put it in a separate
@@ -1299,6 +1318,7 @@ static void insert_work(struct pool_workqueue *pwq, struct work_struct *work,
 	set_work_pwq(work, pwq, extra_flags);
 	list_add_tail(&work->entry, head);
 	get_pwq(pwq);
+	pool->nr_queued++;
 
 	/*
 	 * Ensure either wq_worker_sleeping() sees the above
@@ -1360,6 +1380,28 @@ static int wq_select_unbound_cpu(int cpu)
 	return new_cpu;
 }
 
+/*
+ * The WRR weight tier of the standard pool to queue on.  Work items of a
+ * WQ_WRR_INHERIT workqueue run at about the weight of the task that
+ * queued them; those queued from IRQ context, which has no meaningful
+ * submitter, use the normal tier.
+ */
+static int wq_wrr_tier(struct workqueue_struct *wq)
+{
+	unsigned int weight;
+
+	if (!(wq->flags & WQ_WRR_INHERIT) || !in_task() ||
+	    current->policy != SCHED_WRR)
+		return WRR_TIER_NORMAL;
+
+	weight = READ_ONCE(current->wrr.weight);
+	if (weight < WRR_TIER_LOW_WEIGHT)
+		return WRR_TIER_LOW;
+	if (weight > WRR_TIER_HIGH_WEIGHT)
+		return WRR_TIER_HIGH;
+	return WRR_TIER_NORMAL;
+}
+
 static void __queue_work(int cpu, struct workqueue_struct *wq,
 			 struct work_struct *work)
 {
@@ -1389,7 +1431,7 @@ retry:
 
 	/* pwq which will be used unless @work is executing elsewhere */
 	if (!(wq->flags & WQ_UNBOUND))
-		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
+		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu) + wq_wrr_tier(wq);
 	else
 		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
 
@@ -1806,7 +1848,8 @@ static struct worker *create_worker(struct worker_pool *pool)
 
 	if (pool->cpu >= 0)
 		snprintf(id_buf, sizeof(id_buf), "%d:%d%s", pool->cpu, id,
-			 pool->attrs->nice < 0  ? "H" : "");
+			 pool->attrs->nice < 0  ? "H" :
+			 pool->attrs->wrr_weight == WRR_MIN_WEIGHT ? "L" : "");
 	else
 		snprintf(id_buf, sizeof(id_buf), "u%d:%d", pool->id, id);
 
@@ -1816,6 +1859,8 @@ static struct worker *create_worker(struct worker_pool *pool)
 		goto fail;
 
 	set_user_nice(worker->task, pool->attrs->nice);
+	if (pool->attrs->wrr_weight)
+		sched_set_wrr_weight(worker->task, pool->attrs->wrr_weight);
 	kthread_bind_mask(worker->task, pool->attrs->cpumask);
 
 	/* successful, attach the worker to the pool */
@@ -2052,6 +2097,7 @@ __acquires(&pool->lock)
 	bool cpu_intensive = pwq->wq->flags & WQ_CPU_INTENSIVE;
 	int work_color;
 	struct worker *collision;
+	u64 start;
 #ifdef CONFIG_LOCKDEP
 	/*
 	 * It is permissible to free the struct work_struct from
@@ -2150,7 +2196,9 @@ __acquires(&pool->lock)
 	 */
 	lockdep_invariant_state(true);
 	trace_workqueue_execute_start(work);
+	start = local_clock();
 	worker->current_func(work);
+	start = local_clock() - start;
 	/*
 	 * While we must be careful to not use "work" after this, the trace
 	 * point will only record its address.
@@ -2180,6 +2228,9 @@ __acquires(&pool->lock)
 
 	spin_lock_irq(&pool->lock);
 
+	pool->nr_executed++;
+	pool->exec_ns += start;
+
 	/* clear cpu intensive status */
 	if (unlikely(cpu_intensive))
 		worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
@@ -3247,6 +3298,7 @@ static void copy_workqueue_attrs(struct workqueue_attrs *to,
 				 const struct workqueue_attrs *from)
 {
 	to->nice = from->nice;
+	to->wrr_weight = from->wrr_weight;
 	cpumask_copy(to->cpumask, from->cpumask);
 	/*
 	 * Unlike hash and equality test, this function doesn't ignore
@@ -3262,6 +3314,7 @@ static u32 wqattrs_hash(const struct workqueue_attrs *attrs)
 	u32 hash = 0;
 
 	hash = jhash_1word(attrs->nice, hash);
+	hash = jhash_1word(attrs->wrr_weight, hash);
 	hash = jhash(cpumask_bits(attrs->cpumask),
 		     BITS_TO_LONGS(nr_cpumask_bits) * sizeof(long), hash);
 	return hash;
@@ -3273,6 +3326,8 @@ static bool wqattrs_equal(const struct workqueue_attrs *a,
 {
 	if (a->nice != b->nice)
 		return false;
+	if (a->wrr_weight != b->wrr_weight)
+		return false;
 	if (!cpumask_equal(a->cpumask, b->cpumask))
 		return false;
 	return true;
@@ -3975,7 +4030,11 @@ static int alloc_and_link_pwqs(struct workqueue_struct *wq)
 	int cpu, ret;
 
 	if (!(wq->flags & WQ_UNBOUND)) {
-		wq->cpu_pwqs = alloc_percpu(struct pool_workqueue);
+		/* a WQ_WRR_INHERIT wq has one pwq per tier, indexed by tier */
+		int i, nr_pwqs = wq->flags & WQ_WRR_INHERIT ? NR_STD_WORKER_POOLS : 1;
+
+		wq->cpu_pwqs = __alloc_percpu(sizeof(struct pool_workqueue) * nr_pwqs,
+					      __alignof__(struct pool_workqueue));
 		if (!wq->cpu_pwqs)
 			return -ENOMEM;
 
@@ -3985,11 +4044,14 @@ static int alloc_and_link_pwqs(struct workqueue_struct *wq)
 			struct worker_pool *cpu_pools =
 				per_cpu(cpu_worker_pools, cpu);
 
-			init_pwq(pwq, wq, &cpu_pools[highpri]);
+			for (i = 0; i < nr_pwqs; i++) {
+				init_pwq(pwq + i, wq,
+					 &cpu_pools[nr_pwqs > 1 ? i : highpri]);
 
-			mutex_lock(&wq->mutex);
-			link_pwq(pwq);
-			mutex_unlock(&wq->mutex);
+				mutex_lock(&wq->mutex);
+				link_pwq(pwq + i);
+				mutex_unlock(&wq->mutex);
+			}
 		}
 		return 0;
 	} else if (wq->flags & __WQ_ORDERED) {
@@ -4072,6 +4134,10 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	if ((flags & WQ_POWER_EFFICIENT) && wq_power_efficient)
 		flags |= WQ_UNBOUND;
 
+	/* see the comment above the definition of WQ_WRR_INHERIT */
+	if (flags & (WQ_UNBOUND | WQ_HIGHPRI))
+		flags &= ~WQ_WRR_INHERIT;
+
 	/* allocate wq and format name */
 	if (flags & WQ_UNBOUND)
 		tbl_size = nr_node_ids * sizeof(wq->numa_pwq_tbl[0]);
@@ -4314,7 +4380,7 @@ bool workqueue_congested(int cpu, struct workqueue_struct *wq)
 		cpu = smp_processor_id();
 
 	if (!(wq->flags & WQ_UNBOUND))
-		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
+		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu) + wq_wrr_tier(wq);
 	else
 		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
 
@@ -5335,9 +5401,51 @@ out_unlock:
 	return ret ?: count;
 }
 
+static ssize_t wq_wrr_weight_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq->mutex);
+	written = scnprintf(buf, PAGE_SIZE, "%u\n",
+			    wq->unbound_attrs->wrr_weight);
+	mutex_unlock(&wq->mutex);
+
+	return written;
+}
+
+static ssize_t wq_wrr_weight_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int ret = -ENOMEM;
+
+	apply_wqattrs_lock();
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		goto out_unlock;
+
+	/* 0 leaves the workers at the default weight */
+	if (sscanf(buf, "%u", &attrs->wrr_weight) == 1 &&
+	    attrs->wrr_weight <= WRR_MAX_WEIGHT)
+		ret = apply_workqueue_attrs_locked(wq, attrs);
+	else
+		ret = -EINVAL;
+
+out_unlock:
+	apply_wqattrs_unlock();
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
 static struct device_attribute wq_sysfs_unbound_attrs[] = {
 	__ATTR(pool_ids, 0444, wq_pool_ids_show, NULL),
 	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
+	__ATTR(wrr_weight, 0644, wq_wrr_weight_show, wq_wrr_weight_store),
 	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
 	__ATTR(numa, 0644, wq_numa_show, wq_numa_store),
 	__ATTR_NULL,
@@ -5489,6 +5597,64 @@ static void workqueue_sysfs_unregister(struct workqueue_struct *wq)
 static void workqueue_sysfs_unregister(struct workqueue_struct *wq)	{ }
 #endif	/* CONFIG_SYSFS */
 
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Per-pool counters in <debugfs>/workqueue/pools, one line per pool.
+ * The WRR weight tier of a pool is the weight of its workers, 0 being
+ * the default, so deferred work of heavy submitters that waits behind
+ * bulk work shows up as a high queued-to-executed gap in the high tier.
+ */
+static int wq_pools_show(struct seq_file *m, void *v)
+{
+	struct worker_pool *pool;
+	int pi;
+
+	seq_puts(m, "pool  cpu  nice  wrr_weight  workers  idle  running  queued  executed  exec_ns\n");
+
+	rcu_read_lock_sched();
+	for_each_pool(pool, pi) {
+		spin_lock_irq(&pool->lock);
+		seq_printf(m, "%4d %4d %5d %11u %8d %5d %8d %7llu %9llu %8llu\n",
+			   pool->id, pool->cpu, pool->attrs->nice,
+			   pool->attrs->wrr_weight, pool->nr_workers,
+			   pool->nr_idle, atomic_read(&pool->nr_running),
+			   pool->nr_queued, pool->nr_executed, pool->exec_ns);
+		spin_unlock_irq(&pool->lock);
+	}
+	rcu_read_unlock_sched();
+
+	return 0;
+}
+
+static int wq_pools_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wq_pools_show, NULL);
+}
+
+static const struct file_operations wq_pools_fops = {
+	.open		= wq_pools_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init wq_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("workqueue", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("pools", 0444, dir, NULL, &wq_pools_fops)) {
+		debugfs_remove(dir);
+		return -ENOMEM;
+	}
+	return 0;
+}
+late_initcall(wq_debugfs_init);
+#endif	/* CONFIG_DEBUG_FS */
+
 /*
  * Workqueue watchdog.
  *
@@ -5689,7 +5855,12 @@ static void __init wq_numa_init(void)
  */
 int __init workqueue_init_early(void)
 {
-	int std_nice[NR_STD_WORKER_POOLS] = { 0, HIGHPRI_NICE_LEVEL };
+	int std_nice[NR_STD_WORKER_POOLS] = { 0, HIGHPRI_NICE_LEVEL, 0 };
+	unsigned int std_wrr_weight[NR_STD_WORKER_POOLS] = {
+		[WRR_TIER_NORMAL]	= 0,
+		[WRR_TIER_HIGH]		= WRR_MAX_WEIGHT,
+		[WRR_TIER_LOW]		= WRR_MIN_WEIGHT,
+	};
 	int hk_flags = HK_FLAG_DOMAIN | HK_FLAG_WQ;
 	int i, cpu;
 
@@ -5709,7 +5880,8 @@ int __init workqueue_init_early(void)
 			BUG_ON(init_worker_pool(pool));
 			pool->cpu = cpu;
 			cpumask_copy(pool->attrs->cpumask, cpumask_of(cpu));
-			pool->attrs->nice = std_nice[i++];
+			pool->attrs->nice = std_nice[i];
+			pool->attrs->wrr_weight = std_wrr_weight[i++];
 			pool->node = cpu_to_node(cpu);
 
 			/* alloc pool ID */
@@ -5725,6 +5897,7 @@ int __init workqueue_init_early(void)
 
 		BUG_ON(!(attrs = alloc_workqueue_attrs(GFP_KERNEL)));
 		attrs->nice = std_nice[i];
+		attrs->wrr_weight = std_wrr_weight[i];
 		unbound_std_wq_attrs[i] = attrs;
 
 		/*
@@ -5734,6 +5907,7 @@ int __init workqueue_init_early(void)
 		 */
 		BUG_ON(!(attrs = alloc_workqueue_attrs(GFP_KERNEL)));
 		attrs->nice = std_nice[i];
+		attrs->wrr_weight = std_wrr_weight[i];
 		attrs->no_numa = true;
 		ordered_wq_attrs[i] = attrs;
 	}
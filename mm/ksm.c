@@ -109,6 +109,13 @@
  *
  * If the merge_across_nodes tunable is unset, then KSM maintains multiple
  * stable trees and multiple unstable trees: one of each for each NUMA node.
+ *
+ * The scan can be split among up to KSM_MAX_SCANNERS threads (the
+ * scan_threads tunable), each walking its own share of the mm_slots with
+ * its own cursor.  They walk page tables and checksum pages in parallel,
+ * but take ksm_tree_mutex for everything else they do to the trees.  A
+ * full scan completes when every thread has been through its mm_slots:
+ * the last one to finish flushes the unstable tree for all of them.
  */
 
 /**
@@ -117,12 +124,14 @@
  * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @owner: picks the scanner thread of this mm_slot, see mm_slot_scanner()
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+	unsigned int owner;
 };
 
 /**
@@ -132,7 +141,9 @@ struct mm_slot {
  * @rmap_list: link to the next rmap to be scanned in the rmap_list
  * @seqnr: count of completed full scans (needed when removing unstable node)
  *
- * There is only the one ksm_scan instance of this cursor structure.
+ * The ksm_scan instance is the cursor of unmerge_and_remove_all_rmap_items(),
+ * and its @seqnr counts the full scans.  Each scanner thread has its own
+ * cursor, whose @seqnr is the full scan that thread is working on.
  */
 struct ksm_scan {
 	struct mm_slot *mm_slot;
@@ -239,6 +250,27 @@ static struct ksm_scan ksm_scan = {
 	.mm_slot = &ksm_mm_head,
 };
 
+#define KSM_MAX_SCANNERS	16
+
+/**
+ * struct ksm_scanner - a scanner thread
+ * @scan: cursor of this thread
+ * @stale: rmap_items unlinked from their mm_slot, to be removed from the trees
+ * @task: the thread, or NULL when not running
+ * @id: index in ksm_scanners
+ */
+struct ksm_scanner {
+	struct ksm_scan scan;
+	struct rmap_item *stale;
+	struct task_struct *task;
+	unsigned int id;
+};
+static struct ksm_scanner ksm_scanners[KSM_MAX_SCANNERS] = {
+	[0 ... KSM_MAX_SCANNERS - 1] = {
+		.scan.mm_slot = &ksm_mm_head,
+	},
+};
+
 static struct kmem_cache *rmap_item_cache;
 static struct kmem_cache *stable_node_cache;
 static struct kmem_cache *mm_slot_cache;
@@ -253,7 +285,7 @@ static unsigned long ksm_pages_sharing;
 static unsigned long ksm_pages_unshared;
 
 /* The number of rmap_items in use: to calculate pages_volatile */
-static unsigned long ksm_rmap_items;
+static atomic_long_t ksm_rmap_items;
 
 /* The number of stable_node chains */
 static unsigned long ksm_stable_node_chains;
@@ -273,6 +305,15 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Number of scanner threads */
+static unsigned int ksm_nr_scanners = 1;
+
+/* WRR weight of the scanner threads */
+static unsigned int ksm_scan_weight = WRR_MIN_WEIGHT;
+
+/* Pages scanned */
+static atomic_long_t ksm_pages_scanned;
+
 /* Checksum of an empty (zeroed) page */
 static unsigned int zero_checksum __read_mostly;
 
@@ -296,9 +337,16 @@ static unsigned long ksm_run = KSM_RUN_STOP;
 static void wait_while_offlining(void);
 
 static DECLARE_WAIT_QUEUE_HEAD(ksm_thread_wait);
-static DEFINE_MUTEX(ksm_thread_mutex);
+static DECLARE_RWSEM(ksm_thread_sem);	/* read by scanners, written by the rest */
+static DEFINE_MUTEX(ksm_tree_mutex);	/* serializes scanners on the trees */
+static DEFINE_MUTEX(ksm_scanners_mutex);	/* starting and stopping scanners */
 static DEFINE_SPINLOCK(ksm_mmlist_lock);
 
+/* Scanners done with the current full scan, under ksm_tree_mutex */
+static unsigned int ksm_scanners_done;
+/* Next mm_slot owner, under ksm_mmlist_lock */
+static unsigned int ksm_next_owner;
+
 #define KSM_KMEM_CACHE(__struct, __flags) kmem_cache_create("ksm_"#__struct,\
 		sizeof(struct __struct), __alignof__(struct __struct),\
 		(__flags), NULL)
@@ -381,13 +429,13 @@ static inline struct rmap_item *alloc_rmap_item(void)
 	rmap_item = kmem_cache_zalloc(rmap_item_cache, GFP_KERNEL |
 						__GFP_NORETRY | __GFP_NOWARN);
 	if (rmap_item)
-		ksm_rmap_items++;
+		atomic_long_inc(&ksm_rmap_items);
 	return rmap_item;
 }
 
 static inline void free_rmap_item(struct rmap_item *rmap_item)
 {
-	ksm_rmap_items--;
+	atomic_long_dec(&ksm_rmap_items);
 	rmap_item->mm = NULL;	/* debug safety */
 	kmem_cache_free(rmap_item_cache, rmap_item);
 }
@@ -439,6 +487,27 @@ static void insert_to_mm_slots_hash(struct mm_struct *mm,
 	hash_add(mm_slots_hash, &mm_slot->link, (unsigned long)mm);
 }
 
+/*
+ * The scanner thread in charge of an mm_slot.  ksm_nr_scanners only changes
+ * under ksm_mmlist_lock, with ksm_thread_sem held for write.
+ */
+static inline struct ksm_scanner *mm_slot_scanner(struct mm_slot *mm_slot)
+{
+	return &ksm_scanners[mm_slot->owner % ksm_nr_scanners];
+}
+
+/*
+ * The cursor that gets to the mm_slots behind it next: the one of
+ * unmerge_and_remove_all_rmap_items() while unmerging, or else the one of
+ * the scanner of @mm_slot.  Called under ksm_mmlist_lock.
+ */
+static inline struct mm_slot *ksm_cursor(struct mm_slot *mm_slot)
+{
+	if (ksm_run & KSM_RUN_UNMERGE)
+		return ksm_scan.mm_slot;
+	return mm_slot_scanner(mm_slot)->scan.mm_slot;
+}
+
 /*
  * ksmd, and unmerge_and_remove_all_rmap_items(), must not touch an mm's
  * page tables after it has passed through ksm_exit() - which, if necessary,
@@ -946,6 +1015,25 @@ static int remove_all_stable_nodes(void)
 	return err;
 }
 
+/*
+ * Send all scanner threads back to the start of the current full scan, and
+ * deal the mm_slots out among @nr_scanners of them.  Called with
+ * ksm_thread_sem held for write, so that none of them is within a batch.
+ */
+static void ksm_reset_scanners(unsigned int nr_scanners)
+{
+	int i;
+
+	spin_lock(&ksm_mmlist_lock);
+	ksm_nr_scanners = nr_scanners;
+	for (i = 0; i < KSM_MAX_SCANNERS; i++) {
+		ksm_scanners[i].scan.mm_slot = &ksm_mm_head;
+		ksm_scanners[i].scan.seqnr = ksm_scan.seqnr;
+	}
+	spin_unlock(&ksm_mmlist_lock);
+	ksm_scanners_done = 0;
+}
+
 static int unmerge_and_remove_all_rmap_items(void)
 {
 	struct mm_slot *mm_slot;
@@ -953,6 +1041,9 @@ static int unmerge_and_remove_all_rmap_items(void)
 	struct vm_area_struct *vma;
 	int err = 0;
 
+	/* Get the scanners' cursors off the mm_slots we may free */
+	ksm_reset_scanners(ksm_nr_scanners);
+
 	spin_lock(&ksm_mmlist_lock);
 	ksm_scan.mm_slot = list_entry(ksm_mm_head.mm_list.next,
 						struct mm_slot, mm_list);
@@ -994,6 +1085,7 @@ static int unmerge_and_remove_all_rmap_items(void)
 	/* Clean up stable nodes, but don't worry if some are still busy */
 	remove_all_stable_nodes();
 	ksm_scan.seqnr = 0;
+	ksm_reset_scanners(ksm_nr_scanners);
 	return 0;
 
 error:
@@ -2026,6 +2118,8 @@ static void stable_tree_append(struct rmap_item *rmap_item,
  * be inserted into the unstable tree, or merged with a page already there and
  * both transferred to the stable tree.
  *
+ * Called with ksm_tree_mutex held, which is dropped while checksumming.
+ *
  * @page: the page that we are searching identical page to.
  * @rmap_item: the reverse mapping into the virtual address of this page
  */
@@ -2090,8 +2184,12 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * we calculated it, this page is changing frequently: therefore we
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
+	 * rmap_item is in neither tree now, so let other scanners at the
+	 * trees meanwhile.
 	 */
+	mutex_unlock(&ksm_tree_mutex);
 	checksum = calc_checksum(page);
+	mutex_lock(&ksm_tree_mutex);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
 		return;
@@ -2179,7 +2277,45 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	}
 }
 
-static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
+/*
+ * Unlink the rmap_item at *@rmap_list from its mm_slot, to be taken out of
+ * the trees by remove_stale_rmap_items(): that needs ksm_tree_mutex, which
+ * is not to be taken under mmap_sem, because the holder of ksm_tree_mutex
+ * takes the mmap_sem of the mms it merges pages of.
+ */
+static void unlink_rmap_item(struct ksm_scanner *scanner,
+			     struct rmap_item **rmap_list)
+{
+	struct rmap_item *rmap_item = *rmap_list;
+
+	*rmap_list = rmap_item->rmap_list;
+	rmap_item->rmap_list = scanner->stale;
+	scanner->stale = rmap_item;
+}
+
+/*
+ * Called without mmap_sem, but while the mm of the unlinked rmap_items is
+ * still pinned, since other scanners may find them in the unstable tree.
+ */
+static void remove_stale_rmap_items(struct ksm_scanner *scanner)
+{
+	struct rmap_item *rmap_item;
+
+	if (!scanner->stale)
+		return;
+
+	mutex_lock(&ksm_tree_mutex);
+	while (scanner->stale) {
+		rmap_item = scanner->stale;
+		scanner->stale = rmap_item->rmap_list;
+		remove_rmap_item_from_tree(rmap_item);
+		free_rmap_item(rmap_item);
+	}
+	mutex_unlock(&ksm_tree_mutex);
+}
+
+static struct rmap_item *get_next_rmap_item(struct ksm_scanner *scanner,
+					    struct mm_slot *mm_slot,
 					    struct rmap_item **rmap_list,
 					    unsigned long addr)
 {
@@ -2191,9 +2327,7 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 			return rmap_item;
 		if (rmap_item->address > addr)
 			break;
-		*rmap_list = rmap_item->rmap_list;
-		remove_rmap_item_from_tree(rmap_item);
-		free_rmap_item(rmap_item);
+		unlink_rmap_item(scanner, rmap_list);
 	}
 
 	rmap_item = alloc_rmap_item();
@@ -2207,66 +2341,102 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+/*
+ * Called by a scanner thread at the end of its pass over its mm_slots.  The
+ * last one to get there completes the full scan, and starts the next one
+ * for all of them.
+ */
+static void ksm_scanner_done(struct ksm_scanner *scanner)
+{
+	int nid;
+
+	mutex_lock(&ksm_tree_mutex);
+	WRITE_ONCE(scanner->scan.seqnr, ksm_scan.seqnr + 1);
+	if (++ksm_scanners_done < ksm_nr_scanners) {
+		mutex_unlock(&ksm_tree_mutex);
+		return;
+	}
+	ksm_scanners_done = 0;
+
+	/*
+	 * Whereas stale stable_nodes on the stable_tree itself
+	 * get pruned in the regular course of stable_tree_search(),
+	 * those moved out to the migrate_nodes list can accumulate:
+	 * so prune them once before each full scan.
+	 */
+	if (!ksm_merge_across_nodes) {
+		struct stable_node *stable_node, *next;
+		struct page *page;
+
+		list_for_each_entry_safe(stable_node, next,
+					 &migrate_nodes, list) {
+			page = get_ksm_page(stable_node, false);
+			if (page)
+				put_page(page);
+			cond_resched();
+		}
+	}
+
+	for (nid = 0; nid < ksm_nr_node_ids; nid++)
+		root_unstable_tree[nid] = RB_ROOT;
+
+	WRITE_ONCE(ksm_scan.seqnr, ksm_scan.seqnr + 1);
+	mutex_unlock(&ksm_tree_mutex);
+
+	/*
+	 * A number of pages can hang around indefinitely on per-cpu
+	 * pagevecs, raised page count preventing write_protect_page
+	 * from merging them.  Though it doesn't really matter much,
+	 * it is puzzling to see some stuck in pages_volatile until
+	 * other activity jostles them out, and they also prevented
+	 * LTP's KSM test from succeeding deterministically; so drain
+	 * them here (here rather than on entry to ksm_do_scan(),
+	 * so we don't IPI too often when pages_to_scan is set low).
+	 */
+	lru_add_drain_all();
+
+	wake_up_interruptible(&ksm_thread_wait);
+}
+
+/* The next mm_slot after @slot that @scanner is in charge of */
+static struct mm_slot *ksm_next_slot(struct ksm_scanner *scanner,
+				     struct mm_slot *slot)
+{
+	do {
+		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
+	} while (slot != &ksm_mm_head && mm_slot_scanner(slot) != scanner);
+
+	return slot;
+}
+
+static struct rmap_item *scan_get_next_rmap_item(struct ksm_scanner *scanner,
+						 struct page **page)
 {
+	struct ksm_scan *scan = &scanner->scan;
 	struct mm_struct *mm;
 	struct mm_slot *slot;
 	struct vm_area_struct *vma;
 	struct rmap_item *rmap_item;
-	int nid;
 
 	if (list_empty(&ksm_mm_head.mm_list))
 		return NULL;
 
-	slot = ksm_scan.mm_slot;
+	slot = scan->mm_slot;
 	if (slot == &ksm_mm_head) {
-		/*
-		 * A number of pages can hang around indefinitely on per-cpu
-		 * pagevecs, raised page count preventing write_protect_page
-		 * from merging them.  Though it doesn't really matter much,
-		 * it is puzzling to see some stuck in pages_volatile until
-		 * other activity jostles them out, and they also prevented
-		 * LTP's KSM test from succeeding deterministically; so drain
-		 * them here (here rather than on entry to ksm_do_scan(),
-		 * so we don't IPI too often when pages_to_scan is set low).
-		 */
-		lru_add_drain_all();
-
-		/*
-		 * Whereas stale stable_nodes on the stable_tree itself
-		 * get pruned in the regular course of stable_tree_search(),
-		 * those moved out to the migrate_nodes list can accumulate:
-		 * so prune them once before each full scan.
-		 */
-		if (!ksm_merge_across_nodes) {
-			struct stable_node *stable_node, *next;
-			struct page *page;
-
-			list_for_each_entry_safe(stable_node, next,
-						 &migrate_nodes, list) {
-				page = get_ksm_page(stable_node, false);
-				if (page)
-					put_page(page);
-				cond_resched();
-			}
-		}
-
-		for (nid = 0; nid < ksm_nr_node_ids; nid++)
-			root_unstable_tree[nid] = RB_ROOT;
-
 		spin_lock(&ksm_mmlist_lock);
-		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
-		ksm_scan.mm_slot = slot;
+		slot = ksm_next_slot(scanner, slot);
+		scan->mm_slot = slot;
 		spin_unlock(&ksm_mmlist_lock);
 		/*
-		 * Although we tested list_empty() above, a racing __ksm_exit
-		 * of the last mm on the list may have removed it since then.
+		 * Other scanners may be in charge of all the mm_slots, or a
+		 * racing __ksm_exit of the last mm on the list may have
+		 * removed it since we tested list_empty() above.
 		 */
 		if (slot == &ksm_mm_head)
-			return NULL;
+			goto done;
 next_mm:
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 
 	mm = slot->mm;
@@ -2274,59 +2444,64 @@ next_mm:
 	if (ksm_test_exit(mm))
 		vma = NULL;
 	else
-		vma = find_vma(mm, ksm_scan.address);
+		vma = find_vma(mm, scan->address);
 
 	for (; vma; vma = vma->vm_next) {
 		if (!(vma->vm_flags & VM_MERGEABLE))
 			continue;
-		if (ksm_scan.address < vma->vm_start)
-			ksm_scan.address = vma->vm_start;
+		if (scan->address < vma->vm_start)
+			scan->address = vma->vm_start;
 		if (!vma->anon_vma)
-			ksm_scan.address = vma->vm_end;
+			scan->address = vma->vm_end;
 
-		while (ksm_scan.address < vma->vm_end) {
+		while (scan->address < vma->vm_end) {
 			if (ksm_test_exit(mm))
 				break;
-			*page = follow_page(vma, ksm_scan.address, FOLL_GET);
+			*page = follow_page(vma, scan->address, FOLL_GET);
 			if (IS_ERR_OR_NULL(*page)) {
-				ksm_scan.address += PAGE_SIZE;
+				scan->address += PAGE_SIZE;
 				cond_resched();
 				continue;
 			}
 			if (PageAnon(*page)) {
-				flush_anon_page(vma, *page, ksm_scan.address);
+				flush_anon_page(vma, *page, scan->address);
 				flush_dcache_page(*page);
-				rmap_item = get_next_rmap_item(slot,
-					ksm_scan.rmap_list, ksm_scan.address);
+				rmap_item = get_next_rmap_item(scanner, slot,
+					scan->rmap_list, scan->address);
 				if (rmap_item) {
-					ksm_scan.rmap_list =
+					scan->rmap_list =
 							&rmap_item->rmap_list;
-					ksm_scan.address += PAGE_SIZE;
+					scan->address += PAGE_SIZE;
 				} else
 					put_page(*page);
 				up_read(&mm->mmap_sem);
+				/* The cursor still pins the mm_slot, and so mm */
+				remove_stale_rmap_items(scanner);
 				return rmap_item;
 			}
 			put_page(*page);
-			ksm_scan.address += PAGE_SIZE;
+			scan->address += PAGE_SIZE;
 			cond_resched();
 		}
 	}
 
 	if (ksm_test_exit(mm)) {
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 	/*
 	 * Nuke all the rmap_items that are above this current rmap:
 	 * because there were no VM_MERGEABLE vmas with such addresses.
+	 * Other scanners may find them in the unstable tree until they
+	 * are removed: keep mm around until then.
 	 */
-	remove_trailing_rmap_items(slot, ksm_scan.rmap_list);
+	while (*scan->rmap_list)
+		unlink_rmap_item(scanner, scan->rmap_list);
+	mmgrab(mm);
 
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(slot->mm_list.next,
-						struct mm_slot, mm_list);
-	if (ksm_scan.address == 0) {
+	scan->mm_slot = ksm_next_slot(scanner, slot);
+	if (scan->address == 0) {
 		/*
 		 * We've completed a full scan of all vmas, holding mmap_sem
 		 * throughout, and found no VM_MERGEABLE: so do the same as
@@ -2351,36 +2526,42 @@ next_mm:
 		 * spin_unlock(&ksm_mmlist_lock) run, the "mm" may
 		 * already have been freed under us by __ksm_exit()
 		 * because the "mm_slot" is still hashed and
-		 * ksm_scan.mm_slot doesn't point to it anymore.
+		 * scan->mm_slot doesn't point to it anymore.
 		 */
 		spin_unlock(&ksm_mmlist_lock);
 	}
+	remove_stale_rmap_items(scanner);
+	mmdrop(mm);
 
 	/* Repeat until we've completed scanning the whole list */
-	slot = ksm_scan.mm_slot;
+	slot = scan->mm_slot;
 	if (slot != &ksm_mm_head)
 		goto next_mm;
-
-	ksm_scan.seqnr++;
+done:
+	ksm_scanner_done(scanner);
 	return NULL;
 }
 
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
+ * @scanner:  the scanner thread.
  * @scan_npages:  number of pages we want to scan before we return.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static void ksm_do_scan(struct ksm_scanner *scanner, unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
 
 	while (scan_npages-- && likely(!freezing(current))) {
 		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
+		rmap_item = scan_get_next_rmap_item(scanner, &page);
 		if (!rmap_item)
-			return;
+			break;
+		mutex_lock(&ksm_tree_mutex);
 		cmp_and_merge_page(page, rmap_item);
+		mutex_unlock(&ksm_tree_mutex);
 		put_page(page);
+		atomic_long_inc(&ksm_pages_scanned);
 	}
 }
 
@@ -2389,31 +2570,78 @@ static int ksmd_should_run(void)
 	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
 }
 
-static int ksm_scan_thread(void *nothing)
+/*
+ * Whether @scanner has work: it must be one of the ksm_nr_scanners, and not
+ * be waiting for the others to complete the current full scan.
+ */
+static bool ksm_scanner_should_run(struct ksm_scanner *scanner)
+{
+	return ksmd_should_run() && !(ksm_run & KSM_RUN_OFFLINE) &&
+	       scanner->id < READ_ONCE(ksm_nr_scanners) &&
+	       READ_ONCE(scanner->scan.seqnr) == READ_ONCE(ksm_scan.seqnr);
+}
+
+static int ksm_scan_thread(void *data)
 {
+	struct ksm_scanner *scanner = data;
+
 	set_freezable();
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
-		mutex_lock(&ksm_thread_mutex);
-		wait_while_offlining();
-		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
-		mutex_unlock(&ksm_thread_mutex);
+		down_read(&ksm_thread_sem);
+		if (ksm_scanner_should_run(scanner))
+			ksm_do_scan(scanner, ksm_thread_pages_to_scan);
+		up_read(&ksm_thread_sem);
 
 		try_to_freeze();
 
-		if (ksmd_should_run()) {
+		if (ksm_scanner_should_run(scanner)) {
 			schedule_timeout_interruptible(
 				msecs_to_jiffies(ksm_thread_sleep_millisecs));
 		} else {
 			wait_event_freezable(ksm_thread_wait,
-				ksmd_should_run() || kthread_should_stop());
+				ksm_scanner_should_run(scanner) ||
+				kthread_should_stop());
 		}
 	}
 	return 0;
 }
 
+/* Start scanner thread @id if not running, called under ksm_scanners_mutex */
+static int ksm_start_scanner(unsigned int id)
+{
+	struct ksm_scanner *scanner = &ksm_scanners[id];
+	struct task_struct *task;
+
+	if (scanner->task)
+		return 0;
+
+	if (id)
+		task = kthread_run(ksm_scan_thread, scanner, "ksmd/%u", id);
+	else
+		task = kthread_run(ksm_scan_thread, scanner, "ksmd");
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	sched_set_wrr_weight(task, ksm_scan_weight);
+	scanner->task = task;
+	return 0;
+}
+
+#ifdef CONFIG_SYSFS
+/* Stop the scanner threads from @id on, called under ksm_scanners_mutex */
+static void ksm_stop_scanners(unsigned int id)
+{
+	for (; id < KSM_MAX_SCANNERS; id++) {
+		if (ksm_scanners[id].task) {
+			kthread_stop(ksm_scanners[id].task);
+			ksm_scanners[id].task = NULL;
+		}
+	}
+}
+#endif
+
 int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags)
 {
@@ -2482,9 +2710,10 @@ int __ksm_enter(struct mm_struct *mm)
 
 	spin_lock(&ksm_mmlist_lock);
 	insert_to_mm_slots_hash(mm, mm_slot);
+	mm_slot->owner = ksm_next_owner++;
 	/*
 	 * When KSM_RUN_MERGE (or KSM_RUN_STOP),
-	 * insert just behind the scanning cursor, to let the area settle
+	 * insert just behind its scanner's cursor, to let the area settle
 	 * down a little; when fork is followed by immediate exec, we don't
 	 * want ksmd to waste time setting up and tearing down an rmap_list.
 	 *
@@ -2495,7 +2724,7 @@ int __ksm_enter(struct mm_struct *mm)
 	if (ksm_run & KSM_RUN_UNMERGE)
 		list_add_tail(&mm_slot->mm_list, &ksm_mm_head.mm_list);
 	else
-		list_add_tail(&mm_slot->mm_list, &ksm_scan.mm_slot->mm_list);
+		list_add_tail(&mm_slot->mm_list, &ksm_cursor(mm_slot)->mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
 	set_bit(MMF_VM_MERGEABLE, &mm->flags);
@@ -2523,14 +2752,15 @@ void __ksm_exit(struct mm_struct *mm)
 
 	spin_lock(&ksm_mmlist_lock);
 	mm_slot = get_mm_slot(mm);
-	if (mm_slot && ksm_scan.mm_slot != mm_slot) {
+	if (mm_slot && ksm_scan.mm_slot != mm_slot &&
+	    mm_slot_scanner(mm_slot)->scan.mm_slot != mm_slot) {
 		if (!mm_slot->rmap_list) {
 			hash_del(&mm_slot->link);
 			list_del(&mm_slot->mm_list);
 			easy_to_free = 1;
 		} else {
 			list_move(&mm_slot->mm_list,
-				  &ksm_scan.mm_slot->mm_list);
+				  &ksm_cursor(mm_slot)->mm_list);
 		}
 	}
 	spin_unlock(&ksm_mmlist_lock);
@@ -2669,10 +2899,10 @@ void ksm_migrate_page(struct page *newpage, struct page *oldpage)
 static void wait_while_offlining(void)
 {
 	while (ksm_run & KSM_RUN_OFFLINE) {
-		mutex_unlock(&ksm_thread_mutex);
+		up_write(&ksm_thread_sem);
 		wait_on_bit(&ksm_run, ilog2(KSM_RUN_OFFLINE),
 			    TASK_UNINTERRUPTIBLE);
-		mutex_lock(&ksm_thread_mutex);
+		down_write(&ksm_thread_sem);
 	}
 }
 
@@ -2759,11 +2989,11 @@ static int ksm_memory_callback(struct notifier_block *self,
 		 * and remove_all_stable_nodes() while memory is going offline:
 		 * it is unsafe for them to touch the stable tree at this time.
 		 * But unmerge_ksm_pages(), rmap lookups and other entry points
-		 * which do not need the ksm_thread_mutex are all safe.
+		 * which do not need the ksm_thread_sem are all safe.
 		 */
-		mutex_lock(&ksm_thread_mutex);
+		down_write(&ksm_thread_sem);
 		ksm_run |= KSM_RUN_OFFLINE;
-		mutex_unlock(&ksm_thread_mutex);
+		up_write(&ksm_thread_sem);
 		break;
 
 	case MEM_OFFLINE:
@@ -2779,12 +3009,13 @@ static int ksm_memory_callback(struct notifier_block *self,
 		/* fallthrough */
 
 	case MEM_CANCEL_OFFLINE:
-		mutex_lock(&ksm_thread_mutex);
+		down_write(&ksm_thread_sem);
 		ksm_run &= ~KSM_RUN_OFFLINE;
-		mutex_unlock(&ksm_thread_mutex);
+		up_write(&ksm_thread_sem);
 
 		smp_mb();	/* wake_up_bit advises this */
 		wake_up_bit(&ksm_run, ilog2(KSM_RUN_OFFLINE));
+		wake_up_interruptible(&ksm_thread_wait);
 		break;
 	}
 	return NOTIFY_OK;
@@ -2877,7 +3108,7 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 	 * on the list for when ksmd may be set running again).
 	 */
 
-	mutex_lock(&ksm_thread_mutex);
+	down_write(&ksm_thread_sem);
 	wait_while_offlining();
 	if (ksm_run != flags) {
 		ksm_run = flags;
@@ -2891,7 +3122,7 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 			}
 		}
 	}
-	mutex_unlock(&ksm_thread_mutex);
+	up_write(&ksm_thread_sem);
 
 	if (flags & KSM_RUN_MERGE)
 		wake_up_interruptible(&ksm_thread_wait);
@@ -2920,7 +3151,7 @@ static ssize_t merge_across_nodes_store(struct kobject *kobj,
 	if (knob > 1)
 		return -EINVAL;
 
-	mutex_lock(&ksm_thread_mutex);
+	down_write(&ksm_thread_sem);
 	wait_while_offlining();
 	if (ksm_merge_across_nodes != knob) {
 		if (ksm_pages_shared || remove_all_stable_nodes())
@@ -2951,7 +3182,7 @@ static ssize_t merge_across_nodes_store(struct kobject *kobj,
 			ksm_nr_node_ids = knob ? 1 : nr_node_ids;
 		}
 	}
-	mutex_unlock(&ksm_thread_mutex);
+	up_write(&ksm_thread_sem);
 
 	return err ? err : count;
 }
@@ -3007,7 +3238,7 @@ static ssize_t max_page_sharing_store(struct kobject *kobj,
 	if (READ_ONCE(ksm_max_page_sharing) == knob)
 		return count;
 
-	mutex_lock(&ksm_thread_mutex);
+	down_write(&ksm_thread_sem);
 	wait_while_offlining();
 	if (ksm_max_page_sharing != knob) {
 		if (ksm_pages_shared || remove_all_stable_nodes())
@@ -3015,7 +3246,7 @@ static ssize_t max_page_sharing_store(struct kobject *kobj,
 		else
 			ksm_max_page_sharing = knob;
 	}
-	mutex_unlock(&ksm_thread_mutex);
+	up_write(&ksm_thread_sem);
 
 	return err ? err : count;
 }
@@ -3047,7 +3278,7 @@ static ssize_t pages_volatile_show(struct kobject *kobj,
 {
 	long ksm_pages_volatile;
 
-	ksm_pages_volatile = ksm_rmap_items - ksm_pages_shared
+	ksm_pages_volatile = atomic_long_read(&ksm_rmap_items) - ksm_pages_shared
 				- ksm_pages_sharing - ksm_pages_unshared;
 	/*
 	 * It was not worth any locking to calculate that statistic,
@@ -3106,6 +3337,105 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t scan_threads_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_nr_scanners);
+}
+
+static ssize_t scan_threads_store(struct kobject *kobj,
+				  struct kobj_attribute *attr,
+				  const char *buf, size_t count)
+{
+	unsigned int nr, id;
+	int err;
+
+	err = kstrtouint(buf, 10, &nr);
+	if (err || !nr || nr > KSM_MAX_SCANNERS)
+		return -EINVAL;
+
+	mutex_lock(&ksm_scanners_mutex);
+	for (id = 0; id < nr && !err; id++)
+		err = ksm_start_scanner(id);
+	if (!err) {
+		down_write(&ksm_thread_sem);
+		wait_while_offlining();
+		ksm_reset_scanners(nr);
+		up_write(&ksm_thread_sem);
+		wake_up_interruptible(&ksm_thread_wait);
+	}
+	ksm_stop_scanners(ksm_nr_scanners);
+	mutex_unlock(&ksm_scanners_mutex);
+
+	return err ? err : count;
+}
+KSM_ATTR(scan_threads);
+
+static ssize_t scan_weight_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_scan_weight);
+}
+
+static ssize_t scan_weight_store(struct kobject *kobj,
+				 struct kobj_attribute *attr,
+				 const char *buf, size_t count)
+{
+	unsigned int weight;
+	int err, id;
+
+	err = kstrtouint(buf, 10, &weight);
+	if (err || weight < WRR_MIN_WEIGHT || weight > WRR_MAX_WEIGHT)
+		return -EINVAL;
+
+	mutex_lock(&ksm_scanners_mutex);
+	ksm_scan_weight = weight;
+	for (id = 0; id < KSM_MAX_SCANNERS; id++)
+		if (ksm_scanners[id].task)
+			sched_set_wrr_weight(ksm_scanners[id].task, weight);
+	mutex_unlock(&ksm_scanners_mutex);
+
+	return count;
+}
+KSM_ATTR(scan_weight);
+
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", atomic_long_read(&ksm_pages_scanned));
+}
+KSM_ATTR_RO(pages_scanned);
+
+/* Pages scanned per second between two reads at least a second apart */
+static unsigned long ksm_scan_rate;
+static unsigned long ksm_scan_rate_pages;
+static unsigned long ksm_scan_rate_stamp;
+static DEFINE_SPINLOCK(ksm_scan_rate_lock);
+
+static ssize_t scan_rate_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	unsigned long now = jiffies;
+	unsigned long pages = atomic_long_read(&ksm_pages_scanned);
+	unsigned long rate;
+
+	spin_lock(&ksm_scan_rate_lock);
+	if (!ksm_scan_rate_stamp) {
+		ksm_scan_rate_pages = pages;
+		ksm_scan_rate_stamp = now;
+	} else if (time_after_eq(now, ksm_scan_rate_stamp + HZ)) {
+		ksm_scan_rate = (pages - ksm_scan_rate_pages) * HZ /
+				(now - ksm_scan_rate_stamp);
+		ksm_scan_rate_pages = pages;
+		ksm_scan_rate_stamp = now;
+	}
+	rate = ksm_scan_rate;
+	spin_unlock(&ksm_scan_rate_lock);
+
+	return sprintf(buf, "%lu\n", rate);
+}
+KSM_ATTR_RO(scan_rate);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -3115,6 +3445,10 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&scan_threads_attr.attr,
+	&scan_weight_attr.attr,
+	&pages_scanned_attr.attr,
+	&scan_rate_attr.attr,
 #ifdef CONFIG_NUMA
 	&merge_across_nodes_attr.attr,
 #endif
@@ -3134,8 +3468,7 @@ static const struct attribute_group ksm_attr_group = {
 
 static int __init ksm_init(void)
 {
-	struct task_struct *ksm_thread;
-	int err;
+	int err, id;
 
 	/* The correct value depends on page size and endianness */
 	zero_checksum = calc_checksum(ZERO_PAGE(0));
@@ -3146,10 +3479,14 @@ static int __init ksm_init(void)
 	if (err)
 		goto out;
 
-	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
-	if (IS_ERR(ksm_thread)) {
+	for (id = 0; id < KSM_MAX_SCANNERS; id++)
+		ksm_scanners[id].id = id;
+
+	mutex_lock(&ksm_scanners_mutex);
+	err = ksm_start_scanner(0);
+	mutex_unlock(&ksm_scanners_mutex);
+	if (err) {
 		pr_err("ksm: creating kthread failed\n");
-		err = PTR_ERR(ksm_thread);
 		goto out_free;
 	}
 
@@ -3157,7 +3494,9 @@ static int __init ksm_init(void)
 	err = sysfs_create_group(mm_kobj, &ksm_attr_group);
 	if (err) {
 		pr_err("ksm: register sysfs failed\n");
-		kthread_stop(ksm_thread);
+		mutex_lock(&ksm_scanners_mutex);
+		ksm_stop_scanners(0);
+		mutex_unlock(&ksm_scanners_mutex);
 		goto out_free;
 	}
 #else
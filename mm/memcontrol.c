@@ -1944,9 +1944,28 @@ void unlock_page_memcg(struct page *page)
 }
 EXPORT_SYMBOL(unlock_page_memcg);
 
-struct memcg_stock_pcp {
+/*
+ * Each CPU stocks precharged pages for up to MEMCG_STOCK_SLOTS memcgs, so
+ * that tasks of several cgroups sharing a CPU don't evict each other's
+ * stock on every charge.  A slot that runs dry within MEMCG_STOCK_FAST of
+ * running dry before doubles its batch, up to MEMCG_STOCK_MAX_BATCH, and
+ * one that takes longer than MEMCG_STOCK_SLOW halves it again.
+ */
+#define MEMCG_STOCK_SLOTS	4
+#define MEMCG_STOCK_MAX_BATCH	(MEMCG_CHARGE_BATCH * 4)
+#define MEMCG_STOCK_FAST	max(HZ / 100, 1)
+#define MEMCG_STOCK_SLOW	HZ
+
+struct memcg_stock_slot {
 	struct mem_cgroup *cached; /* this never be root cgroup */
 	unsigned int nr_pages;
+	unsigned int batch;	/* pages to precharge for the next refill */
+	unsigned long dry;	/* jiffies when nr_pages last ran out */
+};
+
+struct memcg_stock_pcp {
+	struct memcg_stock_slot slots[MEMCG_STOCK_SLOTS];
+	unsigned int victim;	/* next slot to evict, round robin */
 	struct work_struct work;
 	unsigned long flags;
 #define FLUSHING_CACHED_CHARGE	0
@@ -1954,54 +1973,106 @@ struct memcg_stock_pcp {
 static DEFINE_PER_CPU(struct memcg_stock_pcp, memcg_stock);
 static DEFINE_MUTEX(percpu_charge_mutex);
 
+static struct memcg_stock_slot *stock_lookup(struct memcg_stock_pcp *stock,
+					     struct mem_cgroup *memcg)
+{
+	int i;
+
+	for (i = 0; i < MEMCG_STOCK_SLOTS; i++)
+		if (stock->slots[i].cached == memcg)
+			return &stock->slots[i];
+	return NULL;
+}
+
 /**
  * consume_stock: Try to consume stocked charge on this cpu.
  * @memcg: memcg to consume from.
  * @nr_pages: how many pages to charge.
  *
- * The charges will only happen if @memcg matches the current cpu's memcg
- * stock, and at least @nr_pages are available in that stock.  Failure to
- * service an allocation will refill the stock.
+ * The charges will only happen if @memcg has a slot in the current cpu's
+ * memcg stock, and at least @nr_pages are available in that slot.  Failure
+ * to service an allocation will refill the stock.
  *
  * returns true if successful, false otherwise.
  */
 static bool consume_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 {
 	struct memcg_stock_pcp *stock;
+	struct memcg_stock_slot *slot;
 	unsigned long flags;
 	bool ret = false;
 
-	if (nr_pages > MEMCG_CHARGE_BATCH)
+	if (nr_pages > MEMCG_STOCK_MAX_BATCH)
 		return ret;
 
 	local_irq_save(flags);
 
 	stock = this_cpu_ptr(&memcg_stock);
-	if (memcg == stock->cached && stock->nr_pages >= nr_pages) {
-		stock->nr_pages -= nr_pages;
+	slot = stock_lookup(stock, memcg);
+	if (slot && slot->nr_pages >= nr_pages) {
+		slot->nr_pages -= nr_pages;
 		ret = true;
+	} else if (slot) {
+		/* Ran dry, size the next refill by how fast that happened */
+		if (time_before(jiffies, slot->dry + MEMCG_STOCK_FAST))
+			slot->batch = min(slot->batch * 2, MEMCG_STOCK_MAX_BATCH);
+		else if (time_after(jiffies, slot->dry + MEMCG_STOCK_SLOW))
+			slot->batch = max(slot->batch / 2, MEMCG_CHARGE_BATCH);
+		slot->dry = jiffies;
 	}
 
+	__count_vm_event(ret ? MEMCG_STOCK_HIT : MEMCG_STOCK_MISS);
+	__count_memcg_events(memcg, ret ? MEMCG_STOCK_HIT : MEMCG_STOCK_MISS, 1);
+
 	local_irq_restore(flags);
 
 	return ret;
 }
 
+/*
+ * The number of pages to precharge when @memcg misses the stock.
+ */
+static unsigned int stock_batch(struct mem_cgroup *memcg)
+{
+	struct memcg_stock_slot *slot;
+	unsigned int batch = MEMCG_CHARGE_BATCH;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	slot = stock_lookup(this_cpu_ptr(&memcg_stock), memcg);
+	if (slot)
+		batch = slot->batch;
+	local_irq_restore(flags);
+
+	return batch;
+}
+
+static void stock_uncharge(struct mem_cgroup *memcg, unsigned int nr_pages)
+{
+	page_counter_uncharge(&memcg->memory, nr_pages);
+	if (do_memsw_account())
+		page_counter_uncharge(&memcg->memsw, nr_pages);
+	css_put_many(&memcg->css, nr_pages);
+}
+
+static void drain_stock_slot(struct memcg_stock_slot *slot)
+{
+	if (slot->nr_pages) {
+		stock_uncharge(slot->cached, slot->nr_pages);
+		slot->nr_pages = 0;
+	}
+	slot->cached = NULL;
+}
+
 /*
  * Returns stocks cached in percpu and reset cached information.
  */
 static void drain_stock(struct memcg_stock_pcp *stock)
 {
-	struct mem_cgroup *old = stock->cached;
+	int i;
 
-	if (stock->nr_pages) {
-		page_counter_uncharge(&old->memory, stock->nr_pages);
-		if (do_memsw_account())
-			page_counter_uncharge(&old->memsw, stock->nr_pages);
-		css_put_many(&old->css, stock->nr_pages);
-		stock->nr_pages = 0;
-	}
-	stock->cached = NULL;
+	for (i = 0; i < MEMCG_STOCK_SLOTS; i++)
+		drain_stock_slot(&stock->slots[i]);
 }
 
 static void drain_local_stock(struct work_struct *dummy)
@@ -2029,19 +2100,31 @@ static void drain_local_stock(struct work_struct *dummy)
 static void refill_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 {
 	struct memcg_stock_pcp *stock;
+	struct memcg_stock_slot *slot;
 	unsigned long flags;
 
 	local_irq_save(flags);
 
 	stock = this_cpu_ptr(&memcg_stock);
-	if (stock->cached != memcg) { /* reset if necessary */
-		drain_stock(stock);
-		stock->cached = memcg;
+	slot = stock_lookup(stock, memcg);
+	if (!slot) { /* take a free slot, or evict one */
+		slot = stock_lookup(stock, NULL);
+		if (!slot) {
+			slot = &stock->slots[stock->victim];
+			stock->victim = (stock->victim + 1) % MEMCG_STOCK_SLOTS;
+			drain_stock_slot(slot);
+		}
+		slot->cached = memcg;
+		slot->batch = MEMCG_CHARGE_BATCH;
+		slot->dry = jiffies;
 	}
-	stock->nr_pages += nr_pages;
+	slot->nr_pages += nr_pages;
 
-	if (stock->nr_pages > MEMCG_CHARGE_BATCH)
-		drain_stock(stock);
+	/* Give back what's beyond the batch, but keep the slot and its size */
+	if (slot->nr_pages > slot->batch) {
+		stock_uncharge(memcg, slot->nr_pages - slot->batch);
+		slot->nr_pages = slot->batch;
+	}
 
 	local_irq_restore(flags);
 }
@@ -2067,21 +2150,26 @@ static void drain_all_stock(struct mem_cgroup *root_memcg)
 	for_each_online_cpu(cpu) {
 		struct memcg_stock_pcp *stock = &per_cpu(memcg_stock, cpu);
 		struct mem_cgroup *memcg;
+		bool flush = false;
+		int i;
 
-		memcg = stock->cached;
-		if (!memcg || !stock->nr_pages || !css_tryget(&memcg->css))
-			continue;
-		if (!mem_cgroup_is_descendant(memcg, root_memcg)) {
+		for (i = 0; i < MEMCG_STOCK_SLOTS && !flush; i++) {
+			struct memcg_stock_slot *slot = &stock->slots[i];
+
+			memcg = READ_ONCE(slot->cached);
+			if (!memcg || !READ_ONCE(slot->nr_pages) ||
+			    !css_tryget(&memcg->css))
+				continue;
+			flush = mem_cgroup_is_descendant(memcg, root_memcg);
 			css_put(&memcg->css);
-			continue;
 		}
-		if (!test_and_set_bit(FLUSHING_CACHED_CHARGE, &stock->flags)) {
+		if (flush &&
+		    !test_and_set_bit(FLUSHING_CACHED_CHARGE, &stock->flags)) {
 			if (cpu == curcpu)
 				drain_local_stock(&stock->work);
 			else
 				schedule_work_on(cpu, &stock->work);
 		}
-		css_put(&memcg->css);
 	}
 	put_cpu();
 	mutex_unlock(&percpu_charge_mutex);
@@ -2172,7 +2260,7 @@ void mem_cgroup_handle_over_high(void)
 static int try_charge(struct mem_cgroup *memcg, gfp_t gfp_mask,
 		      unsigned int nr_pages)
 {
-	unsigned int batch = max(MEMCG_CHARGE_BATCH, nr_pages);
+	unsigned int batch = 0;
 	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
 	struct mem_cgroup *mem_over_limit;
 	struct page_counter *counter;
@@ -2188,6 +2276,9 @@ retry:
 	if (consume_stock(memcg, nr_pages))
 		return 0;
 
+	if (!batch)
+		batch = max(stock_batch(memcg), nr_pages);
+
 	if (!do_memsw_account() ||
 	    page_counter_try_charge(&memcg->memsw, batch, &counter)) {
 		if (page_counter_try_charge(&memcg->memory, batch, &counter))
@@ -5645,6 +5736,8 @@ static int memory_stat_show(struct seq_file *m, void *v)
 	seq_printf(m, "pgdeactivate %lu\n", acc.events[PGDEACTIVATE]);
 	seq_printf(m, "pglazyfree %lu\n", acc.events[PGLAZYFREE]);
 	seq_printf(m, "pglazyfreed %lu\n", acc.events[PGLAZYFREED]);
+	seq_printf(m, "stock_hit %lu\n", acc.events[MEMCG_STOCK_HIT]);
+	seq_printf(m, "stock_miss %lu\n", acc.events[MEMCG_STOCK_MISS]);
 
 	seq_printf(m, "workingset_refault %lu\n",
 		   acc.stat[WORKINGSET_REFAULT]);
@@ -1094,6 +1094,20 @@ static inline void prefetch_buddy(struct page *page)
 	prefetch(buddy);
 }
 
+/*
+ * The high watermark and batch size of a pcp, scaled by pcp_adapt().
+ * pageset_update() may change the base values concurrently.
+ */
+static inline int pcp_high(struct per_cpu_pages *pcp)
+{
+	return READ_ONCE(pcp->high) << pcp->scale;
+}
+
+static inline int pcp_batch(struct per_cpu_pages *pcp)
+{
+	return READ_ONCE(pcp->batch) << pcp->scale;
+}
+
 /*
  * Frees a number of pages from the PCP lists
  * Assumes all pages on list are in same zone, and of same order.
@@ -1161,6 +1175,7 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 		} while (--count && --batch_free && !list_empty(list));
 	}
 
+	pcp->nr_zone_lock++;
 	spin_lock(&zone->lock);
 	isolated_pageblocks = has_isolate_pageblock(zone);
 
@@ -2538,7 +2553,7 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 	int to_drain, batch;
 
 	local_irq_save(flags);
-	batch = READ_ONCE(pcp->batch);
+	batch = pcp_batch(pcp);
 	to_drain = min(pcp->count, batch);
 	if (to_drain > 0)
 		free_pcppages_bulk(zone, to_drain, pcp);
@@ -2546,6 +2561,49 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 }
 #endif
 
+/*
+ * Adaptive pcp sizing.  A pcp whose lists are drained to or refilled from
+ * the buddy allocator PCP_ADAPT_GROW times within a vmstat interval gets
+ * its high watermark and batch doubled, up to PCP_ADAPT_MAX_SCALE times,
+ * so that bursts of allocations and frees take zone->lock less often.
+ * They are halved again after an interval with fewer than
+ * PCP_ADAPT_SHRINK round trips, or when percpu_pagelist_fraction is set,
+ * and the pages above the new high watermark go back to the zone.
+ */
+#define PCP_ADAPT_GROW		64
+#define PCP_ADAPT_SHRINK	4
+#define PCP_ADAPT_MAX_SCALE	2
+
+/*
+ * Called from the vmstat counter updater on the processor owning @pcp.
+ * Returns true while @pcp is scaled up, so that the updater keeps coming
+ * back to shrink it.
+ */
+bool pcp_adapt(struct zone *zone, struct per_cpu_pages *pcp)
+{
+	unsigned long flags;
+	bool scaled;
+
+	local_irq_save(flags);
+	if (pcp->nr_bulk >= PCP_ADAPT_GROW && !percpu_pagelist_fraction &&
+	    pcp->scale < PCP_ADAPT_MAX_SCALE) {
+		pcp->scale++;
+	} else if (pcp->scale && (pcp->nr_bulk < PCP_ADAPT_SHRINK ||
+				  percpu_pagelist_fraction)) {
+		int high;
+
+		pcp->scale--;
+		high = pcp_high(pcp);
+		if (pcp->count > high)
+			free_pcppages_bulk(zone, pcp->count - high, pcp);
+	}
+	pcp->nr_bulk = 0;
+	scaled = pcp->scale;
+	local_irq_restore(flags);
+
+	return scaled;
+}
+
 /*
  * Drain pcplists of the indicated processor and zone.
  *
@@ -2785,8 +2843,10 @@ static void free_unref_page_commit(struct page *page, unsigned long pfn)
 	pcp = &this_cpu_ptr(zone->pageset)->pcp;
 	list_add(&page->lru, &pcp->lists[migratetype]);
 	pcp->count++;
-	if (pcp->count >= pcp->high) {
-		unsigned long batch = READ_ONCE(pcp->batch);
+	if (pcp->count >= pcp_high(pcp)) {
+		unsigned long batch = pcp_batch(pcp);
+
+		pcp->nr_bulk++;
 		free_pcppages_bulk(zone, batch, pcp);
 	}
 }
@@ -2951,8 +3011,11 @@ static struct page *__rmqueue_pcplist(struct zone *zone, int migratetype,
 
 	do {
 		if (list_empty(list)) {
+			pcp->nr_bulk++;
+			pcp->nr_refill++;
+			pcp->nr_zone_lock++;
 			pcp->count += rmqueue_bulk(zone, 0,
-					pcp->batch, list,
+					pcp_batch(pcp), list,
 					migratetype);
 			if (unlikely(list_empty(list)))
 				return NULL;
@@ -6242,6 +6305,7 @@ static void __meminit pgdat_init_internals(struct pglist_data *pgdat)
 	pgdat_init_kcompactd(pgdat);
 
 	init_waitqueue_head(&pgdat->kswapd_wait);
+	init_waitqueue_head(&pgdat->kswapd_helper_wait);
 	init_waitqueue_head(&pgdat->pfmemalloc_wait);
 
 	pgdat_page_ext_init(pgdat);
@@ -22,7 +22,7 @@
 #include <linux/kallsyms.h>
 #include <linux/list.h>
 #include <linux/notifier.h>
-#include <linux/rbtree.h>
+#include <linux/rbtree_augmented.h>
 #include <linux/radix-tree.h>
 #include <linux/rcupdate.h>
 #include <linux/pfn.h>
@@ -33,6 +33,8 @@
 #include <linux/bitops.h>
 
 #include <linux/uaccess.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
 #include <asm/tlbflush.h>
 #include <asm/shmparam.h>
 
@@ -332,12 +334,6 @@ LIST_HEAD(vmap_area_list);
 static LLIST_HEAD(vmap_purge_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
-
 static unsigned long vmap_area_pcpu_hole;
 
 static struct vmap_area *__find_vmap_area(unsigned long addr)
@@ -359,6 +355,53 @@ static struct vmap_area *__find_vmap_area(unsigned long addr)
 	return NULL;
 }
 
+/*
+ * Each vmap_area notes the largest free gap that precedes an area of its
+ * subtree, so that alloc_vmap_area() finds the lowest fitting hole in
+ * O(log n), the same way unmapped_area() does for VMAs.
+ */
+static unsigned long vmap_area_gap(struct vmap_area *va)
+{
+	struct vmap_area *prev;
+
+	if (va->list.prev == &vmap_area_list)
+		return va->va_start;
+
+	prev = list_prev_entry(va, list);
+	return va->va_start - prev->va_end;
+}
+
+static unsigned long vmap_area_compute_subtree_gap(struct vmap_area *va)
+{
+	unsigned long max = vmap_area_gap(va), subtree_gap;
+
+	if (va->rb_node.rb_left) {
+		subtree_gap = rb_entry(va->rb_node.rb_left,
+				struct vmap_area, rb_node)->subtree_gap;
+		if (subtree_gap > max)
+			max = subtree_gap;
+	}
+	if (va->rb_node.rb_right) {
+		subtree_gap = rb_entry(va->rb_node.rb_right,
+				struct vmap_area, rb_node)->subtree_gap;
+		if (subtree_gap > max)
+			max = subtree_gap;
+	}
+	return max;
+}
+
+RB_DECLARE_CALLBACKS(static, vmap_area_gap_callbacks, struct vmap_area, rb_node,
+		     unsigned long, subtree_gap, vmap_area_compute_subtree_gap)
+
+/*
+ * Update the subtree gaps after va->va_start or the end of the area
+ * before it changed.
+ */
+static void vmap_area_gap_update(struct vmap_area *va)
+{
+	vmap_area_gap_callbacks_propagate(&va->rb_node, NULL);
+}
+
 static void __insert_vmap_area(struct vmap_area *va)
 {
 	struct rb_node **p = &vmap_area_root.rb_node;
@@ -379,7 +422,7 @@ static void __insert_vmap_area(struct vmap_area *va)
 	}
 
 	rb_link_node(&va->rb_node, parent, p);
-	rb_insert_color(&va->rb_node, &vmap_area_root);
+	va->subtree_gap = 0;
 
 	/* address-sort this list */
 	tmp = rb_prev(&va->rb_node);
@@ -389,12 +432,151 @@ static void __insert_vmap_area(struct vmap_area *va)
 		list_add_rcu(&va->list, &prev->list);
 	} else
 		list_add_rcu(&va->list, &vmap_area_list);
+
+	/* The gap following the new area shrank */
+	if (!list_is_last(&va->list, &vmap_area_list))
+		vmap_area_gap_update(list_next_entry(va, list));
+
+	vmap_area_gap_update(va);
+	rb_insert_augmented(&va->rb_node, &vmap_area_root,
+			    &vmap_area_gap_callbacks);
+}
+
+/*
+ * The aligned start of a size bytes area in the hole [gap_start, gap_end)
+ * clipped to [vstart, vend), or 0 if it doesn't fit.
+ */
+static unsigned long vmap_hole_addr(unsigned long gap_start, unsigned long gap_end,
+				    unsigned long size, unsigned long align,
+				    unsigned long vstart, unsigned long vend)
+{
+	unsigned long addr;
+
+	addr = ALIGN(max(gap_start, vstart), align);
+	if (!addr || addr + size < addr)
+		return 0;
+	if (addr + size > min(gap_end, vend))
+		return 0;
+	return addr;
+}
+
+/*
+ * Find the lowest address in [vstart, vend) with room for size bytes
+ * aligned to align. Like unmapped_area(), this looks for an area that
+ * immediately follows a suitable gap, skipping the subtrees whose
+ * largest gap is smaller than size. Unlike it, the alignment is checked
+ * on each candidate gap rather than padded into the size, so a hole that
+ * only fits at its exact alignment is still found.
+ */
+static unsigned long __find_vmap_hole(unsigned long size, unsigned long align,
+				      unsigned long vstart, unsigned long vend)
+{
+	struct vmap_area *va;
+	unsigned long low_limit, high_limit, gap_start, gap_end, addr;
+
+	/* Areas and holes are page aligned, callers may ask for align 1 */
+	align = max(align, PAGE_SIZE);
+
+	if (vend < size)
+		return 0;
+	high_limit = vend - size;
+
+	if (vstart > high_limit)
+		return 0;
+	low_limit = vstart + size;
+
+	if (RB_EMPTY_ROOT(&vmap_area_root))
+		goto check_highest;
+	va = rb_entry(vmap_area_root.rb_node, struct vmap_area, rb_node);
+	if (va->subtree_gap < size)
+		goto check_highest;
+
+	while (true) {
+		/* Visit left subtree if it looks promising */
+		gap_end = va->va_start;
+		if (gap_end >= low_limit && va->rb_node.rb_left) {
+			struct vmap_area *left =
+				rb_entry(va->rb_node.rb_left,
+					 struct vmap_area, rb_node);
+			if (left->subtree_gap >= size) {
+				va = left;
+				continue;
+			}
+		}
+
+		gap_start = va->va_start - vmap_area_gap(va);
+check_current:
+		/* Check if current node has a suitable gap */
+		if (gap_start > high_limit)
+			return 0;
+		if (gap_end >= low_limit &&
+		    gap_end > gap_start && gap_end - gap_start >= size) {
+			addr = vmap_hole_addr(gap_start, gap_end, size, align,
+					      vstart, vend);
+			if (addr)
+				return addr;
+		}
+
+		/* Visit right subtree if it looks promising */
+		if (va->rb_node.rb_right) {
+			struct vmap_area *right =
+				rb_entry(va->rb_node.rb_right,
+					 struct vmap_area, rb_node);
+			if (right->subtree_gap >= size) {
+				va = right;
+				continue;
+			}
+		}
+
+		/* Go back up the rbtree to find next candidate node */
+		while (true) {
+			struct rb_node *prev = &va->rb_node;
+			if (!rb_parent(prev))
+				goto check_highest;
+			va = rb_entry(rb_parent(prev), struct vmap_area, rb_node);
+			if (prev == va->rb_node.rb_left) {
+				gap_start = va->va_start - vmap_area_gap(va);
+				gap_end = va->va_start;
+				goto check_current;
+			}
+		}
+	}
+
+check_highest:
+	/* Check highest gap, which does not precede any area */
+	gap_start = list_empty(&vmap_area_list) ? 0 :
+		list_last_entry(&vmap_area_list, struct vmap_area, list)->va_end;
+	if (gap_start > high_limit)
+		return 0;
+
+	return vmap_hole_addr(gap_start, ULONG_MAX, size, align, vstart, vend);
 }
 
 static void purge_vmap_area_lazy(void);
 
 static BLOCKING_NOTIFIER_HEAD(vmap_notify_list);
 
+/*
+ * log2 histograms of how long alloc_vmap_area() and lazy purges take:
+ * bucket 0 counts those under 1us, bucket i those under 2^i us.
+ */
+#define VMAP_LAT_BUCKETS	16
+
+struct vmap_lat_hist {
+	unsigned long buckets[VMAP_LAT_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct vmap_lat_hist, vmap_alloc_lat);
+static DEFINE_PER_CPU(struct vmap_lat_hist, vmap_purge_lat);
+
+static void vmap_lat_account(struct vmap_lat_hist __percpu *hist, u64 start)
+{
+	u64 us = div_u64(ktime_get_ns() - start, NSEC_PER_USEC);
+	int bucket = min_t(int, fls64(us), VMAP_LAT_BUCKETS - 1);
+
+	this_cpu_inc(hist->buckets[bucket]);
+}
+
 /*
  * Allocate a region of KVA of the specified size and alignment, within the
  * vstart and vend.
@@ -405,16 +587,16 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				int node, gfp_t gfp_mask)
 {
 	struct vmap_area *va;
-	struct rb_node *n;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
+	u64 start;
 
 	BUG_ON(!size);
 	BUG_ON(offset_in_page(size));
 	BUG_ON(!is_power_of_2(align));
 
 	might_sleep();
+	start = ktime_get_ns();
 
 	va = kmalloc_node(sizeof(struct vmap_area),
 			gfp_mask & GFP_RECLAIM_MASK, node);
@@ -429,93 +611,25 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 
 retry:
 	spin_lock(&vmap_area_lock);
-	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
-	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size < addr)
-			goto overflow;
-
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
-	}
-
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		if (list_is_last(&first->list, &vmap_area_list))
-			goto found;
-
-		first = list_next_entry(first, list);
-	}
-
-found:
+	addr = __find_vmap_hole(size, align, vstart, vend);
 	/*
 	 * Check also calculated address against the vstart,
 	 * because it can be 0 because of big align request.
 	 */
-	if (addr + size > vend || addr < vstart)
+	if (!addr || addr + size > vend || addr < vstart)
 		goto overflow;
 
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
 	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(!IS_ALIGNED(va->va_start, align));
 	BUG_ON(va->va_start < vstart);
 	BUG_ON(va->va_end > vend);
 
+	vmap_lat_account(&vmap_alloc_lat, start);
 	return va;
 
 overflow:
@@ -556,27 +670,22 @@ EXPORT_SYMBOL_GPL(unregister_vmap_purge_notifier);
 
 static void __free_vmap_area(struct vmap_area *va)
 {
+	struct vmap_area *next = NULL;
+
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
-	rb_erase(&va->rb_node, &vmap_area_root);
+	if (!list_is_last(&va->list, &vmap_area_list))
+		next = list_next_entry(va, list);
+
+	rb_erase_augmented(&va->rb_node, &vmap_area_root,
+			   &vmap_area_gap_callbacks);
 	RB_CLEAR_NODE(&va->rb_node);
 	list_del_rcu(&va->list);
 
+	/* The gap following the area grew */
+	if (next)
+		vmap_area_gap_update(next);
+
 	/*
 	 * Track the highest possible candidate for pcpu area
 	 * allocation.  Areas outside of vmalloc area can be returned
@@ -662,6 +771,7 @@ static bool __purge_vmap_area_lazy(unsigned long start, unsigned long end)
 	struct vmap_area *va;
 	struct vmap_area *n_va;
 	bool do_free = false;
+	u64 time = ktime_get_ns();
 
 	lockdep_assert_held(&vmap_purge_lock);
 
@@ -688,32 +798,36 @@ static bool __purge_vmap_area_lazy(unsigned long start, unsigned long end)
 		cond_resched_lock(&vmap_area_lock);
 	}
 	spin_unlock(&vmap_area_lock);
+
+	vmap_lat_account(&vmap_purge_lat, time);
 	return true;
 }
 
 /*
- * Kick off a purge of the outstanding lazy areas. Don't bother if somebody
- * is already purging.
+ * Kick off a purge of the outstanding lazy areas.
  */
-static void try_purge_vmap_area_lazy(void)
+static void purge_vmap_area_lazy(void)
 {
-	if (mutex_trylock(&vmap_purge_lock)) {
-		__purge_vmap_area_lazy(ULONG_MAX, 0);
-		mutex_unlock(&vmap_purge_lock);
-	}
+	mutex_lock(&vmap_purge_lock);
+	purge_fragmented_blocks_allcpus();
+	__purge_vmap_area_lazy(ULONG_MAX, 0);
+	mutex_unlock(&vmap_purge_lock);
 }
 
 /*
- * Kick off a purge of the outstanding lazy areas.
+ * Purge the lazy areas once there are too many of them, in the
+ * background so that vfree() and vunmap() callers don't stall on the
+ * TLB flush. Frees that come in meanwhile are picked up by the same pass.
  */
-static void purge_vmap_area_lazy(void)
+static void purge_vmap_area_work(struct work_struct *work)
 {
 	mutex_lock(&vmap_purge_lock);
-	purge_fragmented_blocks_allcpus();
 	__purge_vmap_area_lazy(ULONG_MAX, 0);
 	mutex_unlock(&vmap_purge_lock);
 }
 
+static DECLARE_WORK(vmap_purge_work, purge_vmap_area_work);
+
 /*
  * Free a vmap area, caller ensuring that the area has been unmapped
  * and flush_cache_vunmap had been called for the correct range
@@ -730,7 +844,7 @@ static void free_vmap_area_noflush(struct vmap_area *va)
 	llist_add(&va->purge_list, &vmap_purge_list);
 
 	if (unlikely(nr_lazy > lazy_max_pages()))
-		try_purge_vmap_area_lazy();
+		schedule_work(&vmap_purge_work);
 }
 
 /*
@@ -2738,6 +2852,31 @@ static const struct seq_operations vmalloc_op = {
 	.show = s_show,
 };
 
+static void vmap_lat_show(struct seq_file *m, const char *name,
+			  struct vmap_lat_hist __percpu *hist)
+{
+	int cpu, i;
+
+	seq_puts(m, name);
+	for (i = 0; i < VMAP_LAT_BUCKETS; i++) {
+		unsigned long sum = 0;
+
+		for_each_possible_cpu(cpu)
+			sum += per_cpu_ptr(hist, cpu)->buckets[i];
+		seq_printf(m, " %lu", sum);
+	}
+	seq_putc(m, '\n');
+}
+
+static int vmallocstat_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "lazy_pages %d\n", atomic_read(&vmap_lazy_nr));
+	seq_printf(m, "lazy_max_pages %lu\n", lazy_max_pages());
+	vmap_lat_show(m, "alloc_latency_us", &vmap_alloc_lat);
+	vmap_lat_show(m, "purge_latency_us", &vmap_purge_lat);
+	return 0;
+}
+
 static int __init proc_vmalloc_init(void)
 {
 	if (IS_ENABLED(CONFIG_NUMA))
@@ -2746,6 +2885,7 @@ static int __init proc_vmalloc_init(void)
 				nr_node_ids * sizeof(unsigned int), NULL);
 	else
 		proc_create_seq("vmallocinfo", 0400, NULL, &vmalloc_op);
+	proc_create_single("vmallocstat", 0444, NULL, vmallocstat_show);
 	return 0;
 }
 module_init(proc_vmalloc_init);
@@ -49,6 +49,7 @@
 #include <linux/prefetch.h>
 #include <linux/printk.h>
 #include <linux/dax.h>
+#include <linux/memory_hotplug.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -160,6 +161,12 @@ struct scan_control {
  * From 0 .. 100.  Higher means more swappy.
  */
 int vm_swappiness = 60;
+/*
+ * Reclaim threads per node, and their WRR weight (0 for the default).
+ * See kswapd_helper().
+ */
+int kswapd_threads = 1;
+int kswapd_wrr_weight;
 /*
  * The total number of pages which are beyond the high watermark within all
  * zones.
@@ -3583,7 +3590,12 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 			sc.priority--;
 	} while (sc.priority >= 1);
 
-	if (!sc.nr_reclaimed)
+	/*
+	 * Only kswapd[0] counts failed passes: the helpers run the same
+	 * passes concurrently and would make the node look hopeless
+	 * after a single unproductive round.
+	 */
+	if (!sc.nr_reclaimed && current == pgdat->kswapd[0])
 		pgdat->kswapd_failures++;
 
 out:
@@ -3694,6 +3706,54 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int alloc_order, int reclaim_o
 	finish_wait(&pgdat->kswapd_wait, &wait);
 }
 
+static void kswapd_enter(pg_data_t *pgdat, struct reclaim_state *reclaim_state)
+{
+	struct task_struct *tsk = current;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(tsk, cpumask);
+	current->reclaim_state = reclaim_state;
+
+	/*
+	 * Tell the memory management that we're a "memory allocator",
+	 * and that if we need more memory we should get access to it
+	 * regardless (see "__alloc_pages()"). "kswapd" should
+	 * never get caught in the normal page freeing logic.
+	 *
+	 * (Kswapd normally doesn't need memory anyway, but sometimes
+	 * you need a small amount of memory in order to be able to
+	 * page out something else, and this flag essentially protects
+	 * us from recursively trying to free more memory as we're
+	 * trying to free the first piece of memory in the first place).
+	 */
+	tsk->flags |= PF_MEMALLOC | PF_SWAPWRITE | PF_KSWAPD;
+	set_freezable();
+}
+
+static void kswapd_exit(void)
+{
+	current->flags &= ~(PF_MEMALLOC | PF_SWAPWRITE | PF_KSWAPD);
+	current->reclaim_state = NULL;
+}
+
+/*
+ * Hand the reclaim request kswapd[0] is about to work on to the helper
+ * threads of the node.
+ */
+static void kswapd_wake_helpers(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!READ_ONCE(pgdat->kswapd[1]))
+		return;
+
+	WRITE_ONCE(pgdat->kswapd_helper_order, order);
+	WRITE_ONCE(pgdat->kswapd_helper_classzone_idx, classzone_idx);
+	/* Pairs with smp_rmb() in kswapd_helper() */
+	smp_wmb();
+	WRITE_ONCE(pgdat->kswapd_helper_seq, pgdat->kswapd_helper_seq + 1);
+	wake_up_interruptible(&pgdat->kswapd_helper_wait);
+}
+
 /*
  * The background pageout daemon, started as a kernel thread
  * from the init process.
@@ -3712,31 +3772,12 @@ static int kswapd(void *p)
 	unsigned int alloc_order, reclaim_order;
 	unsigned int classzone_idx = MAX_NR_ZONES - 1;
 	pg_data_t *pgdat = (pg_data_t*)p;
-	struct task_struct *tsk = current;
 
 	struct reclaim_state reclaim_state = {
 		.reclaimed_slab = 0,
 	};
-	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
-
-	if (!cpumask_empty(cpumask))
-		set_cpus_allowed_ptr(tsk, cpumask);
-	current->reclaim_state = &reclaim_state;
 
-	/*
-	 * Tell the memory management that we're a "memory allocator",
-	 * and that if we need more memory we should get access to it
-	 * regardless (see "__alloc_pages()"). "kswapd" should
-	 * never get caught in the normal page freeing logic.
-	 *
-	 * (Kswapd normally doesn't need memory anyway, but sometimes
-	 * you need a small amount of memory in order to be able to
-	 * page out something else, and this flag essentially protects
-	 * us from recursively trying to free more memory as we're
-	 * trying to free the first piece of memory in the first place).
-	 */
-	tsk->flags |= PF_MEMALLOC | PF_SWAPWRITE | PF_KSWAPD;
-	set_freezable();
+	kswapd_enter(pgdat, &reclaim_state);
 
 	pgdat->kswapd_order = 0;
 	pgdat->kswapd_classzone_idx = MAX_NR_ZONES;
@@ -3777,14 +3818,51 @@ kswapd_try_sleep:
 		 */
 		trace_mm_vmscan_kswapd_wake(pgdat->node_id, classzone_idx,
 						alloc_order);
+		kswapd_wake_helpers(pgdat, alloc_order, classzone_idx);
 		reclaim_order = balance_pgdat(pgdat, alloc_order, classzone_idx);
 		if (reclaim_order < alloc_order)
 			goto kswapd_try_sleep;
 	}
 
-	tsk->flags &= ~(PF_MEMALLOC | PF_SWAPWRITE | PF_KSWAPD);
-	current->reclaim_state = NULL;
+	kswapd_exit();
+	return 0;
+}
+
+/*
+ * A kswapd helper reclaims the node alongside kswapd[0], for as long as
+ * the node is not balanced.  Concurrent balance_pgdat() calls share the
+ * per-node memcg iterator of shrink_node(), so each helper reclaims from
+ * different memcgs, and the LRU lists of a memcg are isolated from in
+ * batches, which keeps the threads from scanning the same pages.
+ */
+static int kswapd_helper(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t*)p;
+	unsigned long seq = READ_ONCE(pgdat->kswapd_helper_seq);
+	int order, classzone_idx;
+
+	struct reclaim_state reclaim_state = {
+		.reclaimed_slab = 0,
+	};
+
+	kswapd_enter(pgdat, &reclaim_state);
+
+	for ( ; ; ) {
+		wait_event_freezable(pgdat->kswapd_helper_wait,
+				     READ_ONCE(pgdat->kswapd_helper_seq) != seq ||
+				     kthread_should_stop());
+		if (kthread_should_stop())
+			break;
+
+		seq = READ_ONCE(pgdat->kswapd_helper_seq);
+		smp_rmb();
+		order = READ_ONCE(pgdat->kswapd_helper_order);
+		classzone_idx = READ_ONCE(pgdat->kswapd_helper_classzone_idx);
+
+		balance_pgdat(pgdat, order, classzone_idx);
+	}
 
+	kswapd_exit();
 	return 0;
 }
 
@@ -3888,13 +3966,65 @@ static int kswapd_cpu_online(unsigned int cpu)
 
 		mask = cpumask_of_node(pgdat->node_id);
 
-		if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
+		if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids) {
+			int i;
+
 			/* One of our CPUs online: restore mask */
-			set_cpus_allowed_ptr(pgdat->kswapd, mask);
+			for (i = 0; i < MAX_KSWAPD_THREADS; i++)
+				if (pgdat->kswapd[i])
+					set_cpus_allowed_ptr(pgdat->kswapd[i], mask);
+		}
 	}
 	return 0;
 }
 
+/* Serializes vm.kswapd_threads updates against node hotplug */
+static DEFINE_MUTEX(kswapd_threads_lock);
+
+static void kswapd_set_weight(struct task_struct *tsk)
+{
+	int weight = READ_ONCE(kswapd_wrr_weight);
+
+	sched_set_wrr_weight(tsk, weight ? weight : WRR_DEFAULT_WEIGHT);
+}
+
+/*
+ * Start or stop helpers of a node with kswapd[0] running, so that it has
+ * kswapd_threads threads in total, and apply kswapd_wrr_weight to them.
+ */
+static void kswapd_update_helpers(pg_data_t *pgdat)
+{
+	int i, nr_threads = READ_ONCE(kswapd_threads);
+
+	lockdep_assert_held(&kswapd_threads_lock);
+
+	for (i = 1; i < MAX_KSWAPD_THREADS; i++) {
+		struct task_struct *tsk = pgdat->kswapd[i];
+
+		if (i >= nr_threads) {
+			if (tsk) {
+				kthread_stop(tsk);
+				WRITE_ONCE(pgdat->kswapd[i], NULL);
+			}
+			continue;
+		}
+
+		if (!tsk) {
+			tsk = kthread_run(kswapd_helper, pgdat, "kswapd%d:%d",
+					  pgdat->node_id, i);
+			if (IS_ERR(tsk)) {
+				/* kswapd[0] alone still reclaims the node */
+				pr_err("Failed to start kswapd helper %d on node %d\n",
+				       i, pgdat->node_id);
+				break;
+			}
+			WRITE_ONCE(pgdat->kswapd[i], tsk);
+		}
+		kswapd_set_weight(tsk);
+	}
+	kswapd_set_weight(pgdat->kswapd[0]);
+}
+
 /*
  * This kswapd start function will be called by init and node-hot-add.
  * On node-hot-add, kswapd will moved to proper cpus if cpus are hot-added.
@@ -3902,19 +4032,25 @@ static int kswapd_cpu_online(unsigned int cpu)
 int kswapd_run(int nid)
 {
 	pg_data_t *pgdat = NODE_DATA(nid);
+	struct task_struct *tsk;
 	int ret = 0;
 
-	if (pgdat->kswapd)
-		return 0;
+	mutex_lock(&kswapd_threads_lock);
+	if (pgdat->kswapd[0])
+		goto out;
 
-	pgdat->kswapd = kthread_run(kswapd, pgdat, "kswapd%d", nid);
-	if (IS_ERR(pgdat->kswapd)) {
+	tsk = kthread_run(kswapd, pgdat, "kswapd%d", nid);
+	if (IS_ERR(tsk)) {
 		/* failure at boot is fatal */
 		BUG_ON(system_state < SYSTEM_RUNNING);
 		pr_err("Failed to start kswapd on node %d\n", nid);
-		ret = PTR_ERR(pgdat->kswapd);
-		pgdat->kswapd = NULL;
+		ret = PTR_ERR(tsk);
+		goto out;
 	}
+	pgdat->kswapd[0] = tsk;
+	kswapd_update_helpers(pgdat);
+out:
+	mutex_unlock(&kswapd_threads_lock);
 	return ret;
 }
 
@@ -3924,12 +4060,46 @@ int kswapd_run(int nid)
  */
 void kswapd_stop(int nid)
 {
-	struct task_struct *kswapd = NODE_DATA(nid)->kswapd;
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int i;
+
+	mutex_lock(&kswapd_threads_lock);
+	for (i = MAX_KSWAPD_THREADS - 1; i >= 0; i--) {
+		if (pgdat->kswapd[i]) {
+			kthread_stop(pgdat->kswapd[i]);
+			WRITE_ONCE(pgdat->kswapd[i], NULL);
+		}
+	}
+	mutex_unlock(&kswapd_threads_lock);
+}
+
+/*
+ * vm.kswapd_threads and vm.kswapd_wrr_weight: more than one thread per node
+ * lets reclaim keep up with allocators on large nodes instead of pushing
+ * them into direct reclaim.
+ */
+int kswapd_threads_sysctl_handler(struct ctl_table *table, int write,
+				  void __user *buffer, size_t *length,
+				  loff_t *ppos)
+{
+	int nid, ret;
 
-	if (kswapd) {
-		kthread_stop(kswapd);
-		NODE_DATA(nid)->kswapd = NULL;
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	mem_hotplug_begin();
+	mutex_lock(&kswapd_threads_lock);
+	for_each_node_state(nid, N_MEMORY) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		if (pgdat->kswapd[0])
+			kswapd_update_helpers(pgdat);
 	}
+	mutex_unlock(&kswapd_threads_lock);
+	mem_hotplug_done();
+
+	return 0;
 }
 
 static int __init kswapd_init(void)
@@ -770,6 +770,9 @@ static int refresh_cpu_vm_stats(bool do_pagesets)
 #endif
 			}
 		}
+
+		if (do_pagesets && pcp_adapt(zone, this_cpu_ptr(&p->pcp)))
+			changes++;
 #ifdef CONFIG_NUMA
 		for (i = 0; i < NR_VM_NUMA_STAT_ITEMS; i++) {
 			int v;
@@ -1286,6 +1289,10 @@ const char * const vmstat_text[] = {
 	"swap_ra",
 	"swap_ra_hit",
 #endif
+#ifdef CONFIG_MEMCG
+	"memcg_stock_hit",
+	"memcg_stock_miss",
+#endif
 #endif /* CONFIG_VM_EVENTS_COUNTERS */
 };
 #endif /* CONFIG_PROC_FS || CONFIG_SYSFS || CONFIG_NUMA */
@@ -1601,11 +1608,17 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 			   "\n    cpu: %i"
 			   "\n              count: %i"
 			   "\n              high:  %i"
-			   "\n              batch: %i",
+			   "\n              batch: %i"
+			   "\n              scale: %i"
+			   "\n              zone_lock: %lu"
+			   "\n              refill: %lu",
 			   i,
 			   pageset->pcp.count,
 			   pageset->pcp.high,
-			   pageset->pcp.batch);
+			   pageset->pcp.batch,
+			   pageset->pcp.scale,
+			   pageset->pcp.nr_zone_lock,
+			   pageset->pcp.nr_refill);
 #ifdef CONFIG_SMP
 		seq_printf(m, "\n  vm stats threshold: %d",
 				pageset->stat_threshold);
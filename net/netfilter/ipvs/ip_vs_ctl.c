@@ -2128,6 +2128,54 @@ static const struct seq_operations ip_vs_info_seq_ops = {
 	.show  = ip_vs_info_seq_show,
 };
 
+/* Statistics of the schedulers that keep some, e.g. table rebuilds */
+static int ip_vs_sched_stats_seq_show(struct seq_file *seq, void *v)
+{
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(seq,
+			 "Prot LocalAddress:Port Scheduler\n");
+		seq_puts(seq,
+			 "  -> Statistics\n");
+	} else {
+		struct net *net = seq_file_net(seq);
+		struct netns_ipvs *ipvs = net_ipvs(net);
+		struct ip_vs_service *svc = v;
+		const struct ip_vs_iter *iter = seq->private;
+		struct ip_vs_scheduler *sched = rcu_dereference(svc->scheduler);
+
+		if (svc->ipvs != ipvs || !sched || !sched->show_stats)
+			return 0;
+		if (iter->table == ip_vs_svc_table) {
+#ifdef CONFIG_IP_VS_IPV6
+			if (svc->af == AF_INET6)
+				seq_printf(seq, "%s  [%pI6]:%04X %s\n",
+					   ip_vs_proto_name(svc->protocol),
+					   &svc->addr.in6,
+					   ntohs(svc->port),
+					   sched->name);
+			else
+#endif
+				seq_printf(seq, "%s  %08X:%04X %s\n",
+					   ip_vs_proto_name(svc->protocol),
+					   ntohl(svc->addr.ip),
+					   ntohs(svc->port),
+					   sched->name);
+		} else {
+			seq_printf(seq, "FWM  %08X %s\n",
+				   svc->fwmark, sched->name);
+		}
+		sched->show_stats(svc, seq);
+	}
+	return 0;
+}
+
+static const struct seq_operations ip_vs_sched_stats_seq_ops = {
+	.start = ip_vs_info_seq_start,
+	.next  = ip_vs_info_seq_next,
+	.stop  = ip_vs_info_seq_stop,
+	.show  = ip_vs_sched_stats_seq_show,
+};
+
 static int ip_vs_stats_show(struct seq_file *seq, void *v)
 {
 	struct net *net = seq_file_single_net(seq);
@@ -4042,6 +4090,8 @@ int __net_init ip_vs_control_net_init(struct netns_ipvs *ipvs)
 			ip_vs_stats_show, NULL);
 	proc_create_net_single("ip_vs_stats_percpu", 0, ipvs->net->proc_net,
 			ip_vs_stats_percpu_show, NULL);
+	proc_create_net("ip_vs_sched_stats", 0, ipvs->net->proc_net,
+			&ip_vs_sched_stats_seq_ops, sizeof(struct ip_vs_iter));
 
 	if (ip_vs_control_net_init_sysctl(ipvs))
 		goto err;
@@ -4057,6 +4107,7 @@ void __net_exit ip_vs_control_net_cleanup(struct netns_ipvs *ipvs)
 {
 	ip_vs_trash_cleanup(ipvs);
 	ip_vs_control_net_cleanup_sysctl(ipvs);
+	remove_proc_entry("ip_vs_sched_stats", ipvs->net->proc_net);
 	remove_proc_entry("ip_vs_stats_percpu", ipvs->net->proc_net);
 	remove_proc_entry("ip_vs_stats", ipvs->net->proc_net);
 	remove_proc_entry("ip_vs", ipvs->net->proc_net);
@@ -14,6 +14,17 @@
  * The algorithm is detailed in:
  * [3.4 Consistent Hasing]
 https://www.usenix.org/system/files/conference/nsdi16/nsdi16-paper-eisenbud.pdf
+ *
+ * Destination changes only snapshot the destinations; the lookup table is
+ * rebuilt by a worker and swapped in with RCU. Unless the incremental
+ * module parameter is cleared, a rebuild starts from the current table:
+ * each destination keeps as many of its slots as its new weight entitles
+ * it to, and only the slots given up (or owned by removed destinations)
+ * are refilled along the preference lists of the destinations that are
+ * short of slots. So a weight change moves only the flows it has to.
+ * The first table of a service is always populated from scratch, and
+ * so is every table with incremental=0, which keeps tables identical
+ * across directors that saw different histories of changes.
  *
  */
 
@@ -31,19 +42,57 @@ https://www.usenix.org/system/files/conference/nsdi16/nsdi16-paper-eisenbud.pdf
 #include <linux/siphash.h>
 #include <linux/bitops.h>
 #include <linux/gcd.h>
+#include <linux/sort.h>
+#include <linux/bsearch.h>
+#include <linux/workqueue.h>
+#include <linux/seq_file.h>
 
 #define IP_VS_SVC_F_SCHED_MH_FALLBACK	IP_VS_SVC_F_SCHED1 /* MH fallback */
 #define IP_VS_SVC_F_SCHED_MH_PORT	IP_VS_SVC_F_SCHED2 /* MH use port */
 
+static bool incremental = true;
+module_param(incremental, bool, 0644);
+MODULE_PARM_DESC(incremental,
+		 "rebuild the lookup table from the current one (default: true)");
+
 struct ip_vs_mh_lookup {
-	struct ip_vs_dest __rcu	*dest;	/* real server (cache) */
+	struct ip_vs_dest	*dest;	/* real server (cache) */
+};
+
+/* Lookup tables are never changed once published */
+struct ip_vs_mh_table {
+	struct rcu_head		rcu_head;
+	struct ip_vs_mh_lookup	lookup[];
 };
 
 struct ip_vs_mh_dest_setup {
+	struct ip_vs_dest *dest;	/* held until the rebuild is done */
 	unsigned int	offset; /* starting offset */
 	unsigned int	skip;	/* skip */
 	unsigned int	perm;	/* next_offset */
 	int		turns;	/* weight / gcd() and rshift */
+	int		target;	/* slots the dest is entitled to */
+	int		count;	/* slots the dest has in the new table */
+};
+
+/* Snapshot of the destinations, taken under __ip_vs_mutex */
+struct ip_vs_mh_setup {
+	int				num;
+	int				af;
+	int				gcd;
+	int				rshift;
+	struct ip_vs_mh_dest_setup	ds[];
+};
+
+struct ip_vs_mh_stats {
+	u64		rebuilds;	/* tables swapped in */
+	u64		full;		/* ... of them populated from scratch */
+	u64		failed;		/* rebuilds that ran out of memory */
+	u64		moved;		/* slots that changed dest */
+	u64		last_ns;	/* duration of the last rebuild */
+	u64		max_ns;
+	u64		total_ns;
+	unsigned int	last_moved;
 };
 
 /* Available prime numbers for MH table */
@@ -60,11 +109,12 @@ static int primes[] = {251, 509, 1021, 2039, 4093,
 
 struct ip_vs_mh_state {
 	struct rcu_head			rcu_head;
-	struct ip_vs_mh_lookup		*lookup;
-	struct ip_vs_mh_dest_setup	*dest_setup;
+	struct ip_vs_mh_table __rcu	*table;
 	hsiphash_key_t			hash1, hash2;
-	int				gcd;
-	int				rshift;
+	struct work_struct		work;
+	spinlock_t			lock;	/* pending and stats */
+	struct ip_vs_mh_setup		*pending;
+	struct ip_vs_mh_stats		stats;
 };
 
 static inline void generate_hash_secret(hsiphash_key_t *hash1,
@@ -77,11 +127,14 @@ static inline void generate_hash_secret(hsiphash_key_t *hash1,
 	hash2->key[1] = 2654446892UL;
 }
 
-/* Helper function to determine if server is unavailable */
+/* Helper function to determine if server is unavailable, a removed
+ * server stays in the lookup table until the rebuild work runs.
+ */
 static inline bool is_unavailable(struct ip_vs_dest *dest)
 {
 	return atomic_read(&dest->weight) <= 0 ||
-	       dest->flags & IP_VS_DEST_F_OVERLOAD;
+	       dest->flags & IP_VS_DEST_F_OVERLOAD ||
+	       !(dest->flags & IP_VS_DEST_F_AVAILABLE);
 }
 
 /* Returns hash value for IPVS MH entry */
@@ -101,97 +154,91 @@ ip_vs_mh_hashkey(int af, const union nf_inet_addr *addr,
 	return hsiphash(&v, sizeof(v), key);
 }
 
-/* Reset all the hash buckets of the specified table. */
-static void ip_vs_mh_reset(struct ip_vs_mh_state *s)
+/* Drop the references of all the hash buckets of the specified table. */
+static void ip_vs_mh_reset(struct ip_vs_mh_table *t)
 {
 	int i;
 	struct ip_vs_mh_lookup *l;
-	struct ip_vs_dest *dest;
 
-	l = &s->lookup[0];
+	l = &t->lookup[0];
 	for (i = 0; i < IP_VS_MH_TAB_SIZE; i++) {
-		dest = rcu_dereference_protected(l->dest, 1);
-		if (dest) {
-			ip_vs_dest_put(dest);
-			RCU_INIT_POINTER(l->dest, NULL);
-		}
+		if (l->dest)
+			ip_vs_dest_put(l->dest);
 		l++;
 	}
 }
 
-static int ip_vs_mh_permutate(struct ip_vs_mh_state *s,
-			      struct ip_vs_service *svc)
+static void ip_vs_mh_table_free(struct rcu_head *head)
+{
+	kfree(container_of(head, struct ip_vs_mh_table, rcu_head));
+}
+
+static struct ip_vs_mh_table *ip_vs_mh_table_alloc(void)
+{
+	struct ip_vs_mh_table *t;
+
+	return kzalloc(struct_size(t, lookup, IP_VS_MH_TAB_SIZE), GFP_KERNEL);
+}
+
+static void ip_vs_mh_setup_free(struct ip_vs_mh_setup *setup)
+{
+	int i;
+
+	if (!setup)
+		return;
+	for (i = 0; i < setup->num; i++)
+		ip_vs_dest_put(setup->ds[i].dest);
+	kfree(setup);
+}
+
+static void ip_vs_mh_permutate(struct ip_vs_mh_state *s,
+			       struct ip_vs_mh_setup *setup)
 {
-	struct list_head *p;
 	struct ip_vs_mh_dest_setup *ds;
 	struct ip_vs_dest *dest;
-	int lw;
+	int i, lw;
 
 	/* If gcd is smaller then 1, number of dests or
 	 * all last_weight of dests are zero. So, skip
 	 * permutation for the dests.
 	 */
-	if (s->gcd < 1)
-		return 0;
+	if (setup->gcd < 1)
+		return;
 
 	/* Set dest_setup for the dests permutation */
-	p = &svc->destinations;
-	ds = &s->dest_setup[0];
-	while ((p = p->next) != &svc->destinations) {
-		dest = list_entry(p, struct ip_vs_dest, n_list);
+	for (i = 0; i < setup->num; i++) {
+		ds = &setup->ds[i];
+		dest = ds->dest;
 
-		ds->offset = ip_vs_mh_hashkey(svc->af, &dest->addr,
+		ds->offset = ip_vs_mh_hashkey(setup->af, &dest->addr,
 					      dest->port, &s->hash1, 0) %
 					      IP_VS_MH_TAB_SIZE;
-		ds->skip = ip_vs_mh_hashkey(svc->af, &dest->addr,
+		ds->skip = ip_vs_mh_hashkey(setup->af, &dest->addr,
 					    dest->port, &s->hash2, 0) %
 					    (IP_VS_MH_TAB_SIZE - 1) + 1;
 		ds->perm = ds->offset;
 
 		lw = atomic_read(&dest->last_weight);
-		ds->turns = ((lw / s->gcd) >> s->rshift) ? : (lw != 0);
-		ds++;
+		ds->turns = ((lw / setup->gcd) >> setup->rshift) ? : (lw != 0);
 	}
-
-	return 0;
 }
 
-static int ip_vs_mh_populate(struct ip_vs_mh_state *s,
-			     struct ip_vs_service *svc)
+/* Populate the table from scratch, as in the paper */
+static void ip_vs_mh_populate(struct ip_vs_mh_table *t,
+			      struct ip_vs_mh_setup *setup,
+			      unsigned long *table)
 {
-	int n, c, dt_count;
-	unsigned long *table;
-	struct list_head *p;
+	int n, c, i, dt_count;
 	struct ip_vs_mh_dest_setup *ds;
-	struct ip_vs_dest *dest, *new_dest;
-
-	/* If gcd is smaller then 1, number of dests or
-	 * all last_weight of dests are zero. So, skip
-	 * the population for the dests and reset lookup table.
-	 */
-	if (s->gcd < 1) {
-		ip_vs_mh_reset(s);
-		return 0;
-	}
-
-	table =  kcalloc(BITS_TO_LONGS(IP_VS_MH_TAB_SIZE),
-			 sizeof(unsigned long), GFP_KERNEL);
-	if (!table)
-		return -ENOMEM;
 
-	p = &svc->destinations;
 	n = 0;
 	dt_count = 0;
 	while (n < IP_VS_MH_TAB_SIZE) {
-		if (p == &svc->destinations)
-			p = p->next;
-
-		ds = &s->dest_setup[0];
-		while (p != &svc->destinations) {
+		for (i = 0; i < setup->num; ) {
+			ds = &setup->ds[i];
 			/* Ignore added server with zero weight */
 			if (ds->turns < 1) {
-				p = p->next;
-				ds++;
+				i++;
 				continue;
 			}
 
@@ -205,32 +252,167 @@ static int ip_vs_mh_populate(struct ip_vs_mh_state *s,
 			}
 
 			__set_bit(c, table);
-
-			dest = rcu_dereference_protected(s->lookup[c].dest, 1);
-			new_dest = list_entry(p, struct ip_vs_dest, n_list);
-			if (dest != new_dest) {
-				if (dest)
-					ip_vs_dest_put(dest);
-				ip_vs_dest_hold(new_dest);
-				RCU_INIT_POINTER(s->lookup[c].dest, new_dest);
-			}
+			t->lookup[c].dest = ds->dest;
 
 			if (++n == IP_VS_MH_TAB_SIZE)
-				goto out;
+				return;
 
 			if (++dt_count >= ds->turns) {
 				dt_count = 0;
-				p = p->next;
-				ds++;
+				i++;
 			}
 		}
 	}
+}
+
+static int ip_vs_mh_cmp_dest(const void *a, const void *b)
+{
+	const struct ip_vs_mh_dest_setup *x = *(void * const *)a;
+	const struct ip_vs_mh_dest_setup *y = *(void * const *)b;
+
+	if (x->dest == y->dest)
+		return 0;
+	return x->dest < y->dest ? -1 : 1;
+}
+
+static int ip_vs_mh_cmp_key(const void *key, const void *elt)
+{
+	const struct ip_vs_dest *dest = key;
+	const struct ip_vs_mh_dest_setup *ds = *(void * const *)elt;
+
+	if (dest == ds->dest)
+		return 0;
+	return dest < ds->dest ? -1 : 1;
+}
+
+/* Repopulate the table starting from the current one: a dest keeps its
+ * slots up to its share of the table and the remaining slots are handed
+ * out along the preference lists of the dests below their share.
+ */
+static int ip_vs_mh_repopulate(struct ip_vs_mh_table *t,
+			       struct ip_vs_mh_table *old,
+			       struct ip_vs_mh_setup *setup,
+			       unsigned long *table)
+{
+	struct ip_vs_mh_dest_setup **sorted, **found, *ds;
+	int i, c, total = 0, assigned = 0, left;
+	struct ip_vs_dest *dest;
+
+	sorted = kmalloc_array(setup->num, sizeof(*sorted), GFP_KERNEL);
+	if (!sorted)
+		return -ENOMEM;
+
+	for (i = 0; i < setup->num; i++) {
+		sorted[i] = &setup->ds[i];
+		total += setup->ds[i].turns;
+	}
+	sort(sorted, setup->num, sizeof(*sorted), ip_vs_mh_cmp_dest, NULL);
+
+	/* Split the table in proportion to the turns, the rounding
+	 * leftovers go to the first dests with turns, one slot each.
+	 */
+	for (i = 0; i < setup->num; i++) {
+		ds = &setup->ds[i];
+		ds->target = div_u64((u64)IP_VS_MH_TAB_SIZE * ds->turns, total);
+		assigned += ds->target;
+	}
+	for (i = 0; assigned < IP_VS_MH_TAB_SIZE; i++) {
+		if (setup->ds[i].turns > 0) {
+			setup->ds[i].target++;
+			assigned++;
+		}
+	}
+
+	/* Keep the slots of dests that did not exceed their share */
+	left = IP_VS_MH_TAB_SIZE;
+	for (c = 0; c < IP_VS_MH_TAB_SIZE; c++) {
+		dest = old->lookup[c].dest;
+		if (!dest)
+			continue;
+		found = bsearch(dest, sorted, setup->num, sizeof(*sorted),
+				ip_vs_mh_cmp_key);
+		if (!found || (*found)->count >= (*found)->target)
+			continue;
+		(*found)->count++;
+		__set_bit(c, table);
+		t->lookup[c].dest = dest;
+		left--;
+	}
+	kfree(sorted);
+
+	/* Hand out the free slots, one per dest below its share per round */
+	while (left > 0) {
+		for (i = 0; i < setup->num && left > 0; i++) {
+			ds = &setup->ds[i];
+			if (ds->count >= ds->target)
+				continue;
+
+			c = ds->perm;
+			while (test_bit(c, table)) {
+				ds->perm += ds->skip;
+				if (ds->perm >= IP_VS_MH_TAB_SIZE)
+					ds->perm -= IP_VS_MH_TAB_SIZE;
+				c = ds->perm;
+			}
+
+			__set_bit(c, table);
+			t->lookup[c].dest = ds->dest;
+			ds->count++;
+			left--;
+		}
+	}
 
-out:
-	kfree(table);
 	return 0;
 }
 
+/* Build a new lookup table for setup, holding a reference per slot */
+static struct ip_vs_mh_table *
+ip_vs_mh_build(struct ip_vs_mh_state *s, struct ip_vs_mh_table *old,
+	       struct ip_vs_mh_setup *setup, bool *full)
+{
+	struct ip_vs_mh_table *t;
+	unsigned long *table;
+	int c, ret = 0;
+
+	t = ip_vs_mh_table_alloc();
+	if (!t)
+		return NULL;
+
+	/* If gcd is smaller then 1, number of dests or
+	 * all last_weight of dests are zero. So, skip
+	 * the population for the dests and leave the table empty.
+	 */
+	*full = true;
+	if (setup->gcd < 1)
+		return t;
+
+	table = kcalloc(BITS_TO_LONGS(IP_VS_MH_TAB_SIZE),
+			sizeof(unsigned long), GFP_KERNEL);
+	if (!table) {
+		kfree(t);
+		return NULL;
+	}
+
+	ip_vs_mh_permutate(s, setup);
+
+	if (incremental && old && old->lookup[0].dest) {
+		*full = false;
+		ret = ip_vs_mh_repopulate(t, old, setup, table);
+	} else {
+		ip_vs_mh_populate(t, setup, table);
+	}
+	kfree(table);
+
+	if (ret < 0) {
+		kfree(t);
+		return NULL;
+	}
+
+	for (c = 0; c < IP_VS_MH_TAB_SIZE; c++)
+		ip_vs_dest_hold(t->lookup[c].dest);
+	return t;
+}
+
 /* Get ip_vs_dest associated with supplied parameters. */
 static inline struct ip_vs_dest *
 ip_vs_mh_get(struct ip_vs_service *svc, struct ip_vs_mh_state *s,
@@ -238,7 +420,8 @@ ip_vs_mh_get(struct ip_vs_service *svc, struct ip_vs_mh_state *s,
 {
 	unsigned int hash = ip_vs_mh_hashkey(svc->af, addr, port, &s->hash1, 0)
 					     % IP_VS_MH_TAB_SIZE;
-	struct ip_vs_dest *dest = rcu_dereference(s->lookup[hash].dest);
+	struct ip_vs_mh_table *t = rcu_dereference(s->table);
+	struct ip_vs_dest *dest = t->lookup[hash].dest;
 
 	return (!dest || is_unavailable(dest)) ? NULL : dest;
 }
@@ -248,6 +431,7 @@ static inline struct ip_vs_dest *
 ip_vs_mh_get_fallback(struct ip_vs_service *svc, struct ip_vs_mh_state *s,
 		      const union nf_inet_addr *addr, __be16 port)
 {
+	struct ip_vs_mh_table *t = rcu_dereference(s->table);
 	unsigned int offset, roffset;
 	unsigned int hash, ihash;
 	struct ip_vs_dest *dest;
@@ -255,7 +439,7 @@ ip_vs_mh_get_fallback(struct ip_vs_service *svc, struct ip_vs_mh_state *s,
 	/* First try the dest it's supposed to go to */
 	ihash = ip_vs_mh_hashkey(svc->af, addr, port,
 				 &s->hash1, 0) % IP_VS_MH_TAB_SIZE;
-	dest = rcu_dereference(s->lookup[ihash].dest);
+	dest = t->lookup[ihash].dest;
 	if (!dest)
 		return NULL;
 	if (!is_unavailable(dest))
@@ -271,7 +455,7 @@ ip_vs_mh_get_fallback(struct ip_vs_service *svc, struct ip_vs_mh_state *s,
 		roffset = (offset + ihash) % IP_VS_MH_TAB_SIZE;
 		hash = ip_vs_mh_hashkey(svc->af, addr, port, &s->hash1,
 					roffset) % IP_VS_MH_TAB_SIZE;
-		dest = rcu_dereference(s->lookup[hash].dest);
+		dest = t->lookup[hash].dest;
 		if (!dest)
 			break;
 		if (!is_unavailable(dest))
@@ -285,41 +469,6 @@ ip_vs_mh_get_fallback(struct ip_vs_service *svc, struct ip_vs_mh_state *s,
 	return NULL;
 }
 
-/* Assign all the hash buckets of the specified table with the service. */
-static int ip_vs_mh_reassign(struct ip_vs_mh_state *s,
-			     struct ip_vs_service *svc)
-{
-	int ret;
-
-	if (svc->num_dests > IP_VS_MH_TAB_SIZE)
-		return -EINVAL;
-
-	if (svc->num_dests >= 1) {
-		s->dest_setup = kcalloc(svc->num_dests,
-					sizeof(struct ip_vs_mh_dest_setup),
-					GFP_KERNEL);
-		if (!s->dest_setup)
-			return -ENOMEM;
-	}
-
-	ip_vs_mh_permutate(s, svc);
-
-	ret = ip_vs_mh_populate(s, svc);
-	if (ret < 0)
-		goto out;
-
-	IP_VS_DBG_BUF(6, "MH: reassign lookup table of %s:%u\n",
-		      IP_VS_DBG_ADDR(svc->af, &svc->addr),
-		      ntohs(svc->port));
-
-out:
-	if (svc->num_dests >= 1) {
-		kfree(s->dest_setup);
-		s->dest_setup = NULL;
-	}
-	return ret;
-}
-
 static int ip_vs_mh_gcd_weight(struct ip_vs_service *svc)
 {
 	struct ip_vs_dest *dest;
@@ -370,48 +519,137 @@ static int ip_vs_mh_shift_weight(struct ip_vs_service *svc, int gcd)
 	return (shift >= 0) ? shift : 0;
 }
 
+/* Snapshot the dests of the service for a rebuild.
+ * Called with __ip_vs_mutex held.
+ */
+static struct ip_vs_mh_setup *ip_vs_mh_setup_get(struct ip_vs_service *svc)
+{
+	struct ip_vs_mh_setup *setup;
+	struct ip_vs_dest *dest;
+	int n = 0;
+
+	if (svc->num_dests > IP_VS_MH_TAB_SIZE)
+		return ERR_PTR(-EINVAL);
+
+	setup = kzalloc(struct_size(setup, ds, svc->num_dests), GFP_KERNEL);
+	if (!setup)
+		return ERR_PTR(-ENOMEM);
+
+	list_for_each_entry(dest, &svc->destinations, n_list) {
+		if (n == svc->num_dests)
+			break;
+		ip_vs_dest_hold(dest);
+		setup->ds[n++].dest = dest;
+	}
+	setup->num = n;
+	setup->af = svc->af;
+	setup->gcd = ip_vs_mh_gcd_weight(svc);
+	setup->rshift = ip_vs_mh_shift_weight(svc, setup->gcd);
+	return setup;
+}
+
+/* Swap in a table for the pending snapshot */
+static void ip_vs_mh_rebuild(struct work_struct *work)
+{
+	struct ip_vs_mh_state *s = container_of(work, struct ip_vs_mh_state,
+						work);
+	struct ip_vs_mh_table *old, *t;
+	struct ip_vs_mh_setup *setup;
+	unsigned int moved = 0;
+	ktime_t start;
+	bool full;
+	u64 ns;
+	int c;
+
+	spin_lock_bh(&s->lock);
+	setup = s->pending;
+	s->pending = NULL;
+	spin_unlock_bh(&s->lock);
+	if (!setup)
+		return;
+
+	start = ktime_get();
+	/* Only this work and the service setup replace the table */
+	old = rcu_dereference_protected(s->table, 1);
+	t = ip_vs_mh_build(s, old, setup, &full);
+	if (!t) {
+		/* Retry on the next dest change unless one is pending */
+		spin_lock_bh(&s->lock);
+		s->stats.failed++;
+		if (!s->pending)
+			swap(s->pending, setup);
+		spin_unlock_bh(&s->lock);
+		ip_vs_mh_setup_free(setup);
+		return;
+	}
+
+	for (c = 0; c < IP_VS_MH_TAB_SIZE; c++)
+		moved += t->lookup[c].dest != old->lookup[c].dest;
+
+	rcu_assign_pointer(s->table, t);
+	ip_vs_mh_reset(old);
+	call_rcu(&old->rcu_head, ip_vs_mh_table_free);
+	ip_vs_mh_setup_free(setup);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	spin_lock_bh(&s->lock);
+	s->stats.rebuilds++;
+	s->stats.full += full;
+	s->stats.moved += moved;
+	s->stats.last_moved = moved;
+	s->stats.last_ns = ns;
+	s->stats.max_ns = max(s->stats.max_ns, ns);
+	s->stats.total_ns += ns;
+	spin_unlock_bh(&s->lock);
+
+	IP_VS_DBG(6, "MH: rebuilt lookup table in %lluns, %u slots moved\n",
+		  ns, moved);
+}
+
 static void ip_vs_mh_state_free(struct rcu_head *head)
 {
 	struct ip_vs_mh_state *s;
 
 	s = container_of(head, struct ip_vs_mh_state, rcu_head);
-	kfree(s->lookup);
+	kfree(rcu_dereference_raw(s->table));
 	kfree(s);
 }
 
 static int ip_vs_mh_init_svc(struct ip_vs_service *svc)
 {
-	int ret;
+	struct ip_vs_mh_setup *setup;
 	struct ip_vs_mh_state *s;
+	struct ip_vs_mh_table *t;
+	bool full;
 
 	/* Allocate the MH table for this service */
 	s = kzalloc(sizeof(*s), GFP_KERNEL);
 	if (!s)
 		return -ENOMEM;
 
-	s->lookup = kcalloc(IP_VS_MH_TAB_SIZE, sizeof(struct ip_vs_mh_lookup),
-			    GFP_KERNEL);
-	if (!s->lookup) {
+	generate_hash_secret(&s->hash1, &s->hash2);
+	spin_lock_init(&s->lock);
+	INIT_WORK(&s->work, ip_vs_mh_rebuild);
+
+	setup = ip_vs_mh_setup_get(svc);
+	if (IS_ERR(setup)) {
 		kfree(s);
-		return -ENOMEM;
+		return PTR_ERR(setup);
 	}
 
-	generate_hash_secret(&s->hash1, &s->hash2);
-	s->gcd = ip_vs_mh_gcd_weight(svc);
-	s->rshift = ip_vs_mh_shift_weight(svc, s->gcd);
+	/* Assign the lookup table with current dests */
+	t = ip_vs_mh_build(s, NULL, setup, &full);
+	ip_vs_mh_setup_free(setup);
+	if (!t) {
+		kfree(s);
+		return -ENOMEM;
+	}
+	RCU_INIT_POINTER(s->table, t);
 
 	IP_VS_DBG(6,
 		  "MH lookup table (memory=%zdbytes) allocated for current service\n",
 		  sizeof(struct ip_vs_mh_lookup) * IP_VS_MH_TAB_SIZE);
 
-	/* Assign the lookup table with current dests */
-	ret = ip_vs_mh_reassign(s, svc);
-	if (ret < 0) {
-		ip_vs_mh_reset(s);
-		ip_vs_mh_state_free(&s->rcu_head);
-		return ret;
-	}
-
 	/* No more failures, attach state */
 	svc->sched_data = s;
 	return 0;
@@ -421,8 +659,11 @@ static void ip_vs_mh_done_svc(struct ip_vs_service *svc)
 {
 	struct ip_vs_mh_state *s = svc->sched_data;
 
+	cancel_work_sync(&s->work);
+	ip_vs_mh_setup_free(s->pending);
+
 	/* Got to clean up lookup entry here */
-	ip_vs_mh_reset(s);
+	ip_vs_mh_reset(rcu_dereference_protected(s->table, 1));
 
 	call_rcu(&s->rcu_head, ip_vs_mh_state_free);
 	IP_VS_DBG(6, "MH lookup table (memory=%zdbytes) released\n",
@@ -433,12 +674,38 @@ static int ip_vs_mh_dest_changed(struct ip_vs_service *svc,
 				 struct ip_vs_dest *dest)
 {
 	struct ip_vs_mh_state *s = svc->sched_data;
+	struct ip_vs_mh_setup *setup;
 
-	s->gcd = ip_vs_mh_gcd_weight(svc);
-	s->rshift = ip_vs_mh_shift_weight(svc, s->gcd);
+	setup = ip_vs_mh_setup_get(svc);
+	if (IS_ERR(setup))
+		return PTR_ERR(setup);
 
-	/* Assign the lookup table with the updated service */
-	return ip_vs_mh_reassign(s, svc);
+	/* Only the latest snapshot is worth building */
+	spin_lock_bh(&s->lock);
+	swap(s->pending, setup);
+	spin_unlock_bh(&s->lock);
+	ip_vs_mh_setup_free(setup);
+
+	schedule_work(&s->work);
+	return 0;
+}
+
+static void ip_vs_mh_show_stats(struct ip_vs_service *svc,
+				struct seq_file *seq)
+{
+	struct ip_vs_mh_state *s = svc->sched_data;
+	struct ip_vs_mh_stats st;
+
+	spin_lock_bh(&s->lock);
+	st = s->stats;
+	spin_unlock_bh(&s->lock);
+
+	seq_printf(seq, "  -> rebuilds %llu full %llu failed %llu moved %llu last_moved %u\n",
+		   st.rebuilds, st.full, st.failed, st.moved, st.last_moved);
+	seq_printf(seq, "  -> last_ns %llu avg_ns %llu max_ns %llu\n",
+		   st.last_ns,
+		   st.rebuilds ? div64_u64(st.total_ns, st.rebuilds) : 0,
+		   st.max_ns);
 }
 
 /* Helper function to get port number */
@@ -520,6 +787,7 @@ static struct ip_vs_scheduler ip_vs_mh_scheduler = {
 	.del_dest =		ip_vs_mh_dest_changed,
 	.upd_dest =		ip_vs_mh_dest_changed,
 	.schedule =		ip_vs_mh_schedule,
+	.show_stats =		ip_vs_mh_show_stats,
 };
 
 static int __init ip_vs_mh_init(void)
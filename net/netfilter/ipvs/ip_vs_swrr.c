@@ -0,0 +1,432 @@
+/*
+ * IPVS:        Smooth Weighted Round-Robin Scheduling module
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License
+ *              as published by the Free Software Foundation; either version
+ *              2 of the License, or (at your option) any later version.
+ *
+ */
+
+#define KMSG_COMPONENT "IPVS"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/jiffies.h>
+
+#include <net/ip_vs.h>
+
+/* The classic WRR scheduler sends mw/di consecutive connections to the
+ * heaviest server before the others get any. SWRR interleaves them
+ * instead, as the "current weight += weight, pick max, subtract total"
+ * scheme of nginx does, but in O(log n) per connection:
+ *
+ * Every dest with weight w > 0 has a virtual deadline and a stride of
+ * SWRR_SCALE / w. We pick the dest with the earliest deadline from a
+ * binary min-heap and push its deadline back by its stride, so over any
+ * window a dest gets connections in proportion to its weight and they are
+ * spread evenly. A new dest starts half a stride after the current
+ * virtual time, which for weights 5, 1, 1 gives a a a b c a a. The
+ * proportions are the same as with nginx, the order is not: nginx gives
+ * a a b a c a a.
+ *
+ * Overloaded dests lose their turn: their deadline advances as if they
+ * had been picked and the next one is tried, at most once per dest.
+ *
+ * With slow_start set, a dest added to the service (or brought back from
+ * weight 0) starts with weight 1 and ramps linearly up to its configured
+ * weight over slow_start seconds.
+ */
+
+#define SWRR_SCALE	(1ULL << 32)
+/* Rebase deadlines before they can overflow */
+#define SWRR_REBASE	(1ULL << 62)
+#define SWRR_MIN_SIZE	8
+
+static unsigned int slow_start;
+module_param(slow_start, uint, 0644);
+MODULE_PARM_DESC(slow_start,
+		 "seconds over which a new destination ramps up to its weight (0 disables)");
+
+struct ip_vs_swrr_node {
+	struct ip_vs_dest	*dest;
+	u64			deadline;	/* virtual time of the next pick */
+	u64			weight;		/* weight the deadline is set for */
+	unsigned long		added;		/* jiffies, 0 if not ramping */
+	u32			seq;		/* breaks ties in insertion order */
+};
+
+struct ip_vs_swrr_heap {
+	struct ip_vs_swrr_node	*nodes;
+	int			n;		/* dests in the heap */
+	int			size;		/* allocated nodes */
+	u32			seq;
+	u64			vtime;		/* deadline of the last pick */
+	struct rcu_head		rcu_head;
+};
+
+
+static inline bool ip_vs_swrr_before(const struct ip_vs_swrr_node *a,
+				     const struct ip_vs_swrr_node *b)
+{
+	if (a->deadline != b->deadline)
+		return a->deadline < b->deadline;
+	return (s32)(a->seq - b->seq) < 0;
+}
+
+static void ip_vs_swrr_sift_up(struct ip_vs_swrr_heap *h, int i)
+{
+	struct ip_vs_swrr_node node = h->nodes[i];
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!ip_vs_swrr_before(&node, &h->nodes[parent]))
+			break;
+		h->nodes[i] = h->nodes[parent];
+		i = parent;
+	}
+	h->nodes[i] = node;
+}
+
+static void ip_vs_swrr_sift_down(struct ip_vs_swrr_heap *h, int i)
+{
+	struct ip_vs_swrr_node node = h->nodes[i];
+	int child;
+
+	while ((child = 2 * i + 1) < h->n) {
+		if (child + 1 < h->n &&
+		    ip_vs_swrr_before(&h->nodes[child + 1], &h->nodes[child]))
+			child++;
+		if (!ip_vs_swrr_before(&h->nodes[child], &node))
+			break;
+		h->nodes[i] = h->nodes[child];
+		i = child;
+	}
+	h->nodes[i] = node;
+}
+
+/*
+ *    Get the weight a dest is currently scheduled with, 0 if none.
+ */
+static u64 ip_vs_swrr_weight(const struct ip_vs_swrr_node *node)
+{
+	int weight = atomic_read(&node->dest->weight);
+	unsigned long ramp = slow_start * HZ, elapsed;
+
+	if (weight <= 0)
+		return 0;
+	if (!node->added || !ramp)
+		return weight;
+
+	elapsed = jiffies - node->added;
+	if (elapsed >= ramp)
+		return weight;
+	return max_t(u64, div_u64((u64)weight * elapsed, ramp), 1);
+}
+
+static inline u64 ip_vs_swrr_stride(u64 weight)
+{
+	return div64_u64(SWRR_SCALE, weight);
+}
+
+static int ip_vs_swrr_find(struct ip_vs_swrr_heap *h, struct ip_vs_dest *dest)
+{
+	int i;
+
+	for (i = 0; i < h->n; i++)
+		if (h->nodes[i].dest == dest)
+			return i;
+	return -1;
+}
+
+/*
+ *    Make room for one more dest. Called with __ip_vs_mutex held, which
+ *    serializes all heap size changes, so h->n and h->size are stable.
+ */
+static int ip_vs_swrr_reserve(struct ip_vs_service *svc,
+			      struct ip_vs_swrr_heap *h)
+{
+	struct ip_vs_swrr_node *nodes, *old;
+	int size;
+
+	if (h->n < h->size)
+		return 0;
+
+	size = max(h->size * 2, SWRR_MIN_SIZE);
+	nodes = kvmalloc_array(size, sizeof(*nodes), GFP_KERNEL);
+	if (!nodes)
+		return -ENOMEM;
+
+	spin_lock_bh(&svc->sched_lock);
+	memcpy(nodes, h->nodes, h->n * sizeof(*nodes));
+	old = h->nodes;
+	h->nodes = nodes;
+	h->size = size;
+	spin_unlock_bh(&svc->sched_lock);
+
+	kvfree(old);
+	return 0;
+}
+
+/*
+ *    Insert a dest half a stride after the current virtual time.
+ *    Called with sched_lock held and room reserved.
+ */
+static void ip_vs_swrr_insert(struct ip_vs_swrr_heap *h,
+			      struct ip_vs_dest *dest, bool ramp)
+{
+	struct ip_vs_swrr_node *node = &h->nodes[h->n];
+
+	node->dest = dest;
+	node->added = ramp ? (jiffies | 1) : 0;
+	node->seq = h->seq++;
+	node->weight = ip_vs_swrr_weight(node) ? : 1;
+	node->deadline = h->vtime + ip_vs_swrr_stride(node->weight) / 2;
+	ip_vs_swrr_sift_up(h, h->n++);
+}
+
+/*
+ *    Scale what is left of the stride of the node at index i to the
+ *    current weight of its dest. Called with sched_lock held.
+ */
+static void ip_vs_swrr_rekey(struct ip_vs_swrr_heap *h, int i)
+{
+	struct ip_vs_swrr_node *node = &h->nodes[i];
+	u64 weight = ip_vs_swrr_weight(node) ? : 1;
+	u64 left;
+
+	if (weight == node->weight)
+		return;
+
+	/* Both are at most 2^32 and INT_MAX, the product fits */
+	left = node->deadline > h->vtime ? node->deadline - h->vtime : 0;
+	node->deadline = h->vtime + div64_u64(left * node->weight, weight);
+	node->weight = weight;
+	ip_vs_swrr_sift_down(h, i);
+	ip_vs_swrr_sift_up(h, i);
+}
+
+/*
+ *    Remove the node at index i. Called with sched_lock held.
+ */
+static void ip_vs_swrr_remove(struct ip_vs_swrr_heap *h, int i)
+{
+	if (--h->n == i)
+		return;
+	h->nodes[i] = h->nodes[h->n];
+	ip_vs_swrr_sift_down(h, i);
+	ip_vs_swrr_sift_up(h, i);
+}
+
+static void ip_vs_swrr_rebase(struct ip_vs_swrr_heap *h)
+{
+	int i;
+
+	for (i = 0; i < h->n; i++)
+		h->nodes[i].deadline -= h->vtime;
+	h->vtime = 0;
+}
+
+
+static int ip_vs_swrr_init_svc(struct ip_vs_service *svc)
+{
+	struct ip_vs_swrr_heap *h;
+	struct ip_vs_dest *dest;
+
+	h = kzalloc(sizeof(struct ip_vs_swrr_heap), GFP_KERNEL);
+	if (h == NULL)
+		return -ENOMEM;
+
+	h->size = max(svc->num_dests, SWRR_MIN_SIZE);
+	h->nodes = kvmalloc_array(h->size, sizeof(*h->nodes), GFP_KERNEL);
+	if (h->nodes == NULL) {
+		kfree(h);
+		return -ENOMEM;
+	}
+
+	/* Dests that already serve the service do not ramp up again */
+	list_for_each_entry(dest, &svc->destinations, n_list) {
+		if (atomic_read(&dest->weight) > 0 && h->n < h->size)
+			ip_vs_swrr_insert(h, dest, false);
+	}
+	svc->sched_data = h;
+
+	return 0;
+}
+
+
+static void ip_vs_swrr_free_rcu(struct rcu_head *head)
+{
+	struct ip_vs_swrr_heap *h;
+
+	h = container_of(head, struct ip_vs_swrr_heap, rcu_head);
+	kvfree(h->nodes);
+	kfree(h);
+}
+
+static void ip_vs_swrr_done_svc(struct ip_vs_service *svc)
+{
+	struct ip_vs_swrr_heap *h = svc->sched_data;
+
+	/*
+	 *    Release the heap after readers of svc->scheduler are done
+	 */
+	call_rcu(&h->rcu_head, ip_vs_swrr_free_rcu);
+}
+
+
+static int ip_vs_swrr_add_dest(struct ip_vs_service *svc,
+			       struct ip_vs_dest *dest)
+{
+	struct ip_vs_swrr_heap *h = svc->sched_data;
+	int ret;
+
+	if (atomic_read(&dest->weight) <= 0)
+		return 0;
+
+	ret = ip_vs_swrr_reserve(svc, h);
+	if (ret)
+		return ret;
+
+	spin_lock_bh(&svc->sched_lock);
+	if (ip_vs_swrr_find(h, dest) < 0)
+		ip_vs_swrr_insert(h, dest, true);
+	spin_unlock_bh(&svc->sched_lock);
+	return 0;
+}
+
+
+static int ip_vs_swrr_del_dest(struct ip_vs_service *svc,
+			       struct ip_vs_dest *dest)
+{
+	struct ip_vs_swrr_heap *h = svc->sched_data;
+	int i;
+
+	spin_lock_bh(&svc->sched_lock);
+	i = ip_vs_swrr_find(h, dest);
+	if (i >= 0)
+		ip_vs_swrr_remove(h, i);
+	spin_unlock_bh(&svc->sched_lock);
+	return 0;
+}
+
+
+static int ip_vs_swrr_upd_dest(struct ip_vs_service *svc,
+			       struct ip_vs_dest *dest)
+{
+	struct ip_vs_swrr_heap *h = svc->sched_data;
+	int i;
+
+	/* A dest going to weight 0 is quiesced and leaves the heap, a dest
+	 * coming back from weight 0 is treated like a new one. Other weight
+	 * changes rescale the rest of the current stride of the dest.
+	 */
+	if (atomic_read(&dest->weight) <= 0)
+		return ip_vs_swrr_del_dest(svc, dest);
+
+	spin_lock_bh(&svc->sched_lock);
+	i = ip_vs_swrr_find(h, dest);
+	if (i >= 0)
+		ip_vs_swrr_rekey(h, i);
+	spin_unlock_bh(&svc->sched_lock);
+	if (i >= 0)
+		return 0;
+
+	return ip_vs_swrr_add_dest(svc, dest);
+}
+
+
+/*
+ *    Smooth Weighted Round-Robin Scheduling
+ */
+static struct ip_vs_dest *
+ip_vs_swrr_schedule(struct ip_vs_service *svc, const struct sk_buff *skb,
+		    struct ip_vs_iphdr *iph)
+{
+	struct ip_vs_swrr_heap *h = svc->sched_data;
+	struct ip_vs_swrr_node *node;
+	struct ip_vs_dest *dest = NULL;
+	u64 weight;
+	int tries;
+
+	IP_VS_DBG(6, "%s(): Scheduling...\n", __func__);
+
+	spin_lock_bh(&svc->sched_lock);
+	if (!h->n)
+		goto err_noavail;
+
+	for (tries = 0; tries < h->n; tries++) {
+		node = &h->nodes[0];
+		weight = ip_vs_swrr_weight(node);
+		h->vtime = node->deadline;
+		/* A dest whose weight dropped to 0 waits for upd_dest
+		 * to remove it, push it back by the largest stride.
+		 */
+		node->weight = weight ? : 1;
+		node->deadline += ip_vs_swrr_stride(node->weight);
+		dest = node->dest;
+		ip_vs_swrr_sift_down(h, 0);
+		if (weight && !(dest->flags & IP_VS_DEST_F_OVERLOAD))
+			goto found;
+	}
+	goto err_over;
+
+found:
+	if (unlikely(h->vtime >= SWRR_REBASE))
+		ip_vs_swrr_rebase(h);
+
+	IP_VS_DBG_BUF(6, "SWRR: server %s:%u "
+		      "activeconns %d refcnt %d weight %d\n",
+		      IP_VS_DBG_ADDR(dest->af, &dest->addr), ntohs(dest->port),
+		      atomic_read(&dest->activeconns),
+		      refcount_read(&dest->refcnt),
+		      atomic_read(&dest->weight));
+
+  out:
+	spin_unlock_bh(&svc->sched_lock);
+	return dest;
+
+err_noavail:
+	dest = NULL;
+	ip_vs_scheduler_err(svc, "no destination available");
+	goto out;
+
+err_over:
+	dest = NULL;
+	ip_vs_scheduler_err(svc, "no destination available: "
+			    "all destinations are overloaded");
+	goto out;
+}
+
+
+static struct ip_vs_scheduler ip_vs_swrr_scheduler = {
+	.name =			"swrr",
+	.refcnt =		ATOMIC_INIT(0),
+	.module =		THIS_MODULE,
+	.n_list =		LIST_HEAD_INIT(ip_vs_swrr_scheduler.n_list),
+	.init_service =		ip_vs_swrr_init_svc,
+	.done_service =		ip_vs_swrr_done_svc,
+	.add_dest =		ip_vs_swrr_add_dest,
+	.del_dest =		ip_vs_swrr_del_dest,
+	.upd_dest =		ip_vs_swrr_upd_dest,
+	.schedule =		ip_vs_swrr_schedule,
+};
+
+static int __init ip_vs_swrr_init(void)
+{
+	return register_ip_vs_scheduler(&ip_vs_swrr_scheduler);
+}
+
+static void __exit ip_vs_swrr_cleanup(void)
+{
+	unregister_ip_vs_scheduler(&ip_vs_swrr_scheduler);
+	rcu_barrier();
+}
+
+module_init(ip_vs_swrr_init);
+module_exit(ip_vs_swrr_cleanup);
+MODULE_LICENSE("GPL");
@@ -26,6 +26,8 @@
 #include <linux/slab.h>
 #include <linux/net.h>
 #include <linux/gcd.h>
+#include <linux/percpu.h>
+#include <linux/mm.h>
 
 #include <net/ip_vs.h>
 
@@ -60,14 +62,43 @@
  */
 
 /*
- * current destination pointer for weighted round-robin scheduling
+ * Scheduling runs without svc->sched_lock: every CPU runs its own
+ * sequence of passes over an RCU-published array of the destinations,
+ * which is rebuilt whenever a destination is added, removed or updated.
+ * If that rebuild can't allocate, the array is marked stale and the next
+ * schedule call retries it.
+ * Each CPU gives every dest its weighted share, so the proportions also
+ * hold globally. CPUs start at different dests to spread the first
+ * connections after a change.
  */
-struct ip_vs_wrr_mark {
-	struct ip_vs_dest *cl;	/* current dest or head */
-	int cw;			/* current weight */
+
+/*
+ * snapshot of the service destinations
+ */
+struct ip_vs_wrr_dests {
 	int mw;			/* maximum weight */
 	int di;			/* decreasing interval */
+	unsigned int gen;	/* bumped on every rebuild */
+	bool stale;		/* dests changed since it was built */
+	int num;		/* number of dests */
 	struct rcu_head		rcu_head;
+	struct ip_vs_dest *dest[];
+};
+
+/*
+ * per-CPU current destination for weighted round-robin scheduling
+ */
+struct ip_vs_wrr_mark {
+	int cl;			/* current dest index, -1 for head */
+	int cw;			/* current weight */
+	unsigned int gen;	/* snapshot the mark refers to */
+};
+
+struct ip_vs_wrr_sched {
+	struct ip_vs_wrr_dests __rcu	*dests;
+	spinlock_t			lock;	/* serializes rebuilds */
+	struct ip_vs_wrr_mark __percpu	*mark;
+	struct rcu_head			rcu_head;
 };
 
 
@@ -77,7 +108,7 @@ static int ip_vs_wrr_gcd_weight(struct ip_vs_service *svc)
 	int weight;
 	int g = 0;
 
-	list_for_each_entry(dest, &svc->destinations, n_list) {
+	list_for_each_entry_rcu(dest, &svc->destinations, n_list) {
 		weight = atomic_read(&dest->weight);
 		if (weight > 0) {
 			if (g > 0)
@@ -98,7 +129,7 @@ static int ip_vs_wrr_max_weight(struct ip_vs_service *svc)
 	struct ip_vs_dest *dest;
 	int new_weight, weight = 0;
 
-	list_for_each_entry(dest, &svc->destinations, n_list) {
+	list_for_each_entry_rcu(dest, &svc->destinations, n_list) {
 		new_weight = atomic_read(&dest->weight);
 		if (new_weight > weight)
 			weight = new_weight;
@@ -108,53 +139,202 @@ static int ip_vs_wrr_max_weight(struct ip_vs_service *svc)
 }
 
 
+/*
+ *    Build a new snapshot of the service destinations.
+ *    Called with __ip_vs_mutex held, or under RCU to retry a stale one.
+ */
+static struct ip_vs_wrr_dests *
+ip_vs_wrr_build(struct ip_vs_service *svc, unsigned int gen, gfp_t gfp)
+{
+	struct ip_vs_wrr_dests *dests;
+	struct ip_vs_dest *dest;
+	int num = READ_ONCE(svc->num_dests);
+	int n = 0;
+
+	dests = kvmalloc(struct_size(dests, dest, num), gfp);
+	if (dests == NULL)
+		return NULL;
+
+	list_for_each_entry_rcu(dest, &svc->destinations, n_list) {
+		if (n == num)
+			break;
+		dests->dest[n++] = dest;
+	}
+	dests->num = n;
+	dests->di = ip_vs_wrr_gcd_weight(svc);
+	dests->mw = ip_vs_wrr_max_weight(svc) - (dests->di - 1);
+	dests->gen = gen;
+	dests->stale = false;
+
+	return dests;
+}
+
+
 static int ip_vs_wrr_init_svc(struct ip_vs_service *svc)
 {
-	struct ip_vs_wrr_mark *mark;
+	struct ip_vs_wrr_sched *sched;
+	struct ip_vs_wrr_dests *dests;
+	int cpu;
 
 	/*
-	 *    Allocate the mark variable for WRR scheduling
+	 *    Allocate the snapshot and the per-CPU marks for WRR scheduling
 	 */
-	mark = kmalloc(sizeof(struct ip_vs_wrr_mark), GFP_KERNEL);
-	if (mark == NULL)
+	sched = kmalloc(sizeof(struct ip_vs_wrr_sched), GFP_KERNEL);
+	if (sched == NULL)
 		return -ENOMEM;
 
-	mark->cl = list_entry(&svc->destinations, struct ip_vs_dest, n_list);
-	mark->di = ip_vs_wrr_gcd_weight(svc);
-	mark->mw = ip_vs_wrr_max_weight(svc) - (mark->di - 1);
-	mark->cw = mark->mw;
-	svc->sched_data = mark;
+	sched->mark = alloc_percpu(struct ip_vs_wrr_mark);
+	if (sched->mark == NULL)
+		goto err_sched;
+
+	dests = ip_vs_wrr_build(svc, 1, GFP_KERNEL);
+	if (dests == NULL)
+		goto err_mark;
+
+	/* A gen of 0 makes every CPU pick up the snapshot on first use */
+	for_each_possible_cpu(cpu)
+		per_cpu_ptr(sched->mark, cpu)->gen = 0;
+	spin_lock_init(&sched->lock);
+	RCU_INIT_POINTER(sched->dests, dests);
+	svc->sched_data = sched;
 
 	return 0;
+
+err_mark:
+	free_percpu(sched->mark);
+err_sched:
+	kfree(sched);
+	return -ENOMEM;
 }
 
 
+static void ip_vs_wrr_free_rcu(struct rcu_head *head)
+{
+	struct ip_vs_wrr_sched *sched;
+
+	sched = container_of(head, struct ip_vs_wrr_sched, rcu_head);
+	kvfree(rcu_dereference_raw(sched->dests));
+	free_percpu(sched->mark);
+	kfree(sched);
+}
+
 static void ip_vs_wrr_done_svc(struct ip_vs_service *svc)
 {
-	struct ip_vs_wrr_mark *mark = svc->sched_data;
+	struct ip_vs_wrr_sched *sched = svc->sched_data;
 
 	/*
-	 *    Release the mark variable
+	 *    Release the snapshot and the marks when no CPU can use them
 	 */
-	kfree_rcu(mark, rcu_head);
+	call_rcu(&sched->rcu_head, ip_vs_wrr_free_rcu);
+}
+
+
+static void ip_vs_wrr_dests_free_rcu(struct rcu_head *head)
+{
+	kvfree(container_of(head, struct ip_vs_wrr_dests, rcu_head));
+}
+
+/*
+ *    Replace the snapshot, called with sched->lock held
+ */
+static void ip_vs_wrr_publish(struct ip_vs_wrr_sched *sched,
+			      struct ip_vs_wrr_dests *old,
+			      struct ip_vs_wrr_dests *dests)
+{
+	dests->gen = old->gen + 1;
+	rcu_assign_pointer(sched->dests, dests);
+	call_rcu(&old->rcu_head, ip_vs_wrr_dests_free_rcu);
+}
+
+
+/*
+ *    Rebuild the snapshot after a dest change. On allocation failure the
+ *    current snapshot is marked stale, and a removed dest is dropped from
+ *    it in place, since it must not outlive the dest.
+ */
+static int ip_vs_wrr_rebuild(struct ip_vs_service *svc,
+			     struct ip_vs_dest *removed)
+{
+	struct ip_vs_wrr_sched *sched = svc->sched_data;
+	struct ip_vs_wrr_dests *old, *dests;
+	int i;
+
+	/* Destination changes are serialized by __ip_vs_mutex */
+	dests = ip_vs_wrr_build(svc, 0, GFP_KERNEL);
+
+	spin_lock_bh(&sched->lock);
+	old = rcu_dereference_protected(sched->dests,
+					lockdep_is_held(&sched->lock));
+	if (dests) {
+		ip_vs_wrr_publish(sched, old, dests);
+	} else {
+		for (i = 0; removed && i < old->num; i++) {
+			if (old->dest[i] == removed)
+				WRITE_ONCE(old->dest[i], NULL);
+		}
+		WRITE_ONCE(old->stale, true);
+	}
+	spin_unlock_bh(&sched->lock);
+
+	return dests ? 0 : -ENOMEM;
+}
+
+
+/*
+ *    Retry the rebuild of a stale snapshot, called under RCU
+ */
+static struct ip_vs_wrr_dests *
+ip_vs_wrr_refresh(struct ip_vs_service *svc, struct ip_vs_wrr_dests *dests)
+{
+	struct ip_vs_wrr_sched *sched = svc->sched_data;
+	struct ip_vs_wrr_dests *old, *new;
+
+	/* Another CPU or a dest change is already on it */
+	if (!spin_trylock_bh(&sched->lock))
+		return dests;
+
+	old = rcu_dereference_protected(sched->dests,
+					lockdep_is_held(&sched->lock));
+	if (old->stale) {
+		new = ip_vs_wrr_build(svc, 0, GFP_ATOMIC);
+		if (new) {
+			ip_vs_wrr_publish(sched, old, new);
+			old = new;
+		}
+	}
+	spin_unlock_bh(&sched->lock);
+
+	return old;
 }
 
 
 static int ip_vs_wrr_dest_changed(struct ip_vs_service *svc,
 				  struct ip_vs_dest *dest)
 {
-	struct ip_vs_wrr_mark *mark = svc->sched_data;
-
-	spin_lock_bh(&svc->sched_lock);
-	mark->cl = list_entry(&svc->destinations, struct ip_vs_dest, n_list);
-	mark->di = ip_vs_wrr_gcd_weight(svc);
-	mark->mw = ip_vs_wrr_max_weight(svc) - (mark->di - 1);
-	if (mark->cw > mark->mw || !mark->cw)
-		mark->cw = mark->mw;
-	else if (mark->di > 1)
-		mark->cw = (mark->cw / mark->di) * mark->di + 1;
-	spin_unlock_bh(&svc->sched_lock);
-	return 0;
+	return ip_vs_wrr_rebuild(svc, NULL);
+}
+
+
+static int ip_vs_wrr_del_dest(struct ip_vs_service *svc,
+			      struct ip_vs_dest *dest)
+{
+	return ip_vs_wrr_rebuild(svc, dest);
+}
+
+
+/*
+ *    Move a CPU's mark to a new snapshot, keeping its current weight
+ *    when it is still valid.
+ */
+static void ip_vs_wrr_mark_reset(struct ip_vs_wrr_mark *mark,
+				 struct ip_vs_wrr_dests *dests)
+{
+	mark->cl = dests->num ? smp_processor_id() % dests->num - 1 : -1;
+	if (mark->cw > dests->mw || !mark->cw || !mark->gen)
+		mark->cw = dests->mw;
+	else if (dests->di > 1)
+		mark->cw = (mark->cw / dests->di) * dests->di + 1;
+	mark->gen = dests->gen;
 }
 
 
@@ -165,46 +345,55 @@ static struct ip_vs_dest *
 ip_vs_wrr_schedule(struct ip_vs_service *svc, const struct sk_buff *skb,
 		   struct ip_vs_iphdr *iph)
 {
-	struct ip_vs_dest *dest, *last, *stop = NULL;
-	struct ip_vs_wrr_mark *mark = svc->sched_data;
+	struct ip_vs_wrr_sched *sched = svc->sched_data;
+	struct ip_vs_wrr_dests *dests;
+	struct ip_vs_wrr_mark *mark;
+	struct ip_vs_dest *dest = NULL;
 	bool last_pass = false, restarted = false;
+	int i, last, stop = -2;
 
 	IP_VS_DBG(6, "%s(): Scheduling...\n", __func__);
 
-	spin_lock_bh(&svc->sched_lock);
-	dest = mark->cl;
+	dests = rcu_dereference(sched->dests);
+	if (unlikely(READ_ONCE(dests->stale)))
+		dests = ip_vs_wrr_refresh(svc, dests);
+	/* The mark is also used from process context on local output */
+	local_bh_disable();
+	mark = this_cpu_ptr(sched->mark);
+	if (unlikely(mark->gen != dests->gen))
+		ip_vs_wrr_mark_reset(mark, dests);
+	i = mark->cl;
 	/* No available dests? */
-	if (mark->mw == 0)
+	if (dests->mw == 0)
 		goto err_noavail;
-	last = dest;
+	last = i;
 	/* Stop only after all dests were checked for weight >= 1 (last pass) */
 	while (1) {
-		list_for_each_entry_continue_rcu(dest,
-						 &svc->destinations,
-						 n_list) {
-			if (!(dest->flags & IP_VS_DEST_F_OVERLOAD) &&
+		while (++i < dests->num) {
+			/* NULL for a dest removed from a stale snapshot */
+			dest = READ_ONCE(dests->dest[i]);
+			if (dest && !(dest->flags & IP_VS_DEST_F_OVERLOAD) &&
 			    atomic_read(&dest->weight) >= mark->cw)
 				goto found;
-			if (dest == stop)
+			if (i == stop)
 				goto err_over;
 		}
-		mark->cw -= mark->di;
+		i = -1;
+		mark->cw -= dests->di;
 		if (mark->cw <= 0) {
-			mark->cw = mark->mw;
+			mark->cw = dests->mw;
 			/* Stop if we tried last pass from first dest:
 			 * 1. last_pass: we started checks when cw > di but
 			 *	then all dests were checked for w >= 1
 			 * 2. last was head: the first and only traversal
 			 *	was for weight >= 1, for all dests.
 			 */
-			if (last_pass ||
-			    &last->n_list == &svc->destinations)
+			if (last_pass || last == -1)
 				goto err_over;
 			restarted = true;
 		}
-		last_pass = mark->cw <= mark->di;
-		if (last_pass && restarted &&
-		    &last->n_list != &svc->destinations) {
+		last_pass = mark->cw <= dests->di;
+		if (last_pass && restarted && last != -1) {
 			/* First traversal was for w >= 1 but only
 			 * for dests after 'last', now do the same
 			 * for all dests up to 'last'.
@@ -220,20 +409,20 @@ found:
 		      atomic_read(&dest->activeconns),
 		      refcount_read(&dest->refcnt),
 		      atomic_read(&dest->weight));
-	mark->cl = dest;
+	mark->cl = i;
 
   out:
-	spin_unlock_bh(&svc->sched_lock);
+	local_bh_enable();
 	return dest;
 
 err_noavail:
-	mark->cl = dest;
+	mark->cl = i;
 	dest = NULL;
 	ip_vs_scheduler_err(svc, "no destination available");
 	goto out;
 
 err_over:
-	mark->cl = dest;
+	mark->cl = i;
 	dest = NULL;
 	ip_vs_scheduler_err(svc, "no destination available: "
 			    "all destinations are overloaded");
@@ -249,7 +438,7 @@ static struct ip_vs_scheduler ip_vs_wrr_scheduler = {
 	.init_service =		ip_vs_wrr_init_svc,
 	.done_service =		ip_vs_wrr_done_svc,
 	.add_dest =		ip_vs_wrr_dest_changed,
-	.del_dest =		ip_vs_wrr_dest_changed,
+	.del_dest =		ip_vs_wrr_del_dest,
 	.upd_dest =		ip_vs_wrr_dest_changed,
 	.schedule =		ip_vs_wrr_schedule,
 };
@@ -262,7 +451,7 @@ static int __init ip_vs_wrr_init(void)
 static void __exit ip_vs_wrr_cleanup(void)
 {
 	unregister_ip_vs_scheduler(&ip_vs_wrr_scheduler);
-	synchronize_rcu();
+	rcu_barrier();
 }
 
 module_init(ip_vs_wrr_init);
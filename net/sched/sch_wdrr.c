@@ -0,0 +1,421 @@
+/*
+ * net/sched/sch_wdrr.c	Weighted Deficit Round Robin by SCHED_WRR weight
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/init.h>
+#include <linux/skbuff.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/cgroup.h>
+#include <net/netlink.h>
+#include <net/sock.h>
+#include <net/inet_sock.h>
+#include <net/pkt_sched.h>
+
+/*	Weighted DRR.
+ *
+ * Shares a transmit queue between sockets in proportion to the SCHED_WRR
+ * weight of the task that last sent on them (sk->sk_wrr_weight), so that
+ * network share follows the same policy as CPU share.
+ *
+ * Packets are hashed into flows, either per socket (the packet hash) or per
+ * cgroup v2 of the socket. Each round, an active flow may send up to
+ * quantum * weight bytes, where weight is the one of the last packet queued
+ * on the flow; packets without a WRR sender get the default weight. When
+ * the limit is hit, the flow with the largest backlog per weight loses the
+ * packet at its head.
+ *
+ * There is no state shared between instances: under mq, every transmit
+ * queue gets its own instance, serialized only by its own qdisc lock.
+ */
+
+struct wdrr_flow {
+	struct sk_buff	  *head;
+	struct sk_buff	  *tail;
+	struct list_head  flowchain;
+	int		  deficit;
+	u32		  backlog;	/* bytes queued */
+	u32		  weight;
+};
+
+struct wdrr_sched_data {
+	struct wdrr_flow *flows;	/* Flows table [flows_cnt] */
+	u32		flows_cnt;	/* number of flows */
+	u32		quantum;	/* psched_mtu(qdisc_dev(sch)); */
+	u32		default_weight;
+	u32		key;		/* enum tc_wdrr_key */
+	u32		drop_overlimit;
+	u32		new_flow_count;
+	u64		nr_default_weight;
+
+	struct list_head active;	/* list of active flows */
+};
+
+static unsigned int wdrr_classify(const struct wdrr_sched_data *q,
+				  struct sk_buff *skb, u32 *weight)
+{
+	struct sock *sk = skb_to_full_sk(skb);
+	u32 hash;
+
+	*weight = 0;
+	if (sk && sk_fullsock(sk))
+		*weight = READ_ONCE(sk->sk_wrr_weight);
+	else
+		sk = NULL;
+
+#ifdef CONFIG_SOCK_CGROUP_DATA
+	if (q->key == TC_WDRR_KEY_CGROUP && sk)
+		hash = hash_ptr(sock_cgroup_ptr(&sk->sk_cgrp_data), 32);
+	else
+#endif
+		hash = skb_get_hash(skb);
+
+	return reciprocal_scale(hash, q->flows_cnt);
+}
+
+/* remove one skb from head of slot queue */
+static inline struct sk_buff *dequeue_head(struct wdrr_flow *flow)
+{
+	struct sk_buff *skb = flow->head;
+
+	flow->head = skb->next;
+	skb->next = NULL;
+	flow->backlog -= qdisc_pkt_len(skb);
+	return skb;
+}
+
+/* add skb to flow queue (tail add) */
+static inline void flow_queue_add(struct wdrr_flow *flow,
+				  struct sk_buff *skb)
+{
+	if (flow->head == NULL)
+		flow->head = skb;
+	else
+		flow->tail->next = skb;
+	flow->tail = skb;
+	skb->next = NULL;
+	flow->backlog += qdisc_pkt_len(skb);
+}
+
+/* Drop the head of the flow with the largest backlog for its weight */
+static unsigned int wdrr_drop(struct Qdisc *sch, struct sk_buff **to_free)
+{
+	struct wdrr_sched_data *q = qdisc_priv(sch);
+	struct wdrr_flow *flow, *fat = NULL;
+	struct sk_buff *skb;
+
+	/* Only active flows have a backlog */
+	list_for_each_entry(flow, &q->active, flowchain) {
+		if (!fat || (u64)flow->backlog * fat->weight >
+			    (u64)fat->backlog * flow->weight)
+			fat = flow;
+	}
+
+	skb = dequeue_head(fat);
+	if (!fat->head)
+		list_del_init(&fat->flowchain);
+	qdisc_qstats_backlog_dec(sch, skb);
+	sch->q.qlen--;
+	qdisc_qstats_drop(sch);
+	__qdisc_drop(skb, to_free);
+
+	return fat - q->flows;
+}
+
+static int wdrr_enqueue(struct sk_buff *skb, struct Qdisc *sch,
+			struct sk_buff **to_free)
+{
+	struct wdrr_sched_data *q = qdisc_priv(sch);
+	unsigned int idx, ret, pkt_len, prev_backlog;
+	struct wdrr_flow *flow;
+	u32 weight;
+
+	idx = wdrr_classify(q, skb, &weight);
+	if (!weight) {
+		weight = q->default_weight;
+		q->nr_default_weight++;
+	}
+
+	flow = &q->flows[idx];
+	flow->weight = weight;
+	flow_queue_add(flow, skb);
+	qdisc_qstats_backlog_inc(sch, skb);
+
+	if (list_empty(&flow->flowchain)) {
+		list_add_tail(&flow->flowchain, &q->active);
+		q->new_flow_count++;
+		flow->deficit = q->quantum * weight;
+	}
+	if (++sch->q.qlen <= sch->limit)
+		return NET_XMIT_SUCCESS;
+
+	prev_backlog = sch->qstats.backlog;
+
+	/* save this packet length as it might be dropped by wdrr_drop() */
+	pkt_len = qdisc_pkt_len(skb);
+	q->drop_overlimit++;
+	ret = wdrr_drop(sch, to_free);
+	prev_backlog -= sch->qstats.backlog;
+
+	/* If we dropped a packet of this flow, return NET_XMIT_CN,
+	 * but in this case, our parents wont increase their backlogs.
+	 */
+	if (ret == idx) {
+		qdisc_tree_reduce_backlog(sch, 0, prev_backlog - pkt_len);
+		return NET_XMIT_CN;
+	}
+	qdisc_tree_reduce_backlog(sch, 1, prev_backlog);
+	return NET_XMIT_SUCCESS;
+}
+
+static struct sk_buff *wdrr_dequeue(struct Qdisc *sch)
+{
+	struct wdrr_sched_data *q = qdisc_priv(sch);
+	struct wdrr_flow *flow;
+	struct sk_buff *skb;
+
+	if (list_empty(&q->active))
+		return NULL;
+
+	for (;;) {
+		flow = list_first_entry(&q->active, struct wdrr_flow, flowchain);
+
+		if (flow->deficit <= 0) {
+			flow->deficit += q->quantum * flow->weight;
+			list_move_tail(&flow->flowchain, &q->active);
+			continue;
+		}
+
+		skb = dequeue_head(flow);
+		flow->deficit -= qdisc_pkt_len(skb);
+		if (!flow->head)
+			list_del_init(&flow->flowchain);
+		break;
+	}
+
+	qdisc_qstats_backlog_dec(sch, skb);
+	sch->q.qlen--;
+	qdisc_bstats_update(sch, skb);
+	return skb;
+}
+
+static void wdrr_reset(struct Qdisc *sch)
+{
+	struct wdrr_sched_data *q = qdisc_priv(sch);
+	int i;
+
+	INIT_LIST_HEAD(&q->active);
+	for (i = 0; i < q->flows_cnt; i++) {
+		struct wdrr_flow *flow = q->flows + i;
+
+		rtnl_kfree_skbs(flow->head, flow->tail);
+		flow->head = NULL;
+		flow->backlog = 0;
+		INIT_LIST_HEAD(&flow->flowchain);
+	}
+	sch->q.qlen = 0;
+	sch->qstats.backlog = 0;
+}
+
+static const struct nla_policy wdrr_policy[TCA_WDRR_MAX + 1] = {
+	[TCA_WDRR_LIMIT]		= { .type = NLA_U32 },
+	[TCA_WDRR_FLOWS]		= { .type = NLA_U32 },
+	[TCA_WDRR_QUANTUM]		= { .type = NLA_U32 },
+	[TCA_WDRR_DEFAULT_WEIGHT]	= { .type = NLA_U32 },
+	[TCA_WDRR_KEY]			= { .type = NLA_U32 },
+};
+
+static int wdrr_change(struct Qdisc *sch, struct nlattr *opt,
+		       struct netlink_ext_ack *extack)
+{
+	struct wdrr_sched_data *q = qdisc_priv(sch);
+	struct nlattr *tb[TCA_WDRR_MAX + 1];
+	unsigned int dropped = 0, dropped_len = 0;
+	int err;
+
+	if (!opt)
+		return -EINVAL;
+
+	err = nla_parse_nested(tb, TCA_WDRR_MAX, opt, wdrr_policy, extack);
+	if (err < 0)
+		return err;
+	if (tb[TCA_WDRR_FLOWS]) {
+		if (q->flows) {
+			NL_SET_ERR_MSG(extack, "The number of flows cannot be changed");
+			return -EINVAL;
+		}
+		q->flows_cnt = nla_get_u32(tb[TCA_WDRR_FLOWS]);
+		if (!q->flows_cnt ||
+		    q->flows_cnt > 65536)
+			return -EINVAL;
+	}
+	if (tb[TCA_WDRR_DEFAULT_WEIGHT]) {
+		u32 weight = nla_get_u32(tb[TCA_WDRR_DEFAULT_WEIGHT]);
+
+		if (weight < WRR_MIN_WEIGHT || weight > WRR_MAX_WEIGHT) {
+			NL_SET_ERR_MSG(extack, "Default weight is out of the WRR weight range");
+			return -EINVAL;
+		}
+	}
+	if (tb[TCA_WDRR_KEY]) {
+		u32 key = nla_get_u32(tb[TCA_WDRR_KEY]);
+
+		if (key >= __TC_WDRR_KEY_MAX)
+			return -EINVAL;
+		if (!IS_ENABLED(CONFIG_SOCK_CGROUP_DATA) && key == TC_WDRR_KEY_CGROUP) {
+			NL_SET_ERR_MSG(extack, "Socket cgroup data is not available");
+			return -EOPNOTSUPP;
+		}
+	}
+
+	sch_tree_lock(sch);
+
+	if (tb[TCA_WDRR_LIMIT])
+		sch->limit = nla_get_u32(tb[TCA_WDRR_LIMIT]);
+
+	if (tb[TCA_WDRR_QUANTUM])
+		q->quantum = max(256U, nla_get_u32(tb[TCA_WDRR_QUANTUM]));
+
+	if (tb[TCA_WDRR_DEFAULT_WEIGHT])
+		q->default_weight = nla_get_u32(tb[TCA_WDRR_DEFAULT_WEIGHT]);
+
+	if (tb[TCA_WDRR_KEY])
+		q->key = nla_get_u32(tb[TCA_WDRR_KEY]);
+
+	while (sch->q.qlen > sch->limit) {
+		struct sk_buff *skb = wdrr_dequeue(sch);
+
+		dropped_len += qdisc_pkt_len(skb);
+		rtnl_kfree_skbs(skb, skb);
+		dropped++;
+	}
+	qdisc_tree_reduce_backlog(sch, dropped, dropped_len);
+
+	sch_tree_unlock(sch);
+	return 0;
+}
+
+static void wdrr_destroy(struct Qdisc *sch)
+{
+	struct wdrr_sched_data *q = qdisc_priv(sch);
+
+	kvfree(q->flows);
+}
+
+static int wdrr_init(struct Qdisc *sch, struct nlattr *opt,
+		     struct netlink_ext_ack *extack)
+{
+	struct wdrr_sched_data *q = qdisc_priv(sch);
+	int i;
+	int err;
+
+	sch->limit = 10*1024;
+	q->flows_cnt = 1024;
+	q->quantum = psched_mtu(qdisc_dev(sch));
+	q->default_weight = WRR_DEFAULT_WEIGHT;
+	q->key = TC_WDRR_KEY_SOCKET;
+	INIT_LIST_HEAD(&q->active);
+
+	if (opt) {
+		err = wdrr_change(sch, opt, extack);
+		if (err)
+			goto init_failure;
+	}
+
+	q->flows = kvcalloc(q->flows_cnt, sizeof(struct wdrr_flow), GFP_KERNEL);
+	if (!q->flows) {
+		err = -ENOMEM;
+		goto init_failure;
+	}
+	for (i = 0; i < q->flows_cnt; i++)
+		INIT_LIST_HEAD(&q->flows[i].flowchain);
+
+	if (sch->limit >= 1)
+		sch->flags |= TCQ_F_CAN_BYPASS;
+	else
+		sch->flags &= ~TCQ_F_CAN_BYPASS;
+	return 0;
+
+init_failure:
+	q->flows_cnt = 0;
+	return err;
+}
+
+static int wdrr_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct wdrr_sched_data *q = qdisc_priv(sch);
+	struct nlattr *opts;
+
+	opts = nla_nest_start(skb, TCA_OPTIONS);
+	if (opts == NULL)
+		goto nla_put_failure;
+
+	if (nla_put_u32(skb, TCA_WDRR_LIMIT, sch->limit) ||
+	    nla_put_u32(skb, TCA_WDRR_FLOWS, q->flows_cnt) ||
+	    nla_put_u32(skb, TCA_WDRR_QUANTUM, q->quantum) ||
+	    nla_put_u32(skb, TCA_WDRR_DEFAULT_WEIGHT, q->default_weight) ||
+	    nla_put_u32(skb, TCA_WDRR_KEY, q->key))
+		goto nla_put_failure;
+
+	return nla_nest_end(skb, opts);
+
+nla_put_failure:
+	return -1;
+}
+
+static int wdrr_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
+{
+	struct wdrr_sched_data *q = qdisc_priv(sch);
+	struct tc_wdrr_xstats st = { 0 };
+	struct list_head *pos;
+
+	sch_tree_lock(sch);
+	st.drop_overlimit = q->drop_overlimit;
+	st.new_flow_count = q->new_flow_count;
+	st.default_weight = q->nr_default_weight;
+	list_for_each(pos, &q->active)
+		st.flows_len++;
+	sch_tree_unlock(sch);
+
+	return gnet_stats_copy_app(d, &st, sizeof(st));
+}
+
+static struct Qdisc_ops wdrr_qdisc_ops __read_mostly = {
+	.id		=	"wdrr",
+	.priv_size	=	sizeof(struct wdrr_sched_data),
+	.enqueue	=	wdrr_enqueue,
+	.dequeue	=	wdrr_dequeue,
+	.peek		=	qdisc_peek_dequeued,
+	.init		=	wdrr_init,
+	.reset		=	wdrr_reset,
+	.destroy	=	wdrr_destroy,
+	.change		=	wdrr_change,
+	.dump		=	wdrr_dump,
+	.dump_stats	=	wdrr_dump_stats,
+	.owner		=	THIS_MODULE,
+};
+
+static int __init wdrr_module_init(void)
+{
+	return register_qdisc(&wdrr_qdisc_ops);
+}
+
+static void __exit wdrr_module_exit(void)
+{
+	unregister_qdisc(&wdrr_qdisc_ops);
+}
+
+module_init(wdrr_module_init)
+module_exit(wdrr_module_exit)
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Weighted DRR of SCHED_WRR senders");
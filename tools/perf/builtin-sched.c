@@ -17,6 +17,7 @@
 #include "util/stat.h"
 #include "util/callchain.h"
 #include "util/time-utils.h"
+#include "util/parse-events.h"
 
 #include <subcmd/parse-options.h>
 #include "util/trace-event.h"
@@ -234,6 +235,13 @@ struct perf_sched {
 	const char	*time_str;
 	struct perf_time_interval ptime;
 	struct perf_time_interval hist_time;
+
+	/* options for wrr command */
+	struct wrr_cpu_runtime *wrr_cpus;
+	u64		wrr_interval;
+	u64		wrr_first_time;
+	u64		*wrr_balance_slots;
+	u64		wrr_nr_slots;
 };
 
 /* per thread run time data */
@@ -3052,6 +3060,454 @@ out:
 }
 
 
+/*
+ * WRR analysis: achieved CPU share vs. configured weight, round length
+ * per CPU and load balancer activity.
+ */
+
+/* prev_state of a task preempted while runnable, see __trace_sched_switch_state() */
+#define TASK_REPORT_MAX		0x100
+#define WRR_DEFAULT_WEIGHT	10
+
+/* per thread WRR data */
+struct wrr_runtime {
+	char		comm[COMM_LEN];
+	unsigned int	weight;
+	u64		runtime;
+	u64		last_in;	 /* time of the last sched-in, 0 when off cpu */
+	u64		last_expire;	 /* time of the last slice expiry, 0 after blocking */
+	int		last_expire_cpu;
+	bool		expired;	 /* slice expired with other tasks queued */
+	u64		nr_expire;	 /* sched-out on time slice expiry */
+	u64		nr_preempt;	 /* sched-out while runnable, for any other reason */
+	u64		nr_voluntary;	 /* sched-out blocked */
+	u64		nr_migrations;
+	u64		nr_balance;	 /* moved by the WRR load balancer */
+};
+
+/* per cpu WRR data */
+struct wrr_cpu_runtime {
+	struct stats	round;		/* time between two slice expiries of a task */
+	u64		busy;
+	u64		nr_expire;
+	u64		nr_balance_in;
+	u64		nr_balance_out;
+};
+
+struct wrr_totals {
+	u64		runtime;
+	u64		weight;
+	u64		nr_tasks;
+};
+
+static struct wrr_runtime *wrr_get_runtime(struct machine *machine, u32 pid,
+					   const char *comm)
+{
+	struct thread *thread;
+	struct wrr_runtime *r;
+
+	thread = machine__findnew_thread(machine, -1, pid);
+	if (thread == NULL) {
+		pr_err("Failed to get thread for pid %d\n", pid);
+		return NULL;
+	}
+
+	r = thread__priv(thread);
+	if (r == NULL) {
+		r = zalloc(sizeof(*r));
+		if (r == NULL) {
+			thread__put(thread);
+			return NULL;
+		}
+		/* tasks are only seen with their weight once they expire a slice */
+		r->weight = WRR_DEFAULT_WEIGHT;
+		thread__set_priv(thread, r);
+	}
+	if (comm)
+		strlcpy(r->comm, comm, sizeof(r->comm));
+
+	thread__put(thread);
+	return r;
+}
+
+static bool wrr_valid_cpu(struct perf_sched *sched, int cpu)
+{
+	if (cpu >= 0 && cpu < sched->max_cpu)
+		return true;
+
+	pr_debug("WRR event for out of range CPU %d\n", cpu);
+	return false;
+}
+
+static int wrr_sched_switch_event(struct perf_tool *tool,
+				  struct perf_evsel *evsel,
+				  struct perf_sample *sample,
+				  struct machine *machine)
+{
+	struct perf_sched *sched = container_of(tool, struct perf_sched, tool);
+	const char *prev_comm = perf_evsel__strval(evsel, sample, "prev_comm"),
+		   *next_comm = perf_evsel__strval(evsel, sample, "next_comm");
+	const u32 prev_pid = perf_evsel__intval(evsel, sample, "prev_pid"),
+		  next_pid = perf_evsel__intval(evsel, sample, "next_pid");
+	const u64 prev_state = perf_evsel__intval(evsel, sample, "prev_state");
+	struct wrr_runtime *r;
+
+	if (!wrr_valid_cpu(sched, sample->cpu))
+		return 0;
+
+	if (prev_pid) {
+		r = wrr_get_runtime(machine, prev_pid, prev_comm);
+		if (r == NULL)
+			return -1;
+
+		if (r->last_in && sample->time > r->last_in) {
+			r->runtime += sample->time - r->last_in;
+			sched->wrr_cpus[sample->cpu].busy += sample->time - r->last_in;
+		}
+		r->last_in = 0;
+
+		if (prev_state & (TASK_REPORT_MAX - 1)) {
+			r->nr_voluntary++;
+			/* a round is only measured between back-to-back expiries */
+			r->last_expire = 0;
+		} else if (r->expired) {
+			r->nr_expire++;
+		} else {
+			r->nr_preempt++;
+		}
+		r->expired = false;
+	}
+
+	if (next_pid) {
+		r = wrr_get_runtime(machine, next_pid, next_comm);
+		if (r == NULL)
+			return -1;
+
+		r->last_in = sample->time;
+		r->expired = false;
+	}
+
+	return 0;
+}
+
+static int wrr_slice_expire_event(struct perf_tool *tool,
+				  struct perf_evsel *evsel,
+				  struct perf_sample *sample,
+				  struct machine *machine)
+{
+	struct perf_sched *sched = container_of(tool, struct perf_sched, tool);
+	const char *comm = perf_evsel__strval(evsel, sample, "comm");
+	const u32 pid = perf_evsel__intval(evsel, sample, "pid");
+	const u32 weight = perf_evsel__intval(evsel, sample, "weight");
+	const u32 nr_running = perf_evsel__intval(evsel, sample, "nr_running");
+	struct wrr_cpu_runtime *c;
+	struct wrr_runtime *r;
+
+	if (!wrr_valid_cpu(sched, sample->cpu))
+		return 0;
+
+	r = wrr_get_runtime(machine, pid, comm);
+	if (r == NULL)
+		return -1;
+
+	c = &sched->wrr_cpus[sample->cpu];
+	c->nr_expire++;
+
+	if (r->last_expire && r->last_expire_cpu == (int)sample->cpu &&
+	    sample->time > r->last_expire)
+		update_stats(&c->round, sample->time - r->last_expire);
+
+	r->weight = weight;
+	r->last_expire = sample->time;
+	r->last_expire_cpu = sample->cpu;
+	/* a task alone on its runqueue keeps running after expiry */
+	r->expired = nr_running > 1;
+
+	return 0;
+}
+
+static int wrr_balance_event(struct perf_tool *tool,
+			     struct perf_evsel *evsel,
+			     struct perf_sample *sample,
+			     struct machine *machine)
+{
+	struct perf_sched *sched = container_of(tool, struct perf_sched, tool);
+	const char *comm = perf_evsel__strval(evsel, sample, "comm");
+	const u32 pid = perf_evsel__intval(evsel, sample, "pid");
+	const u32 weight = perf_evsel__intval(evsel, sample, "weight");
+	const int orig_cpu = perf_evsel__intval(evsel, sample, "orig_cpu");
+	const int dest_cpu = perf_evsel__intval(evsel, sample, "dest_cpu");
+	const u32 orig_weight = perf_evsel__intval(evsel, sample, "orig_weight");
+	const u32 dest_weight = perf_evsel__intval(evsel, sample, "dest_weight");
+	struct wrr_runtime *r;
+	u64 slot;
+
+	if (!wrr_valid_cpu(sched, orig_cpu) || !wrr_valid_cpu(sched, dest_cpu))
+		return 0;
+
+	r = wrr_get_runtime(machine, pid, comm);
+	if (r == NULL)
+		return -1;
+
+	r->weight = weight;
+	r->nr_balance++;
+	sched->wrr_cpus[orig_cpu].nr_balance_out++;
+	sched->wrr_cpus[dest_cpu].nr_balance_in++;
+
+	if (!sched->wrr_first_time)
+		sched->wrr_first_time = sample->time;
+
+	slot = (sample->time - sched->wrr_first_time) / sched->wrr_interval;
+	if (slot >= sched->wrr_nr_slots) {
+		u64 nr = max(slot + 1, sched->wrr_nr_slots * 2);
+		u64 *p = realloc(sched->wrr_balance_slots, nr * sizeof(*p));
+
+		if (p == NULL)
+			return -1;
+		memset(p + sched->wrr_nr_slots, 0,
+		       (nr - sched->wrr_nr_slots) * sizeof(*p));
+		sched->wrr_balance_slots = p;
+		sched->wrr_nr_slots = nr;
+	}
+	sched->wrr_balance_slots[slot]++;
+
+	if (sched->show_migrations) {
+		char tstr[64];
+
+		timestamp__scnprintf_usec(sample->time, tstr, sizeof(tstr));
+		printf("%15s  %-16s %7d  weight %2u  cpu %3d (%3u) -> cpu %3d (%3u)\n",
+		       tstr, comm, pid, weight, orig_cpu, orig_weight,
+		       dest_cpu, dest_weight);
+	}
+
+	return 0;
+}
+
+static int wrr_setweight_event(struct perf_tool *tool __maybe_unused,
+			       struct perf_evsel *evsel,
+			       struct perf_sample *sample,
+			       struct machine *machine)
+{
+	const char *comm = perf_evsel__strval(evsel, sample, "comm");
+	const u32 pid = perf_evsel__intval(evsel, sample, "pid");
+	struct wrr_runtime *r;
+
+	r = wrr_get_runtime(machine, pid, comm);
+	if (r == NULL)
+		return -1;
+
+	r->weight = perf_evsel__intval(evsel, sample, "weight");
+	return 0;
+}
+
+static int wrr_migrate_task_event(struct perf_tool *tool __maybe_unused,
+				  struct perf_evsel *evsel,
+				  struct perf_sample *sample,
+				  struct machine *machine)
+{
+	const char *comm = perf_evsel__strval(evsel, sample, "comm");
+	const u32 pid = perf_evsel__intval(evsel, sample, "pid");
+	struct wrr_runtime *r;
+
+	r = wrr_get_runtime(machine, pid, comm);
+	if (r == NULL)
+		return -1;
+
+	r->nr_migrations++;
+	return 0;
+}
+
+static int wrr_sum_thread(struct thread *t, void *priv)
+{
+	struct wrr_totals *totals = priv;
+	struct wrr_runtime *r = thread__priv(t);
+
+	if (r == NULL || !r->runtime)
+		return 0;
+
+	totals->runtime += r->runtime;
+	totals->weight += r->weight;
+	totals->nr_tasks++;
+	return 0;
+}
+
+static int wrr_show_thread(struct thread *t, void *priv)
+{
+	struct wrr_totals *totals = priv;
+	struct wrr_runtime *r = thread__priv(t);
+	double share, weight_share;
+
+	if (r == NULL || !r->runtime)
+		return 0;
+
+	share = 100.0 * r->runtime / totals->runtime;
+	weight_share = 100.0 * r->weight / totals->weight;
+
+	printf("%16s %7d %6u ", r->comm, t->tid, r->weight);
+	print_sched_time(r->runtime, 9);
+	printf("%7.2f %7.2f %7.2f %9" PRIu64 " %9" PRIu64 " %9" PRIu64
+	       " %9" PRIu64 " %9" PRIu64 "\n",
+	       share, weight_share, share / weight_share,
+	       r->nr_expire, r->nr_preempt, r->nr_voluntary,
+	       r->nr_migrations, r->nr_balance);
+	return 0;
+}
+
+static void wrr_print_summary(struct perf_sched *sched,
+			      struct perf_session *session)
+{
+	struct machine *m = &session->machines.host;
+	struct wrr_totals totals = { 0 };
+	u64 i;
+	int cpu;
+
+	machine__for_each_thread(m, wrr_sum_thread, &totals);
+
+	printf("\nWRR share vs. weight\n");
+	printf("%16s %7s %6s %13s %7s %7s %7s %9s %9s %9s %9s %9s\n",
+	       "comm", "pid", "weight", "run-time", "share", "weight", "ratio",
+	       "expire", "preempt", "voluntary", "migrate", "balance");
+	printf("%16s %7s %6s %13s %7s %7s %7s %9s %9s %9s %9s %9s\n",
+	       "", "", "", "(msec)", "(%)", "(%)", "", "", "", "", "", "");
+	printf("%.120s\n", graph_dotted_line);
+
+	if (totals.nr_tasks)
+		machine__for_each_thread(m, wrr_show_thread, &totals);
+	else
+		printf("<no tasks ran>\n");
+
+	printf("\nWRR rounds per CPU\n");
+	printf("%5s %13s %9s %9s %13s %13s %13s %9s %9s\n",
+	       "cpu", "busy", "expire", "rounds", "avg-round", "min-round",
+	       "max-round", "bal-in", "bal-out");
+	printf("%5s %13s %9s %9s %13s %13s %13s %9s %9s\n",
+	       "", "(msec)", "", "", "(msec)", "(msec)", "(msec)", "", "");
+	printf("%.100s\n", graph_dotted_line);
+
+	for (cpu = 0; cpu < sched->max_cpu; cpu++) {
+		struct wrr_cpu_runtime *c = &sched->wrr_cpus[cpu];
+
+		if (!c->busy && !c->nr_expire && !c->nr_balance_in &&
+		    !c->nr_balance_out)
+			continue;
+
+		printf("%5d ", cpu);
+		print_sched_time(c->busy, 9);
+		printf("%9" PRIu64 " %9" PRIu64 " ", c->nr_expire, (u64)c->round.n);
+		if (c->round.n) {
+			print_sched_time(avg_stats(&c->round), 9);
+			print_sched_time(c->round.min, 9);
+			print_sched_time(c->round.max, 9);
+		} else {
+			printf("%13s %13s %13s ", "-", "-", "-");
+		}
+		printf("%9" PRIu64 " %9" PRIu64 "\n",
+		       c->nr_balance_in, c->nr_balance_out);
+	}
+
+	printf("\nWRR balancer migrations per %" PRIu64 " msec\n",
+	       sched->wrr_interval / NSEC_PER_MSEC);
+	if (!sched->wrr_nr_slots)
+		printf("<no balancer migrations>\n");
+	for (i = 0; i < sched->wrr_nr_slots; i++) {
+		printf("%10" PRIu64 " msec  %9" PRIu64 "\n",
+		       i * sched->wrr_interval / NSEC_PER_MSEC,
+		       sched->wrr_balance_slots[i]);
+	}
+}
+
+static int perf_sched__wrr(struct perf_sched *sched)
+{
+	const struct perf_evsel_str_handler handlers[] = {
+		{ "sched:sched_switch",		  wrr_sched_switch_event, },
+		{ "sched:sched_migrate_task",	  wrr_migrate_task_event, },
+	};
+	const struct perf_evsel_str_handler wrr_handlers[] = {
+		{ "sched:sched_wrr_slice_expire", wrr_slice_expire_event, },
+		{ "sched:sched_wrr_balance",	  wrr_balance_event, },
+		{ "sched:sched_wrr_setweight",	  wrr_setweight_event, },
+	};
+	struct perf_data data = {
+		.file      = {
+			.path = input_name,
+		},
+		.mode      = PERF_DATA_MODE_READ,
+		.force     = sched->force,
+	};
+	struct perf_session *session;
+	int cpu, err = -1;
+
+	sched->tool.sample	 = perf_sched__process_tracepoint_sample;
+	sched->tool.comm	 = perf_event__process_comm;
+	sched->tool.exit	 = perf_event__process_exit;
+	sched->tool.fork	 = perf_event__process_fork;
+	sched->tool.lost	 = process_lost;
+	sched->tool.attr	 = perf_event__process_attr;
+	sched->tool.tracing_data = perf_event__process_tracing_data;
+
+	sched->tool.ordered_events = true;
+	sched->tool.ordering_requires_timestamps = true;
+
+	if (!sched->wrr_interval)
+		sched->wrr_interval = 1000;
+	sched->wrr_interval *= NSEC_PER_MSEC;
+
+	session = perf_session__new(&data, false, &sched->tool);
+	if (session == NULL)
+		return -ENOMEM;
+
+	if (perf_session__set_tracepoints_handlers(session, handlers))
+		goto out;
+
+	if (!perf_evlist__find_tracepoint_by_name(session->evlist,
+						  "sched:sched_switch")) {
+		pr_err("No sched_switch events found. Have you run 'perf sched record'?\n");
+		goto out;
+	}
+
+	if (!perf_evlist__find_tracepoint_by_name(session->evlist,
+						  "sched:sched_wrr_slice_expire")) {
+		pr_err("No WRR events found. Was the kernel built with the WRR scheduler?\n");
+		goto out;
+	}
+
+	if (perf_session__set_tracepoints_handlers(session, wrr_handlers))
+		goto out;
+
+	sched->max_cpu = session->header.env.nr_cpus_avail;
+	if (sched->max_cpu == 0)
+		sched->max_cpu = 4;
+
+	sched->wrr_cpus = calloc(sched->max_cpu, sizeof(*sched->wrr_cpus));
+	if (sched->wrr_cpus == NULL)
+		goto out;
+	for (cpu = 0; cpu < sched->max_cpu; cpu++)
+		init_stats(&sched->wrr_cpus[cpu].round);
+
+	setup_pager();
+
+	if (sched->show_migrations)
+		printf("%15s  %-16s %7s  %9s  %-9s %5s    %-9s %5s\n",
+		       "time", "comm", "pid", "weight", "orig cpu", "(total)",
+		       "dest cpu", "(total)");
+
+	err = perf_session__process_events(session);
+	if (err) {
+		pr_err("Failed to process events, error %d", err);
+		goto out;
+	}
+
+	wrr_print_summary(sched, session);
+
+out:
+	zfree(&sched->wrr_cpus);
+	zfree(&sched->wrr_balance_slots);
+	perf_session__delete(session);
+
+	return err;
+}
+
+
 static void print_bad_events(struct perf_sched *sched)
 {
 	if (sched->nr_unordered_timestamps && sched->nr_timestamps) {
@@ -3316,8 +3772,16 @@ static int __cmd_record(int argc, const char **argv)
 		"-e", "sched:sched_wakeup_new",
 		"-e", "sched:sched_migrate_task",
 	};
+	const char * const wrr_args[] = {
+		"-e", "sched:sched_wrr_slice_expire",
+		"-e", "sched:sched_wrr_balance",
+		"-e", "sched:sched_wrr_setweight",
+	};
+	bool wrr = is_valid_tracepoint("sched:sched_wrr_slice_expire");
 
 	rec_argc = ARRAY_SIZE(record_args) + argc - 1;
+	if (wrr)
+		rec_argc += ARRAY_SIZE(wrr_args);
 	rec_argv = calloc(rec_argc + 1, sizeof(char *));
 
 	if (rec_argv == NULL)
@@ -3326,6 +3790,9 @@ static int __cmd_record(int argc, const char **argv)
 	for (i = 0; i < ARRAY_SIZE(record_args); i++)
 		rec_argv[i] = strdup(record_args[i]);
 
+	for (j = 0; wrr && j < ARRAY_SIZE(wrr_args); j++, i++)
+		rec_argv[i] = strdup(wrr_args[j]);
+
 	for (j = 1; j < (unsigned int)argc; j++, i++)
 		rec_argv[i] = argv[j];
 
@@ -3423,6 +3890,13 @@ int cmd_sched(int argc, const char **argv)
 		   "analyze events only for given thread id(s)"),
 	OPT_PARENT(sched_options)
 	};
+	const struct option wrr_options[] = {
+	OPT_BOOLEAN('M', "migrations", &sched.show_migrations,
+		    "Show WRR load balancer migrations"),
+	OPT_U64(0, "interval", &sched.wrr_interval,
+		"Interval in msec to count balancer migrations over (default 1000)"),
+	OPT_PARENT(sched_options)
+	};
 
 	const char * const latency_usage[] = {
 		"perf sched latency [<options>]",
@@ -3440,9 +3914,13 @@ int cmd_sched(int argc, const char **argv)
 		"perf sched timehist [<options>]",
 		NULL
 	};
+	const char * const wrr_usage[] = {
+		"perf sched wrr [<options>]",
+		NULL
+	};
 	const char *const sched_subcommands[] = { "record", "latency", "map",
 						  "replay", "script",
-						  "timehist", NULL };
+						  "timehist", "wrr", NULL };
 	const char *sched_usage[] = {
 		NULL,
 		NULL
@@ -3524,6 +4002,14 @@ int cmd_sched(int argc, const char **argv)
 		}
 
 		return perf_sched__timehist(&sched);
+	} else if (!strcmp(argv[0], "wrr")) {
+		if (argc) {
+			argc = parse_options(argc, argv, wrr_options,
+					     wrr_usage, 0);
+			if (argc)
+				usage_with_options(wrr_usage, wrr_options);
+		}
+		return perf_sched__wrr(&sched);
 	} else {
 		usage_with_options(sched_usage, sched_options);
 	}
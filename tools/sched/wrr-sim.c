@@ -0,0 +1,931 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * wrr-sim: replay a workload on a model of the WRR scheduler.
+ *
+ * The placement, load balancing and timeslice decisions are made by
+ * kernel/sched/wrr_policy.h, the same code kernel/sched/wrr.c runs, on a
+ * modeled machine of N CPUs driven by ticks of 1/HZ seconds. The workload
+ * is either synthetic (-w) or a recording converted with
+ * 'perf sched script' (-t), in which every task becomes a sequence of CPU
+ * bursts and sleeps. Fairness, runqueue latency and migration metrics are
+ * printed at the end.
+ *
+ * Usage:
+ *	perf sched record -- sleep 10
+ *	perf sched script | wrr-sim -c 4 -t -
+ *	wrr-sim -c 4 -w 8:10:0:0 -w 2:20:5:20:0 -d 10
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/list.h>
+#include <linux/time64.h>
+#include <linux/types.h>
+
+#define MAX_CPUS		64
+#define WRR_DEFAULT_WEIGHT	10
+#define PID_HASH_SIZE		4096
+#define U64_MAX			((u64)~0ULL)
+
+/* Shims for the policy shared with kernel/sched/wrr.c */
+
+static unsigned int hz = 250;
+
+/* as in include/linux/sched.h */
+#define WRR_TIMESLICE (10 * hz / 1000) // 10ms
+
+struct sched_wrr_entity {
+	unsigned int weight;
+	unsigned int time_slice;
+	struct list_head run_list;
+};
+
+struct burst {
+	u64 run;			/* ns of CPU time before blocking */
+	u64 sleep;			/* ns asleep afterwards, U64_MAX if the task exits */
+	unsigned int weight;		/* 0 while unknown */
+};
+
+struct sim_task {
+	struct sched_wrr_entity wrr;
+	struct sim_task *hash_next;
+	char comm[16];
+	int pid;
+	int cpu;			/* -1 before the first placement */
+	bool on_rq;
+	u64 allowed;			/* CPU affinity mask */
+
+	struct burst *bursts;
+	int nr_bursts, alloc_bursts;
+	int next_burst;
+	u64 burst_left;
+	u64 wake_at;			/* U64_MAX while runnable or gone */
+	u64 wait_start;
+
+	/* only used while converting a trace */
+	u64 trace_in, trace_run, trace_sleep;
+	unsigned int trace_weight;
+
+	u64 runtime;
+	u64 runnable;			/* ns on a runqueue, running or waiting */
+	u64 enqueue_time;
+	u64 nr_expire;
+	u64 nr_wakeup_migrations;
+	u64 nr_balance_migrations;
+};
+
+struct sim_cpu {
+	struct list_head queue;
+	unsigned int nr_running;
+	unsigned int total_weight;
+	struct sim_task *curr;
+	bool need_resched;
+	u64 busy;
+	unsigned int nr_balance_failed;
+	unsigned int active_backoff;
+};
+
+static struct sim_cpu cpus[MAX_CPUS];
+static int nr_cpus = 4;
+
+static struct sim_task **tasks;
+static int nr_tasks, alloc_tasks;
+static struct sim_task *pid_hash[PID_HASH_SIZE];
+
+static u64 *waits;
+static u64 nr_waits, alloc_waits;
+static u64 nr_balance, nr_balance_migrations, nr_wakeup_migrations;
+static u64 nr_active_balance, nr_active_migrations;
+static u64 imbalance_sum, nr_imbalance_samples;
+
+/* Random CPUs sampled per placement, 0 scans all of them */
+static unsigned int nr_samples;
+static unsigned int sample_seed = 1;
+
+static inline struct sim_task *task_of(struct sched_wrr_entity *wrr_se)
+{
+	return container_of(wrr_se, struct sim_task, wrr);
+}
+
+static int random_cpu(u64 allowed)
+{
+	int cpu = rand_r(&sample_seed) % nr_cpus, i;
+
+	for (i = 0; i < nr_cpus; i++, cpu = (cpu + 1) % nr_cpus) {
+		if (allowed & (1ULL << cpu))
+			return cpu;
+	}
+	return -1;
+}
+
+#define wrr_policy_for_each_cpu(cpu)		for ((cpu) = 0; (cpu) < nr_cpus; (cpu)++)
+#define wrr_policy_cpu_online(cpu)		((cpu) < nr_cpus)
+#define wrr_policy_total_weight(cpu)		(cpus[cpu].total_weight)
+#define wrr_policy_cpu_allowed(wrr_se, cpu)	(task_of(wrr_se)->allowed & (1ULL << (cpu)))
+#define wrr_policy_random_cpu(wrr_se)		random_cpu(task_of(wrr_se)->allowed)
+#define wrr_policy_running(wrr_se, cpu)		(cpus[cpu].curr == task_of(wrr_se))
+#define wrr_policy_may_migrate(wrr_se, src, dst)	((void)(src), (void)(dst), true)
+
+#include "../../kernel/sched/wrr_policy.h"
+
+static void *xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (!ptr) {
+		fprintf(stderr, "wrr-sim: out of memory\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+static struct sim_task *task_new(int pid, const char *comm)
+{
+	struct sim_task *t = xrealloc(NULL, sizeof(*t));
+
+	memset(t, 0, sizeof(*t));
+	t->pid = pid;
+	t->cpu = -1;
+	t->allowed = ~0ULL;
+	t->wake_at = U64_MAX;
+	t->wrr.weight = WRR_DEFAULT_WEIGHT;
+	INIT_LIST_HEAD(&t->wrr.run_list);
+	snprintf(t->comm, sizeof(t->comm), "%s", comm);
+
+	if (nr_tasks == alloc_tasks) {
+		alloc_tasks = alloc_tasks ? alloc_tasks * 2 : 64;
+		tasks = xrealloc(tasks, alloc_tasks * sizeof(*tasks));
+	}
+	tasks[nr_tasks++] = t;
+	return t;
+}
+
+static void task_add_burst(struct sim_task *t, u64 run, u64 sleep, unsigned int weight)
+{
+	if (t->nr_bursts == t->alloc_bursts) {
+		t->alloc_bursts = t->alloc_bursts ? t->alloc_bursts * 2 : 8;
+		t->bursts = xrealloc(t->bursts, t->alloc_bursts * sizeof(*t->bursts));
+	}
+	t->bursts[t->nr_bursts].run = run;
+	t->bursts[t->nr_bursts].sleep = sleep;
+	t->bursts[t->nr_bursts].weight = weight;
+	t->nr_bursts++;
+}
+
+/* Runqueue operations, mirroring kernel/sched/wrr.c */
+
+static void enqueue_task(struct sim_cpu *c, struct sim_task *t, u64 now)
+{
+	list_add_tail(&t->wrr.run_list, &c->queue);
+	t->on_rq = true;
+	t->wait_start = now;
+	t->enqueue_time = now;
+	c->nr_running++;
+	c->total_weight += t->wrr.weight;
+
+	/* An idle CPU is preempted by any task */
+	if (!c->curr)
+		c->need_resched = true;
+}
+
+static void dequeue_task(struct sim_cpu *c, struct sim_task *t, u64 now)
+{
+	list_del_init(&t->wrr.run_list);
+	t->on_rq = false;
+	t->runnable += now - t->enqueue_time;
+	c->nr_running--;
+	c->total_weight -= t->wrr.weight;
+}
+
+static void record_wait(u64 wait)
+{
+	if (nr_waits == alloc_waits) {
+		alloc_waits = alloc_waits ? alloc_waits * 2 : 4096;
+		waits = xrealloc(waits, alloc_waits * sizeof(*waits));
+	}
+	waits[nr_waits++] = wait;
+}
+
+static void schedule(struct sim_cpu *c, u64 now)
+{
+	struct sim_task *prev = c->curr, *next;
+
+	c->need_resched = false;
+
+	/* put_prev_task_wrr() */
+	if (prev && prev->on_rq) {
+		list_move_tail(&prev->wrr.run_list, &c->queue);
+		prev->wait_start = now;
+	}
+
+	/* pick_next_task_wrr() */
+	if (list_empty(&c->queue)) {
+		c->curr = NULL;
+		return;
+	}
+	next = list_first_entry(&c->queue, struct sim_task, wrr.run_list);
+	if (next != prev)
+		record_wait(now - next->wait_start);
+	c->curr = next;
+}
+
+/* Start the next burst of a task, or retire it */
+static bool task_next_burst(struct sim_task *t)
+{
+	struct burst *b;
+
+	if (t->next_burst >= t->nr_bursts)
+		return false;
+
+	b = &t->bursts[t->next_burst++];
+	if (b->weight)
+		t->wrr.weight = b->weight;
+	t->burst_left = b->run;
+	return true;
+}
+
+static void wake_up_task(struct sim_task *t, u64 now)
+{
+	int cpu;
+
+	t->wake_at = U64_MAX;
+	if (!task_next_burst(t))
+		return;
+
+	/* select_task_rq_wrr() */
+	if (nr_samples)
+		cpu = wrr_policy_sample_cpu(&t->wrr, t->cpu, nr_samples);
+	else
+		cpu = wrr_policy_select_cpu(&t->wrr);
+	if (cpu < 0) {
+		fprintf(stderr, "wrr-sim: %s/%d is not allowed on any CPU\n",
+			t->comm, t->pid);
+		exit(1);
+	}
+	if (t->cpu >= 0 && t->cpu != cpu) {
+		t->nr_wakeup_migrations++;
+		nr_wakeup_migrations++;
+	}
+	t->cpu = cpu;
+	enqueue_task(&cpus[cpu], t, now);
+}
+
+/* The current task of c blocked at now */
+static void block_task(struct sim_cpu *c, struct sim_task *t, u64 now)
+{
+	u64 sleep = t->bursts[t->next_burst - 1].sleep;
+
+	dequeue_task(c, t, now);
+	c->need_resched = true;
+
+	if (sleep != U64_MAX && t->next_burst < t->nr_bursts)
+		t->wake_at = now + sleep;
+}
+
+/* Run the tasks of c from now to end */
+static void run_cpu(struct sim_cpu *c, u64 now, u64 end)
+{
+	struct sim_task *t;
+	u64 delta;
+
+	while (now < end) {
+		if (c->need_resched)
+			schedule(c, now);
+
+		t = c->curr;
+		if (!t)
+			return;
+
+		delta = min(end - now, t->burst_left);
+		t->burst_left -= delta;
+		t->runtime += delta;
+		c->busy += delta;
+		now += delta;
+
+		if (!t->burst_left)
+			block_task(c, t, now);
+	}
+}
+
+/* task_tick_wrr() */
+static void tick_cpu(struct sim_cpu *c)
+{
+	struct sim_task *t = c->curr;
+
+	if (!t || !t->on_rq)
+		return;
+
+	if (!wrr_policy_tick(&t->wrr))
+		return;
+
+	t->nr_expire++;
+	if (t->wrr.run_list.prev != t->wrr.run_list.next) {
+		list_move_tail(&t->wrr.run_list, &c->queue);
+		c->need_resched = true;
+	}
+}
+
+static void migrate_task(struct sim_task *t, int src_cpu, int dst_cpu, u64 now)
+{
+	dequeue_task(&cpus[src_cpu], t, now);
+	t->cpu = dst_cpu;
+	enqueue_task(&cpus[dst_cpu], t, now);
+	t->nr_balance_migrations++;
+	nr_balance_migrations++;
+}
+
+/*
+ * wrr_active_balance_cpu_stop(). The stopper runs right away here: it
+ * preempts the running task of max_cpu, then moves a task with the totals
+ * of that moment.
+ */
+static void active_balance(int max_cpu, int min_cpu, u64 now)
+{
+	struct sim_cpu *c = &cpus[max_cpu];
+	struct sched_wrr_entity *wrr_se;
+
+	nr_active_balance++;
+
+	if (c->curr) {
+		list_move_tail(&c->curr->wrr.run_list, &c->queue);
+		c->curr->wait_start = now;
+		c->curr = NULL;
+		c->need_resched = true;
+	}
+
+	wrr_se = wrr_policy_pick_migration(&c->queue, max_cpu, c->total_weight,
+					   min_cpu, cpus[min_cpu].total_weight);
+	if (wrr_se) {
+		migrate_task(task_of(wrr_se), max_cpu, min_cpu, now);
+		nr_active_migrations++;
+		c->active_backoff = 0;
+	} else if (c->active_backoff < WRR_ACTIVE_BALANCE_MAX_SHIFT) {
+		c->active_backoff++;
+	}
+	c->nr_balance_failed = 0;
+}
+
+/* load_balance_wrr() */
+static void load_balance(u64 now)
+{
+	struct sched_wrr_entity *wrr_se;
+	unsigned int max_total, min_total;
+	int max_cpu, min_cpu;
+	struct sim_cpu *c;
+
+	nr_balance++;
+
+	if (!wrr_policy_find_imbalance(&max_cpu, &max_total, &min_cpu, &min_total))
+		return;
+
+	c = &cpus[max_cpu];
+	wrr_se = wrr_policy_pick_migration(&c->queue, max_cpu, max_total,
+					   min_cpu, min_total);
+	if (wrr_se) {
+		c->nr_balance_failed = 0;
+		migrate_task(task_of(wrr_se), max_cpu, min_cpu, now);
+		return;
+	}
+
+	/* wrr_want_active_balance() */
+	if (!c->curr || !c->curr->on_rq ||
+	    !wrr_policy_can_migrate(&c->curr->wrr, max_cpu, max_total, min_cpu, min_total)) {
+		c->nr_balance_failed = 0;
+		return;
+	}
+	if (wrr_policy_active_balance_due(++c->nr_balance_failed, c->active_backoff))
+		active_balance(max_cpu, min_cpu, now);
+}
+
+static void sample_imbalance(void)
+{
+	unsigned int max_total = 0, min_total = UINT_MAX;
+	int cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		max_total = max(max_total, cpus[cpu].total_weight);
+		min_total = min(min_total, cpus[cpu].total_weight);
+	}
+	imbalance_sum += max_total - min_total;
+	nr_imbalance_samples++;
+}
+
+static u64 simulate(u64 duration, u64 balance_interval)
+{
+	u64 tick = NSEC_PER_SEC / hz;
+	u64 next_balance = balance_interval;
+	u64 now;
+	int cpu, i;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		INIT_LIST_HEAD(&cpus[cpu].queue);
+
+	for (i = 0; i < nr_tasks; i++)
+		tasks[i]->wrr.time_slice = wrr_policy_timeslice(&tasks[i]->wrr);
+
+	for (now = 0; now < duration; now += tick) {
+		bool active = false;
+
+		/* scheduler_tick() charges the task that ran up to now */
+		if (now) {
+			for (cpu = 0; cpu < nr_cpus; cpu++)
+				tick_cpu(&cpus[cpu]);
+		}
+
+		if (balance_interval && now >= next_balance) {
+			load_balance(now);
+			next_balance += balance_interval;
+		}
+
+		/* Wakeups are rounded up to the tick they fall into */
+		for (i = 0; i < nr_tasks; i++) {
+			if (tasks[i]->wake_at <= now)
+				wake_up_task(tasks[i], now);
+			if (tasks[i]->on_rq || tasks[i]->wake_at != U64_MAX)
+				active = true;
+		}
+		if (!active)
+			break;
+
+		sample_imbalance();
+
+		for (cpu = 0; cpu < nr_cpus; cpu++)
+			run_cpu(&cpus[cpu], now, now + tick);
+	}
+
+	/* Account tasks still queued at the end */
+	for (i = 0; i < nr_tasks; i++) {
+		if (tasks[i]->on_rq)
+			tasks[i]->runnable += now - tasks[i]->enqueue_time;
+	}
+
+	return now;
+}
+
+/* Synthetic workloads: NR:WEIGHT:RUN_MS:SLEEP_MS[:CPU] */
+
+static unsigned int seed = 1;
+
+static u64 jitter(u64 ns)
+{
+	/* uniform in [ns / 2, ns * 3 / 2) */
+	return ns / 2 + (u64)((double)rand_r(&seed) / ((double)RAND_MAX + 1) * ns);
+}
+
+static int add_synthetic(const char *spec, u64 duration)
+{
+	unsigned int nr, weight, run_ms, sleep_ms;
+	int pin = -1, n, i;
+	char comm[16];
+
+	n = sscanf(spec, "%u:%u:%u:%u:%d", &nr, &weight, &run_ms, &sleep_ms, &pin);
+	if (n < 4 || weight < 1 || weight > 20 || pin >= nr_cpus) {
+		fprintf(stderr, "wrr-sim: bad workload '%s'\n", spec);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < (int)nr; i++) {
+		struct sim_task *t;
+		u64 total = 0;
+
+		snprintf(comm, sizeof(comm), "w%u-%d", weight, nr_tasks);
+		t = task_new(nr_tasks + 1, comm);
+		t->wrr.weight = weight;
+		if (pin >= 0)
+			t->allowed = 1ULL << pin;
+
+		if (!sleep_ms) {
+			/* CPU bound for the whole run */
+			task_add_burst(t, U64_MAX, U64_MAX, weight);
+		} else {
+			while (total < duration) {
+				u64 run = jitter(run_ms * NSEC_PER_MSEC);
+				u64 sleep = jitter(sleep_ms * NSEC_PER_MSEC);
+
+				task_add_burst(t, run ? run : 1, sleep, weight);
+				total += run + sleep;
+			}
+		}
+		t->wake_at = 0;
+	}
+
+	return 0;
+}
+
+/* Traces: the text output of 'perf sched script' */
+
+static struct sim_task *trace_task(int pid, const char *comm)
+{
+	struct sim_task **p = &pid_hash[pid % PID_HASH_SIZE];
+
+	for (; *p; p = &(*p)->hash_next) {
+		if ((*p)->pid == pid)
+			return *p;
+	}
+
+	*p = task_new(pid, comm ? comm : "");
+	return *p;
+}
+
+/* Look up "key=" in an event's fields and return its value */
+static const char *field(const char *fields, const char *key, char *buf, size_t size)
+{
+	size_t len = strlen(key);
+	const char *p = fields;
+
+	while ((p = strstr(p, key)) != NULL) {
+		if ((p == fields || p[-1] == ' ') && p[len] == '=') {
+			size_t n = strcspn(p + len + 1, " ");
+
+			if (n >= size)
+				n = size - 1;
+			memcpy(buf, p + len + 1, n);
+			buf[n] = '\0';
+			return buf;
+		}
+		p += len;
+	}
+	return NULL;
+}
+
+static long field_long(const char *fields, const char *key, long def)
+{
+	char buf[32];
+
+	if (!field(fields, key, buf, sizeof(buf)))
+		return def;
+	return strtol(buf, NULL, 10);
+}
+
+/* A task's weight became known; bursts recorded before it had it too */
+static void trace_set_weight(struct sim_task *t, unsigned int old_weight,
+			     unsigned int weight)
+{
+	int i;
+
+	for (i = t->nr_bursts - 1; i >= 0 && !t->bursts[i].weight; i--)
+		t->bursts[i].weight = old_weight;
+	t->trace_weight = weight;
+}
+
+static void trace_switch(const char *fields, u64 ts)
+{
+	char comm[32], state[8];
+	struct sim_task *t;
+	int pid;
+
+	pid = field_long(fields, "prev_pid", 0);
+	if (pid > 0) {
+		t = trace_task(pid, field(fields, "prev_comm", comm, sizeof(comm)));
+		if (t->trace_in) {
+			t->trace_run += ts - t->trace_in;
+			t->trace_in = 0;
+		}
+
+		if (!field(fields, "prev_state", state, sizeof(state)))
+			state[0] = 'R';
+		if (state[0] != 'R') {
+			bool dead = strchr(state, 'X') || strchr(state, 'Z');
+
+			task_add_burst(t, t->trace_run ? t->trace_run : 1,
+				       dead ? U64_MAX : 0, t->trace_weight);
+			t->trace_run = 0;
+			t->trace_sleep = dead ? 0 : ts;
+		}
+	}
+
+	pid = field_long(fields, "next_pid", 0);
+	if (pid > 0) {
+		t = trace_task(pid, field(fields, "next_comm", comm, sizeof(comm)));
+		if (t->trace_sleep) {
+			/* the wakeup was not recorded */
+			t->bursts[t->nr_bursts - 1].sleep = ts - t->trace_sleep;
+			t->trace_sleep = 0;
+		} else if (!t->nr_bursts && !t->trace_run && t->wake_at == U64_MAX) {
+			t->wake_at = ts;
+		}
+		t->trace_in = ts;
+	}
+}
+
+static void trace_wakeup(const char *fields, u64 ts)
+{
+	char comm[32];
+	struct sim_task *t;
+	int pid = field_long(fields, "pid", 0);
+
+	if (pid <= 0)
+		return;
+
+	t = trace_task(pid, field(fields, "comm", comm, sizeof(comm)));
+	if (t->trace_sleep) {
+		t->bursts[t->nr_bursts - 1].sleep = ts - t->trace_sleep;
+		t->trace_sleep = 0;
+	} else if (!t->nr_bursts && t->wake_at == U64_MAX) {
+		t->wake_at = ts;
+	}
+}
+
+static void trace_weight(const char *fields, bool setweight)
+{
+	char comm[32];
+	struct sim_task *t;
+	int pid = field_long(fields, "pid", 0);
+	long weight = field_long(fields, "weight", 0);
+
+	if (pid <= 0 || weight < 1 || weight > 20)
+		return;
+
+	t = trace_task(pid, field(fields, "comm", comm, sizeof(comm)));
+	if (setweight)
+		trace_set_weight(t, field_long(fields, "old_weight", weight), weight);
+	else
+		trace_set_weight(t, weight, weight);
+}
+
+static int load_trace(const char *path)
+{
+	FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	u64 first = 0, last = 0;
+	char line[1024];
+	int i;
+
+	if (!f) {
+		fprintf(stderr, "wrr-sim: %s: %s\n", path, strerror(errno));
+		return -errno;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long sec, usec;
+		char event[64];
+		const char *p;
+		int n = 0;
+		u64 ts;
+
+		/* "comm pid [cpu] sec.usec: sched:event: fields" */
+		p = strchr(line, ']');
+		if (!p || sscanf(p + 1, " %lu.%lu: %63[^:]:%63[^:]: %n",
+				 &sec, &usec, event, event, &n) < 4 || !n)
+			continue;
+		line[strcspn(line, "\n")] = '\0';
+
+		ts = sec * NSEC_PER_SEC + usec * NSEC_PER_USEC;
+		if (!first)
+			first = ts;
+		ts -= first - 1;
+		last = ts;
+
+		if (!strcmp(event, "sched_switch"))
+			trace_switch(p + 1 + n, ts);
+		else if (!strcmp(event, "sched_wakeup") ||
+			 !strcmp(event, "sched_wakeup_new"))
+			trace_wakeup(p + 1 + n, ts);
+		else if (!strcmp(event, "sched_wrr_setweight"))
+			trace_weight(p + 1 + n, true);
+		else if (!strcmp(event, "sched_wrr_slice_expire") ||
+			 !strcmp(event, "sched_wrr_balance"))
+			trace_weight(p + 1 + n, false);
+	}
+
+	if (f != stdin)
+		fclose(f);
+
+	/* Close the bursts still open at the end of the recording */
+	for (i = 0; i < nr_tasks; i++) {
+		struct sim_task *t = tasks[i];
+
+		if (t->trace_in)
+			t->trace_run += last - t->trace_in;
+		if (t->trace_run)
+			task_add_burst(t, t->trace_run, U64_MAX, t->trace_weight);
+		if (t->trace_sleep)
+			t->bursts[t->nr_bursts - 1].sleep = U64_MAX;
+		if (!t->nr_bursts)
+			t->wake_at = U64_MAX;
+	}
+
+	return 0;
+}
+
+/* Report */
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double ms(u64 ns)
+{
+	return (double)ns / NSEC_PER_MSEC;
+}
+
+static u64 percentile(double pct)
+{
+	if (!nr_waits)
+		return 0;
+	return waits[(u64)(pct / 100 * (nr_waits - 1))];
+}
+
+static void report(u64 elapsed, bool parseable, bool verbose)
+{
+	double sum = 0, sum_sq = 0, jain = 1, wait_avg = 0;
+	u64 total_runtime = 0, total_busy = 0, weight_runtime[21] = { 0 };
+	unsigned int weight_tasks[21] = { 0 }, total_weight = 0;
+	int i, n = 0, cpu;
+
+	for (i = 0; i < nr_tasks; i++) {
+		struct sim_task *t = tasks[i];
+		double x;
+
+		if (!t->runnable)
+			continue;
+
+		/* share of CPU per unit of weight while the task was runnable */
+		x = (double)t->runtime / t->runnable / t->wrr.weight;
+		sum += x;
+		sum_sq += x * x;
+		n++;
+
+		total_runtime += t->runtime;
+		total_weight += t->wrr.weight;
+		weight_runtime[t->wrr.weight] += t->runtime;
+		weight_tasks[t->wrr.weight]++;
+	}
+	if (n && sum_sq)
+		jain = sum * sum / (n * sum_sq);
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		total_busy += cpus[cpu].busy;
+
+	qsort(waits, nr_waits, sizeof(*waits), cmp_u64);
+	for (i = 0; i < (int)nr_waits; i++)
+		wait_avg += waits[i];
+	if (nr_waits)
+		wait_avg /= nr_waits;
+
+	if (parseable) {
+		printf("cpus=%d hz=%u samples=%u elapsed_ms=%.3f tasks=%d jain=%.4f util=%.4f"
+		       " wait_avg_ms=%.3f wait_p50_ms=%.3f wait_p99_ms=%.3f wait_max_ms=%.3f"
+		       " wakeup_migrations=%" PRIu64 " balance_migrations=%" PRIu64
+		       " balance_passes=%" PRIu64 " active_balance=%" PRIu64
+		       " active_migrations=%" PRIu64 " avg_imbalance=%.2f\n",
+		       nr_cpus, hz, nr_samples, ms(elapsed), n, jain,
+		       elapsed ? (double)total_busy / elapsed / nr_cpus : 0,
+		       wait_avg / NSEC_PER_MSEC, ms(percentile(50)), ms(percentile(99)),
+		       ms(percentile(100)), nr_wakeup_migrations, nr_balance_migrations,
+		       nr_balance, nr_active_balance, nr_active_migrations,
+		       nr_imbalance_samples ? (double)imbalance_sum / nr_imbalance_samples : 0);
+		return;
+	}
+
+	printf("%d CPUs, HZ=%u, %.3f ms simulated, %d tasks\n", nr_cpus, hz, ms(elapsed), n);
+	if (nr_samples)
+		printf("Placement on the lightest of the last CPU and %u random ones\n", nr_samples);
+	printf("\n");
+
+	printf("Fairness\n");
+	printf("  Jain index of runtime / (runnable time * weight): %.4f\n", jain);
+	printf("  %6s %6s %13s %9s %9s\n", "weight", "tasks", "runtime(ms)", "share(%)", "weight(%)");
+	for (i = 1; i <= 20; i++) {
+		if (!weight_tasks[i])
+			continue;
+		printf("  %6d %6u %13.3f %9.2f %9.2f\n", i, weight_tasks[i],
+		       ms(weight_runtime[i]),
+		       total_runtime ? 100.0 * weight_runtime[i] / total_runtime : 0,
+		       100.0 * i * weight_tasks[i] / total_weight);
+	}
+
+	printf("\nLatency (runqueue wait before running, ms)\n");
+	printf("  waits %" PRIu64 "  avg %.3f  p50 %.3f  p99 %.3f  max %.3f\n",
+	       nr_waits, wait_avg / NSEC_PER_MSEC, ms(percentile(50)),
+	       ms(percentile(99)), ms(percentile(100)));
+
+	printf("\nMigrations\n");
+	printf("  wakeup %" PRIu64 "  balance %" PRIu64 " in %" PRIu64 " passes\n",
+	       nr_wakeup_migrations, nr_balance_migrations, nr_balance);
+	printf("  active pushes %" PRIu64 ", %" PRIu64 " of them moved a task\n",
+	       nr_active_balance, nr_active_migrations);
+	printf("  average max-min total weight %.2f\n",
+	       nr_imbalance_samples ? (double)imbalance_sum / nr_imbalance_samples : 0);
+
+	printf("\nCPUs\n");
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		printf("  cpu%-3d busy %6.2f%%\n", cpu,
+		       elapsed ? 100.0 * cpus[cpu].busy / elapsed : 0);
+
+	if (!verbose)
+		return;
+
+	printf("\nTasks\n");
+	printf("  %-16s %7s %6s %13s %13s %7s %7s %7s\n", "comm", "pid", "weight",
+	       "runtime(ms)", "runnable(ms)", "expire", "wakemig", "balmig");
+	for (i = 0; i < nr_tasks; i++) {
+		struct sim_task *t = tasks[i];
+
+		if (!t->runnable)
+			continue;
+		printf("  %-16s %7d %6u %13.3f %13.3f %7" PRIu64 " %7" PRIu64 " %7" PRIu64 "\n",
+		       t->comm, t->pid, t->wrr.weight, ms(t->runtime), ms(t->runnable),
+		       t->nr_expire, t->nr_wakeup_migrations, t->nr_balance_migrations);
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: wrr-sim [options]\n"
+		"  -c CPUS        number of modeled CPUs (default 4, at most %d)\n"
+		"  -H HZ          tick rate (default 250)\n"
+		"  -b MS          load balancing interval, 0 disables it (default 2000)\n"
+		"  -d SEC         stop after SEC seconds (default 10, or the whole trace)\n"
+		"  -t FILE        replay 'perf sched script' output, - for stdin\n"
+		"  -w SPEC        add synthetic tasks, SPEC is NR:WEIGHT:RUN_MS:SLEEP_MS[:CPU];\n"
+		"                 SLEEP_MS 0 makes them CPU bound, CPU pins them\n"
+		"  -s SEED        seed of the synthetic burst jitter and CPU sampling (default 1)\n"
+		"  -S NR          place tasks on the lightest of their last CPU and NR\n"
+		"                 random ones, like sched_wrr_select_mode 1 (default 0,\n"
+		"                 which scans all CPUs)\n"
+		"  -p             print one line of key=value metrics\n"
+		"  -v             print per task metrics\n",
+		MAX_CPUS);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *trace = NULL;
+	char **specs = NULL;
+	int nr_specs = 0, opt, i;
+	u64 duration = 0, balance_interval = 2000 * NSEC_PER_MSEC, elapsed;
+	bool parseable = false, verbose = false;
+
+	while ((opt = getopt(argc, argv, "c:H:b:d:t:w:s:S:pvh")) != -1) {
+		switch (opt) {
+		case 'c':
+			nr_cpus = atoi(optarg);
+			break;
+		case 'H':
+			hz = atoi(optarg);
+			break;
+		case 'b':
+			balance_interval = strtoull(optarg, NULL, 10) * NSEC_PER_MSEC;
+			break;
+		case 'd':
+			duration = strtoull(optarg, NULL, 10) * NSEC_PER_SEC;
+			break;
+		case 't':
+			trace = optarg;
+			break;
+		case 'w':
+			specs = xrealloc(specs, (nr_specs + 1) * sizeof(*specs));
+			specs[nr_specs++] = optarg;
+			break;
+		case 's':
+			seed = sample_seed = atoi(optarg);
+			break;
+		case 'S':
+			nr_samples = atoi(optarg);
+			break;
+		case 'p':
+			parseable = true;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind != argc || nr_cpus < 1 || nr_cpus > MAX_CPUS || (!trace && !nr_specs))
+		usage();
+
+	/* WRR_TIMESLICE must be at least one tick */
+	if (hz < 100 || hz > 1000) {
+		fprintf(stderr, "wrr-sim: HZ must be between 100 and 1000\n");
+		return 1;
+	}
+
+	if (trace && load_trace(trace))
+		return 1;
+
+	if (!duration)
+		duration = trace ? U64_MAX : 10 * NSEC_PER_SEC;
+
+	for (i = 0; i < nr_specs; i++) {
+		if (add_synthetic(specs[i], duration))
+			return 1;
+	}
+
+	elapsed = simulate(duration, balance_interval);
+	report(elapsed, parseable, verbose);
+
+	return 0;
+}
@@ -2153,19 +2153,34 @@ out:
 	return ret;
 }
 
+/*
+ * Polling is charged to the WRR timeslice of the vCPU thread like any
+ * other run time.  Don't poll past the end of the slice, where the
+ * scheduler would hand the CPU to the next task anyway.
+ */
+static u64 kvm_halt_poll_window(struct kvm_vcpu *vcpu)
+{
+	u64 poll_ns = vcpu->halt_poll_ns;
+
+	if (current->policy == SCHED_WRR)
+		poll_ns = min_t(u64, poll_ns,
+				(u64)READ_ONCE(current->wrr.time_slice) * TICK_NSEC);
+	return poll_ns;
+}
+
 /*
  * The vCPU has executed a HLT instruction with in-kernel mode enabled.
  */
 void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 {
-	ktime_t start, cur;
+	ktime_t start, cur, poll_end;
 	DECLARE_SWAITQUEUE(wait);
-	bool waited = false;
+	bool waited = false, yielded = false;
 	u64 block_ns;
 
-	start = cur = ktime_get();
+	start = cur = poll_end = ktime_get();
 	if (vcpu->halt_poll_ns) {
-		ktime_t stop = ktime_add_ns(ktime_get(), vcpu->halt_poll_ns);
+		ktime_t stop = ktime_add_ns(start, kvm_halt_poll_window(vcpu));
 
 		++vcpu->stat.halt_attempted_poll;
 		do {
@@ -2177,10 +2192,21 @@ void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 				++vcpu->stat.halt_successful_poll;
 				if (!vcpu_valid_wakeup(vcpu))
 					++vcpu->stat.halt_poll_invalid;
+				cur = poll_end = ktime_get();
 				goto out;
 			}
 			cur = ktime_get();
+		/*
+		 * Other tasks on this CPU would wait for the rest of our
+		 * timeslice: give way to them.
+		 */
 		} while (single_task_running() && ktime_before(cur, stop));
+
+		if (ktime_before(cur, stop)) {
+			++vcpu->stat.halt_poll_yield;
+			yielded = true;
+		}
+		poll_end = cur;
 	}
 
 	kvm_arch_vcpu_blocking(vcpu);
@@ -2202,6 +2228,11 @@ void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 out:
 	block_ns = ktime_to_ns(cur) - ktime_to_ns(start);
 
+	if (waited)
+		vcpu->stat.halt_poll_fail_ns += ktime_to_ns(poll_end) - ktime_to_ns(start);
+	else
+		vcpu->stat.halt_poll_success_ns += ktime_to_ns(poll_end) - ktime_to_ns(start);
+
 	if (!vcpu_valid_wakeup(vcpu))
 		shrink_halt_poll_ns(vcpu);
 	else if (halt_poll_ns) {
@@ -2210,8 +2241,11 @@ out:
 		/* we had a long block, shrink polling */
 		else if (vcpu->halt_poll_ns && block_ns > halt_poll_ns)
 			shrink_halt_poll_ns(vcpu);
-		/* we had a short halt and our poll time is too small */
-		else if (vcpu->halt_poll_ns < halt_poll_ns &&
+		/*
+		 * we had a short halt and our poll time is too small, unless
+		 * the poll was cut short by other tasks
+		 */
+		else if (!yielded && vcpu->halt_poll_ns < halt_poll_ns &&
 			block_ns < halt_poll_ns)
 			grow_halt_poll_ns(vcpu);
 	} else